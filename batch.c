@@ -0,0 +1,445 @@
+/*
+The batch runner. Runs the jobs of a manifest on a pool of worker threads,
+one machine per job, in this process. A manifest has one job per line:
+
+    <disk image> <input file> <output file> [setting=value ...]
+
+An input file of - gives the job no console input. The settings are
+timer, disk and console, taking the same values as the options of the
+same names, limit, the most instructions the job may run, and overlay,
+one of none, discard or commit. Blank lines and lines starting with #
+are skipped.
+
+Console output and the exception that stops a job go to its output file.
+The status of every job is printed once all of them have finished.
+*/
+
+#include "batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Run the jobs of the manifest on the given number of workers */
+int batch_run(const char *manifest, const xsm_config *config, int overlay, int workers)
+{
+    batch_pool pool;
+    batch_worker *state;
+    pthread_t *threads;
+    int i, started, result;
+
+    memset(&pool, 0, sizeof(batch_pool));
+
+    if (!batch_read_manifest(&pool, manifest, config, overlay))
+    {
+        batch_free(&pool);
+        return XSM_FAILURE;
+    }
+
+    if (workers > pool.num_jobs)
+        workers = pool.num_jobs;
+
+    if (workers < 1)
+        workers = 1;
+
+    pool.num_workers = workers;
+    pool.deques = (batch_deque *)calloc(workers, sizeof(batch_deque));
+    state = (batch_worker *)calloc(workers, sizeof(batch_worker));
+    threads = (pthread_t *)calloc(workers, sizeof(pthread_t));
+
+    if (!pool.deques || !state || !threads)
+    {
+        free(state);
+        free(threads);
+        batch_free(&pool);
+        return XSM_FAILURE;
+    }
+
+    /* Every worker starts with an even share of consecutive jobs */
+    for (i = 0; i < workers; ++i)
+    {
+        pool.deques[i].head = (int)((long long)pool.num_jobs * i / workers);
+        pool.deques[i].tail = (int)((long long)pool.num_jobs * (i + 1) / workers);
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+
+        state[i].pool = &pool;
+        state[i].id = i;
+    }
+
+    /*
+    The calling thread is the first worker. Jobs of a worker that could not
+    be started are stolen by the others.
+    */
+    for (started = 1; started < workers; ++started)
+        if (pthread_create(&threads[started], NULL, batch_worker_run, &state[started]) != 0)
+            break;
+
+    batch_worker_run(&state[0]);
+
+    for (i = 1; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    batch_report(&pool);
+
+    result = XSM_SUCCESS;
+
+    for (i = 0; i < pool.num_jobs; ++i)
+        if (pool.jobs[i].status == BATCH_JOB_FAILED)
+            result = XSM_FAILURE;
+
+    for (i = 0; i < workers; ++i)
+        pthread_mutex_destroy(&pool.deques[i].lock);
+
+    free(state);
+    free(threads);
+    batch_free(&pool);
+
+    return result;
+}
+
+/* Read the jobs of the manifest */
+int batch_read_manifest(batch_pool *pool, const char *manifest, const xsm_config *config, int overlay)
+{
+    char line[BATCH_LINE_LEN];
+    batch_job *jobs;
+    FILE *fp;
+    int capacity, line_num, result;
+
+    fp = fopen(manifest, "r");
+
+    if (!fp)
+    {
+        fprintf(stderr, "Could not open the manifest %s\n", manifest);
+        return XSM_FAILURE;
+    }
+
+    capacity = 0;
+    line_num = 0;
+    result = XSM_SUCCESS;
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        line_num++;
+
+        if (pool->num_jobs == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 64;
+            jobs = (batch_job *)realloc(pool->jobs, capacity * sizeof(batch_job));
+
+            if (!jobs)
+            {
+                result = XSM_FAILURE;
+                break;
+            }
+
+            pool->jobs = jobs;
+        }
+
+        switch (batch_parse_job(&pool->jobs[pool->num_jobs], line, config, overlay))
+        {
+            case XSM_SUCCESS:
+                pool->num_jobs++;
+                break;
+
+            case XSM_FAILURE:
+                fprintf(stderr, "%s:%d: Malformed job\n", manifest, line_num);
+                result = XSM_FAILURE;
+                break;
+        }
+    }
+
+    fclose(fp);
+    return result;
+}
+
+/*
+Fill in the job from a line of the manifest, starting from the given
+settings. Returns -1 for a line without a job.
+*/
+int batch_parse_job(batch_job *job, char *line, const xsm_config *config, int overlay)
+{
+    char *fields[3], *setting, *save;
+    int i;
+
+    memset(job, 0, sizeof(batch_job));
+
+    job->config = *config;
+    job->overlay = overlay;
+
+    for (i = 0; i < 3; ++i)
+    {
+        fields[i] = strtok_r(i == 0 ? line : NULL, " \t\r\n", &save);
+
+        if (!fields[i])
+            break;
+    }
+
+    if (i == 0 || fields[0][0] == '#')
+        return -1;
+
+    if (i < 3)
+        return XSM_FAILURE;
+
+    while ((setting = strtok_r(NULL, " \t\r\n", &save)))
+        if (!batch_parse_setting(job, setting))
+            return XSM_FAILURE;
+
+    job->disk = strdup(fields[0]);
+    job->input = strdup(fields[1]);
+    job->output = strdup(fields[2]);
+
+    if (!job->disk || !job->input || !job->output)
+    {
+        free(job->disk);
+        free(job->input);
+        free(job->output);
+        return XSM_FAILURE;
+    }
+
+    return XSM_SUCCESS;
+}
+
+/* Apply a setting=value field of a job */
+int batch_parse_setting(batch_job *job, const char *setting)
+{
+    const char *value;
+    int val;
+
+    value = strchr(setting, '=');
+
+    if (!value)
+        return XSM_FAILURE;
+
+    value++;
+    val = atoi(value);
+
+    if (!strncmp(setting, "timer=", 6))
+    {
+        if (val < 0 || val > 1024)
+            return XSM_FAILURE;
+
+        job->config.timer = val ? val + 1 : 0;
+    }
+    else if (!strncmp(setting, "disk=", 5) || !strncmp(setting, "console=", 8))
+    {
+        if (val < 20 || val > 1024)
+            return XSM_FAILURE;
+
+        if (setting[0] == 'd')
+            job->config.disk = val + 1;
+        else
+            job->config.console = val + 1;
+    }
+    else if (!strncmp(setting, "limit=", 6))
+    {
+        job->limit = atoll(value);
+
+        if (job->limit <= 0)
+            return XSM_FAILURE;
+    }
+    else if (!strncmp(setting, "overlay=", 8))
+    {
+        if (!strcmp(value, "none"))
+            job->overlay = XSM_DISK_OVERLAY_NONE;
+        else if (!strcmp(value, "discard"))
+            job->overlay = XSM_DISK_OVERLAY_DISCARD;
+        else if (!strcmp(value, "commit"))
+            job->overlay = XSM_DISK_OVERLAY_COMMIT;
+        else
+            return XSM_FAILURE;
+    }
+    else
+        return XSM_FAILURE;
+
+    return XSM_SUCCESS;
+}
+
+/* Run jobs until there are none left to take or steal */
+void *batch_worker_run(void *arg)
+{
+    batch_worker *worker = (batch_worker *)arg;
+    int job;
+
+    while ((job = batch_next_job(worker)) >= 0)
+        batch_run_job(&worker->pool->jobs[job]);
+
+    return NULL;
+}
+
+/* Returns the next job for the worker, -1 once every job has been taken */
+int batch_next_job(batch_worker *worker)
+{
+    batch_pool *pool = worker->pool;
+    int i, job;
+
+    job = batch_take_job(&pool->deques[worker->id], FALSE);
+
+    /* Steal from the others, starting after this worker */
+    for (i = 1; job < 0 && i < pool->num_workers; ++i)
+        job = batch_take_job(&pool->deques[(worker->id + i) % pool->num_workers], TRUE);
+
+    return job;
+}
+
+/* Take a job from the head of the deque, or steal one from its tail */
+int batch_take_job(batch_deque *deque, int steal)
+{
+    int job = -1;
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->head < deque->tail)
+    {
+        if (steal)
+            job = --deque->tail;
+        else
+            job = deque->head++;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+    return job;
+}
+
+/* Run the job on a machine of its own */
+void batch_run_job(batch_job *job)
+{
+    xsm_machine *machine;
+    int state;
+
+    job->output_fp = fopen(job->output, "w");
+
+    if (!job->output_fp)
+    {
+        job->status = BATCH_JOB_FAILED;
+        snprintf(job->message, BATCH_MESSAGE_LEN, "Could not open %s", job->output);
+        return;
+    }
+
+    if (strcmp(job->input, "-"))
+    {
+        job->input_fp = fopen(job->input, "r");
+
+        if (!job->input_fp)
+        {
+            job->status = BATCH_JOB_FAILED;
+            snprintf(job->message, BATCH_MESSAGE_LEN, "Could not open %s", job->input);
+            fclose(job->output_fp);
+            return;
+        }
+    }
+
+    machine = xsm_create(&job->config);
+
+    if (!machine || !xsm_attach_disk(machine, job->disk, job->overlay))
+    {
+        job->status = BATCH_JOB_FAILED;
+        snprintf(job->message, BATCH_MESSAGE_LEN, "Could not set up a machine on %s", job->disk);
+    }
+    else
+    {
+        xsm_set_console(machine, batch_console_write, batch_console_read, job);
+        xsm_set_console_error(machine, batch_console_error);
+
+        if (job->limit)
+            state = xsm_run_for(machine, job->limit);
+        else
+            state = xsm_run(machine);
+
+        if (state == XSM_HALTED)
+            job->status = BATCH_JOB_HALTED;
+        else if (state == XSM_STOPPED)
+        {
+            job->status = BATCH_JOB_STOPPED;
+            snprintf(job->message, BATCH_MESSAGE_LEN, "%s", xsm_error(machine));
+        }
+        else
+            job->status = BATCH_JOB_LIMIT;
+    }
+
+    if (machine)
+        xsm_destroy(machine);
+
+    if (job->input_fp)
+        fclose(job->input_fp);
+
+    fclose(job->output_fp);
+}
+
+/* Console output of a job */
+void batch_console_write(void *data, const char *text)
+{
+    batch_job *job = (batch_job *)data;
+
+    fprintf(job->output_fp, "%s\n", text);
+}
+
+/* Console input of a job */
+int batch_console_read(void *data, char *buffer, int size)
+{
+    batch_job *job = (batch_job *)data;
+
+    if (!job->input_fp)
+        return FALSE;
+
+    return fgets(buffer, size, job->input_fp) != NULL;
+}
+
+/* The exception that stopped a job, as the simulator prints it */
+void batch_console_error(void *data, const char *message)
+{
+    batch_job *job = (batch_job *)data;
+
+    fprintf(job->output_fp, "-----------------------------------\n");
+    fprintf(job->output_fp, "%s.\n", message);
+}
+
+/* Print the status of every job, in the order of the manifest */
+void batch_report(batch_pool *pool)
+{
+    batch_job *job;
+    int i;
+
+    for (i = 0; i < pool->num_jobs; ++i)
+    {
+        job = &pool->jobs[i];
+
+        switch (job->status)
+        {
+            case BATCH_JOB_HALTED:
+                printf("%s: halted\n", job->output);
+                break;
+
+            case BATCH_JOB_STOPPED:
+                printf("%s: stopped: %s\n", job->output, job->message);
+                break;
+
+            case BATCH_JOB_LIMIT:
+                printf("%s: limit\n", job->output);
+                break;
+
+            default:
+                printf("%s: failed: %s\n", job->output, job->message);
+                break;
+        }
+    }
+}
+
+/* Deallocate the jobs and the workers */
+void batch_free(batch_pool *pool)
+{
+    int i;
+
+    for (i = 0; i < pool->num_jobs; ++i)
+    {
+        free(pool->jobs[i].disk);
+        free(pool->jobs[i].input);
+        free(pool->jobs[i].output);
+    }
+
+    free(pool->jobs);
+    free(pool->deques);
+
+    pool->jobs = NULL;
+    pool->deques = NULL;
+    pool->num_jobs = 0;
+}
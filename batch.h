@@ -0,0 +1,81 @@
+#ifndef XSM_BATCH_H
+
+#define XSM_BATCH_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "libxsm.h"
+#include "types.h"
+
+/* Longest line of a manifest */
+#define BATCH_LINE_LEN 4096
+
+/* Longest message kept for a job */
+#define BATCH_MESSAGE_LEN 256
+
+/* How a job ended */
+#define BATCH_JOB_PENDING 0
+#define BATCH_JOB_HALTED 1
+#define BATCH_JOB_STOPPED 2     /* Exception in KERNEL mode */
+#define BATCH_JOB_LIMIT 3       /* Ran out of instructions */
+#define BATCH_JOB_FAILED 4      /* Could not be started */
+
+typedef struct _batch_job
+{
+    char *disk;
+    char *input;
+    char *output;
+
+    xsm_config config;
+    int overlay;
+
+    /* Instructions the job may run, 0 for no limit */
+    long long limit;
+
+    FILE *input_fp, *output_fp;
+
+    int status;
+    char message[BATCH_MESSAGE_LEN];
+} batch_job;
+
+/*
+Jobs left to a worker, the indices from head up to tail. The worker takes
+them from the head, other workers steal from the tail.
+*/
+typedef struct _batch_deque
+{
+    int head, tail;
+    pthread_mutex_t lock;
+} batch_deque;
+
+typedef struct _batch_pool
+{
+    batch_job *jobs;
+    int num_jobs;
+
+    batch_deque *deques;
+    int num_workers;
+} batch_pool;
+
+typedef struct _batch_worker
+{
+    batch_pool *pool;
+    int id;
+} batch_worker;
+
+int batch_run(const char *manifest, const xsm_config *config, int overlay, int workers);
+int batch_read_manifest(batch_pool *pool, const char *manifest, const xsm_config *config, int overlay);
+int batch_parse_job(batch_job *job, char *line, const xsm_config *config, int overlay);
+int batch_parse_setting(batch_job *job, const char *setting);
+void *batch_worker_run(void *arg);
+int batch_next_job(batch_worker *worker);
+int batch_take_job(batch_deque *deque, int steal);
+void batch_run_job(batch_job *job);
+void batch_console_write(void *data, const char *text);
+int batch_console_read(void *data, char *buffer, int size);
+void batch_console_error(void *data, const char *message);
+void batch_report(batch_pool *pool);
+void batch_free(batch_pool *pool);
+
+#endif
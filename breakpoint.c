@@ -0,0 +1,497 @@
+/*
+Breakpoints of the debugger. They are kept in a hash table by IP that is
+looked up once per instruction, so a run with breakpoints set goes on at
+the speed of the debugger stepping silently. A condition is compiled to a
+few stack operations when the breakpoint is set, and evaluated only when
+its IP is reached:
+
+    condition := and { "||" and }
+    and       := compare { "&&" compare }
+    compare   := sum [ ("==" | "!=" | "<=" | ">=" | "<" | ">") sum ]
+    sum       := product { ("+" | "-") product }
+    product   := unary { ("*" | "/" | "%") unary }
+    unary     := ("!" | "-") unary | primary
+    primary   := number | register | "[" sum "]" | "(" condition ")"
+
+Memory is addressed as an instruction would, through the page table in
+USER mode. A condition reading a word that is not an integer, an address
+that can not be reached or dividing by zero does not hold.
+*/
+
+#include "breakpoint.h"
+
+#include "machine.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Remove every breakpoint */
+void breakpoint_clear(xsm_machine *machine)
+{
+    memset(&machine->breakpoints, 0, sizeof(xsm_breakpoints));
+}
+
+/* Set a breakpoint at the given IP, replacing one already there, with an optional condition */
+int breakpoint_add(xsm_machine *machine, int ip, const char *condition)
+{
+    xsm_breakpoints *breakpoints = &machine->breakpoints;
+    breakpoint compiled, *bp;
+    int slot;
+
+    if (!breakpoint_compile(&compiled, condition))
+        return XSM_FAILURE;
+
+    compiled.used = TRUE;
+    compiled.ip = ip;
+
+    bp = breakpoint_find(machine, ip);
+
+    if (bp)
+    {
+        *bp = compiled;
+        return XSM_SUCCESS;
+    }
+
+    if (breakpoints->count >= BREAKPOINT_MAX)
+        return XSM_FAILURE;
+
+    for (slot = breakpoint_slot(ip); breakpoints->slots[slot].used; slot = (slot + 1) & (BREAKPOINT_SLOTS - 1))
+        ;
+
+    breakpoints->slots[slot] = compiled;
+    breakpoints->count++;
+
+    return XSM_SUCCESS;
+}
+
+/* Remove the breakpoint at the given IP */
+int breakpoint_remove(xsm_machine *machine, int ip)
+{
+    xsm_breakpoints *breakpoints = &machine->breakpoints;
+    breakpoint *bp;
+    int hole, slot, home;
+
+    bp = breakpoint_find(machine, ip);
+
+    if (!bp)
+        return XSM_FAILURE;
+
+    bp->used = FALSE;
+    breakpoints->count--;
+
+    /* Move back the ones after it that would no longer be found */
+    hole = bp - breakpoints->slots;
+    slot = hole;
+
+    while (TRUE)
+    {
+        slot = (slot + 1) & (BREAKPOINT_SLOTS - 1);
+
+        if (!breakpoints->slots[slot].used)
+            break;
+
+        home = breakpoint_slot(breakpoints->slots[slot].ip);
+
+        /* Stays if its home lies cyclically after the hole, up to where it is */
+        if (hole <= slot ? (hole < home && home <= slot) : (hole < home || home <= slot))
+            continue;
+
+        breakpoints->slots[hole] = breakpoints->slots[slot];
+        breakpoints->slots[slot].used = FALSE;
+        hole = slot;
+    }
+
+    return XSM_SUCCESS;
+}
+
+/* Find the breakpoint at the given IP */
+breakpoint *breakpoint_find(xsm_machine *machine, int ip)
+{
+    xsm_breakpoints *breakpoints = &machine->breakpoints;
+    int slot;
+
+    for (slot = breakpoint_slot(ip); breakpoints->slots[slot].used; slot = (slot + 1) & (BREAKPOINT_SLOTS - 1))
+        if (breakpoints->slots[slot].ip == ip)
+            return &breakpoints->slots[slot];
+
+    return NULL;
+}
+
+/* Slot the given IP hashes to, IPs are even so the high bits of the product are taken */
+int breakpoint_slot(int ip)
+{
+    return ((unsigned int)ip * 2654435761U) >> (32 - BREAKPOINT_SLOT_BITS);
+}
+
+/* Checks whether the machine stops before the instruction at the given IP */
+int breakpoint_test(xsm_machine *machine, int ip)
+{
+    breakpoint *bp;
+    int result;
+
+    bp = breakpoint_find(machine, ip);
+
+    if (!bp)
+        return FALSE;
+
+    if (bp->length == 0)
+        return TRUE;
+
+    return breakpoint_evaluate(machine, bp, &result) && result;
+}
+
+/* Evaluate the condition of a breakpoint, returns FALSE if it has no value */
+int breakpoint_evaluate(xsm_machine *machine, breakpoint *bp, int *result)
+{
+    int stack[BREAKPOINT_STACK];
+    int i, top, address, left, right;
+    breakpoint_op *op;
+    xsm_word *word;
+
+    top = -1;
+
+    for (i = 0; i < bp->length; ++i)
+    {
+        op = &bp->code[i];
+
+        switch (op->op)
+        {
+        case BREAKPOINT_OP_NUMBER:
+            stack[++top] = op->arg;
+            continue;
+
+        case BREAKPOINT_OP_REGISTER:
+            if (!breakpoint_value(&machine->cpu.regs[op->arg], &stack[++top]))
+                return FALSE;
+            continue;
+
+        case BREAKPOINT_OP_MEMORY:
+            address = machine_translate_address(machine, stack[top], FALSE, DEBUG_FETCH, machine_get_mode(machine));
+            word = (address >= 0) ? memory_get_word(machine, address) : NULL;
+
+            if (!word || !breakpoint_value(word, &stack[top]))
+                return FALSE;
+            continue;
+
+        case BREAKPOINT_OP_NEG:
+            stack[top] = -stack[top];
+            continue;
+
+        case BREAKPOINT_OP_NOT:
+            stack[top] = !stack[top];
+            continue;
+        }
+
+        /* The rest take two operands */
+        right = stack[top--];
+        left = stack[top];
+
+        switch (op->op)
+        {
+        case BREAKPOINT_OP_MUL:
+            left = left * right;
+            break;
+
+        case BREAKPOINT_OP_DIV:
+        case BREAKPOINT_OP_MOD:
+            if (right == 0)
+                return FALSE;
+
+            left = (op->op == BREAKPOINT_OP_DIV) ? left / right : left % right;
+            break;
+
+        case BREAKPOINT_OP_ADD:
+            left = left + right;
+            break;
+
+        case BREAKPOINT_OP_SUB:
+            left = left - right;
+            break;
+
+        case BREAKPOINT_OP_LT:
+            left = left < right;
+            break;
+
+        case BREAKPOINT_OP_GT:
+            left = left > right;
+            break;
+
+        case BREAKPOINT_OP_LE:
+            left = left <= right;
+            break;
+
+        case BREAKPOINT_OP_GE:
+            left = left >= right;
+            break;
+
+        case BREAKPOINT_OP_EQ:
+            left = left == right;
+            break;
+
+        case BREAKPOINT_OP_NE:
+            left = left != right;
+            break;
+
+        case BREAKPOINT_OP_AND:
+            left = left && right;
+            break;
+
+        default:
+            left = left || right;
+            break;
+        }
+
+        stack[top] = left;
+    }
+
+    *result = stack[top];
+    return TRUE;
+}
+
+/* Integer value of a word, returns FALSE if it holds a string */
+int breakpoint_value(xsm_word *word, int *value)
+{
+    if (word_get_unix_type(word) == XSM_TYPE_STRING)
+        return FALSE;
+
+    *value = word_get_integer(word);
+    return TRUE;
+}
+
+/* Compile a condition, NULL or blank for none */
+int breakpoint_compile(breakpoint *bp, const char *condition)
+{
+    breakpoint_parser parser;
+
+    memset(bp, 0, sizeof(breakpoint));
+
+    if (!condition)
+        return TRUE;
+
+    parser.pos = condition;
+    parser.bp = bp;
+    parser.depth = 0;
+    parser.error = FALSE;
+
+    breakpoint_skip_space(&parser);
+
+    if (!*parser.pos)
+        return TRUE;
+
+    if (strlen(parser.pos) >= BREAKPOINT_TEXT_LEN)
+        return FALSE;
+
+    strcpy(bp->condition, parser.pos);
+    breakpoint_parse_or(&parser);
+    breakpoint_skip_space(&parser);
+
+    /* All of it must have been read */
+    if (parser.error || *parser.pos)
+        return FALSE;
+
+    return TRUE;
+}
+
+/* Add an operation to the condition */
+void breakpoint_emit(breakpoint_parser *parser, int op, int arg)
+{
+    breakpoint *bp = parser->bp;
+
+    if (op == BREAKPOINT_OP_NUMBER || op == BREAKPOINT_OP_REGISTER)
+        parser->depth++;
+    else if (op >= BREAKPOINT_OP_MUL)
+        parser->depth--;
+
+    if (bp->length >= BREAKPOINT_CODE_LEN || parser->depth > BREAKPOINT_STACK)
+    {
+        parser->error = TRUE;
+        return;
+    }
+
+    bp->code[bp->length].op = op;
+    bp->code[bp->length].arg = arg;
+    bp->length++;
+}
+
+void breakpoint_skip_space(breakpoint_parser *parser)
+{
+    while (isspace((unsigned char)*parser->pos))
+        parser->pos++;
+}
+
+/* Consume the given token if it comes next */
+int breakpoint_match(breakpoint_parser *parser, const char *token)
+{
+    size_t length = strlen(token);
+
+    breakpoint_skip_space(parser);
+
+    if (strncmp(parser->pos, token, length))
+        return FALSE;
+
+    parser->pos += length;
+    return TRUE;
+}
+
+void breakpoint_parse_or(breakpoint_parser *parser)
+{
+    breakpoint_parse_and(parser);
+
+    while (!parser->error && breakpoint_match(parser, "||"))
+    {
+        breakpoint_parse_and(parser);
+        breakpoint_emit(parser, BREAKPOINT_OP_OR, 0);
+    }
+}
+
+void breakpoint_parse_and(breakpoint_parser *parser)
+{
+    breakpoint_parse_compare(parser);
+
+    while (!parser->error && breakpoint_match(parser, "&&"))
+    {
+        breakpoint_parse_compare(parser);
+        breakpoint_emit(parser, BREAKPOINT_OP_AND, 0);
+    }
+}
+
+void breakpoint_parse_compare(breakpoint_parser *parser)
+{
+    int op;
+
+    breakpoint_parse_sum(parser);
+
+    /* The two character operators are tried first */
+    if (breakpoint_match(parser, "=="))
+        op = BREAKPOINT_OP_EQ;
+    else if (breakpoint_match(parser, "!="))
+        op = BREAKPOINT_OP_NE;
+    else if (breakpoint_match(parser, "<="))
+        op = BREAKPOINT_OP_LE;
+    else if (breakpoint_match(parser, ">="))
+        op = BREAKPOINT_OP_GE;
+    else if (breakpoint_match(parser, "<"))
+        op = BREAKPOINT_OP_LT;
+    else if (breakpoint_match(parser, ">"))
+        op = BREAKPOINT_OP_GT;
+    else
+        return;
+
+    breakpoint_parse_sum(parser);
+    breakpoint_emit(parser, op, 0);
+}
+
+void breakpoint_parse_sum(breakpoint_parser *parser)
+{
+    int op;
+
+    breakpoint_parse_product(parser);
+
+    while (!parser->error)
+    {
+        if (breakpoint_match(parser, "+"))
+            op = BREAKPOINT_OP_ADD;
+        else if (breakpoint_match(parser, "-"))
+            op = BREAKPOINT_OP_SUB;
+        else
+            return;
+
+        breakpoint_parse_product(parser);
+        breakpoint_emit(parser, op, 0);
+    }
+}
+
+void breakpoint_parse_product(breakpoint_parser *parser)
+{
+    int op;
+
+    breakpoint_parse_unary(parser);
+
+    while (!parser->error)
+    {
+        if (breakpoint_match(parser, "*"))
+            op = BREAKPOINT_OP_MUL;
+        else if (breakpoint_match(parser, "/"))
+            op = BREAKPOINT_OP_DIV;
+        else if (breakpoint_match(parser, "%"))
+            op = BREAKPOINT_OP_MOD;
+        else
+            return;
+
+        breakpoint_parse_unary(parser);
+        breakpoint_emit(parser, op, 0);
+    }
+}
+
+void breakpoint_parse_unary(breakpoint_parser *parser)
+{
+    breakpoint_skip_space(parser);
+
+    /* Not the start of != */
+    if (parser->pos[0] == '!' && parser->pos[1] != '=')
+    {
+        parser->pos++;
+        breakpoint_parse_unary(parser);
+        breakpoint_emit(parser, BREAKPOINT_OP_NOT, 0);
+    }
+    else if (breakpoint_match(parser, "-"))
+    {
+        breakpoint_parse_unary(parser);
+        breakpoint_emit(parser, BREAKPOINT_OP_NEG, 0);
+    }
+    else
+        breakpoint_parse_primary(parser);
+}
+
+void breakpoint_parse_primary(breakpoint_parser *parser)
+{
+    char name[BREAKPOINT_TEXT_LEN];
+    char *end;
+    long number;
+    int length, code;
+
+    if (parser->error)
+        return;
+
+    breakpoint_skip_space(parser);
+
+    if (breakpoint_match(parser, "("))
+    {
+        breakpoint_parse_or(parser);
+
+        if (!breakpoint_match(parser, ")"))
+            parser->error = TRUE;
+    }
+    else if (breakpoint_match(parser, "["))
+    {
+        breakpoint_parse_sum(parser);
+        breakpoint_emit(parser, BREAKPOINT_OP_MEMORY, 0);
+
+        if (!breakpoint_match(parser, "]"))
+            parser->error = TRUE;
+    }
+    else if (isdigit((unsigned char)*parser->pos))
+    {
+        number = strtol(parser->pos, &end, 10);
+        parser->pos = end;
+        breakpoint_emit(parser, BREAKPOINT_OP_NUMBER, (int)number);
+    }
+    else if (isalpha((unsigned char)*parser->pos))
+    {
+        for (length = 0; isalnum((unsigned char)parser->pos[length]); ++length)
+            name[length] = parser->pos[length];
+
+        name[length] = '\0';
+        parser->pos += length;
+
+        code = registers_get_register_code(name);
+
+        if (code < 0)
+            parser->error = TRUE;
+        else
+            breakpoint_emit(parser, BREAKPOINT_OP_REGISTER, code);
+    }
+    else
+        parser->error = TRUE;
+}
@@ -0,0 +1,91 @@
+#ifndef XSM_BREAKPOINT_H
+
+#define XSM_BREAKPOINT_H
+
+#include "types.h"
+
+/* Slots of the breakpoint table, a power of two, and the breakpoints it holds */
+#define BREAKPOINT_SLOT_BITS 6
+#define BREAKPOINT_SLOTS (1 << BREAKPOINT_SLOT_BITS)
+#define BREAKPOINT_MAX 32
+
+/* Longest condition, in operations and in characters */
+#define BREAKPOINT_CODE_LEN 64
+#define BREAKPOINT_TEXT_LEN 100
+
+/* Deepest stack a condition is evaluated on */
+#define BREAKPOINT_STACK 16
+
+/* Operations of a compiled condition */
+#define BREAKPOINT_OP_NUMBER 0      /* Push the argument */
+#define BREAKPOINT_OP_REGISTER 1    /* Push the register the argument is the code of */
+#define BREAKPOINT_OP_MEMORY 2      /* Replace an address with the word at it */
+#define BREAKPOINT_OP_NEG 3
+#define BREAKPOINT_OP_NOT 4
+#define BREAKPOINT_OP_MUL 5
+#define BREAKPOINT_OP_DIV 6
+#define BREAKPOINT_OP_MOD 7
+#define BREAKPOINT_OP_ADD 8
+#define BREAKPOINT_OP_SUB 9
+#define BREAKPOINT_OP_LT 10
+#define BREAKPOINT_OP_GT 11
+#define BREAKPOINT_OP_LE 12
+#define BREAKPOINT_OP_GE 13
+#define BREAKPOINT_OP_EQ 14
+#define BREAKPOINT_OP_NE 15
+#define BREAKPOINT_OP_AND 16
+#define BREAKPOINT_OP_OR 17
+
+typedef struct _breakpoint_op
+{
+    int op;
+    int arg;
+} breakpoint_op;
+
+typedef struct _breakpoint
+{
+    int used;
+    int ip;
+
+    /* The condition as typed and compiled, always stopping if empty */
+    char condition[BREAKPOINT_TEXT_LEN];
+    breakpoint_op code[BREAKPOINT_CODE_LEN];
+    int length;
+} breakpoint;
+
+typedef struct _xsm_breakpoints
+{
+    /* Open addressing by IP */
+    breakpoint slots[BREAKPOINT_SLOTS];
+    int count;
+} xsm_breakpoints;
+
+/* A condition being compiled */
+typedef struct _breakpoint_parser
+{
+    const char *pos;
+    breakpoint *bp;
+    int depth, error;
+} breakpoint_parser;
+
+void breakpoint_clear(xsm_machine *machine);
+int breakpoint_add(xsm_machine *machine, int ip, const char *condition);
+int breakpoint_remove(xsm_machine *machine, int ip);
+breakpoint *breakpoint_find(xsm_machine *machine, int ip);
+int breakpoint_slot(int ip);
+int breakpoint_test(xsm_machine *machine, int ip);
+int breakpoint_evaluate(xsm_machine *machine, breakpoint *bp, int *result);
+int breakpoint_value(xsm_word *word, int *value);
+int breakpoint_compile(breakpoint *bp, const char *condition);
+void breakpoint_emit(breakpoint_parser *parser, int op, int arg);
+void breakpoint_skip_space(breakpoint_parser *parser);
+int breakpoint_match(breakpoint_parser *parser, const char *token);
+void breakpoint_parse_or(breakpoint_parser *parser);
+void breakpoint_parse_and(breakpoint_parser *parser);
+void breakpoint_parse_compare(breakpoint_parser *parser);
+void breakpoint_parse_sum(breakpoint_parser *parser);
+void breakpoint_parse_product(breakpoint_parser *parser);
+void breakpoint_parse_unary(breakpoint_parser *parser);
+void breakpoint_parse_primary(breakpoint_parser *parser);
+
+#endif
@@ -4,12 +4,12 @@ The XSM debugger.
 
 #include "debug.h"
 
+#include "machine.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static debug_status _db_status;
-
 const char *_db_commands_lh[] = {
     "step",
     "continue",
@@ -38,7 +38,11 @@ const char *_db_commands_lh[] = {
     "list",
     "page",
     "exit",
-    "help"};
+    "help",
+    "back",
+    "readwatch",
+    "break",
+    "breakclear"};
 
 const char *_db_commands_sh[] = {
     "s",
@@ -68,93 +72,128 @@ const char *_db_commands_sh[] = {
     "l",
     "pg",
     "e",
-    "h"};
+    "h",
+    "rs",
+    "rw",
+    "b",
+    "bc"};
 
 /* Initialise debugger */
-int debug_init()
+int debug_init(xsm_machine *machine)
 {
-    _db_status.state = OFF;
-    _db_status.ip = -1;
-    _db_status.prev_mode = PRIVILEGE_KERNEL;
-    _db_status.skip = 0;
-    strcpy(_db_status.command, "help");
+    machine->debug.state = OFF;
+    machine->debug.ip = -1;
+    machine->debug.prev_mode = PRIVILEGE_KERNEL;
+    machine->debug.skip = 0;
+    strcpy(machine->debug.command, "help");
 
-    debug_watch_clear();
+    debug_watch_clear(machine);
+    breakpoint_clear(machine);
 
     return TRUE;
 }
 
 /* Activate the debugger */
-void debug_activate()
+void debug_activate(xsm_machine *machine)
 {
-    _db_status.state = ON;
+    machine->debug.state = ON;
 }
 
 /* Deactivate debugger */
-void debug_deactivate()
+void debug_deactivate(xsm_machine *machine)
 {
-    _db_status.state = OFF;
+    machine->debug.state = OFF;
+}
+
+/* Release the watch points */
+void debug_destroy(xsm_machine *machine)
+{
+    free(machine->debug.wp);
+    free(machine->debug.wp_reach);
+
+    machine->debug.wp = NULL;
+    machine->debug.wp_reach = NULL;
+    machine->debug.wp_size = 0;
+    machine->debug.wp_max = 0;
 }
 
 /* Called from machine for debugger */
-int debug_next_step(int curr_ip)
+int debug_next_step(xsm_machine *machine, int curr_ip)
 {
-    int mem_left, mem_right;
-    int wp = DEBUG_ERROR;
+    debug_watch *wp;
 
-    _db_status.prev_ip = _db_status.ip;
-    _db_status.ip = curr_ip;
+    history_step(machine);
 
-    machine_get_mem_access(&mem_left, &mem_right);
+    /* The prompt before this instruction was shown when the machine was moved back to it */
+    if (machine->history.rewound)
+    {
+        machine->history.rewound = FALSE;
+        machine->debug.wp_hit = DEBUG_ERROR;
+        machine->debug.prev_mode = machine_get_mode(machine);
+        machine->history.count++;
+        return TRUE;
+    }
 
-    if (mem_left > 0)
-        wp = debug_watch_test(mem_left, mem_right);
+    machine->debug.prev_ip = machine->debug.ip;
+    machine->debug.ip = curr_ip;
 
-    if (wp >= 0)
+    /* Running forward again to where the debugger stepped back to */
+    if (machine->history.replaying)
     {
-        printf("Watchpoint at %d has been triggered.\n", _db_status.wp[wp]);
-        _db_status.state = ON;
+        machine->debug.wp_hit = DEBUG_ERROR;
+        machine->debug.prev_mode = machine_get_mode(machine);
+        machine->history.count++;
+        return TRUE;
     }
 
-    if (_db_status.state == ON)
-        debug_show_interface();
+    /* Accesses are seen as they happen, the debugger stops after the instruction */
+    if (machine->debug.wp_hit >= 0)
+    {
+        wp = &machine->debug.wp[machine->debug.wp_hit];
+
+        if (wp->access == DEBUG_WATCH_READ)
+            printf("Read watchpoint at %d has been triggered.\n", machine->debug.wp_address);
+        else
+            printf("Watchpoint at %d has been triggered.\n", machine->debug.wp_address);
+
+        machine->debug.wp_hit = DEBUG_ERROR;
+        machine->debug.state = ON;
+    }
 
-    _db_status.prev_mode = machine_get_mode();
+    /* A breakpoint stops the machine even in the middle of a step or continue over several */
+    if (machine->breakpoints.count && breakpoint_test(machine, curr_ip))
+    {
+        printf("Breakpoint at %d has been reached.\n", curr_ip);
+        machine->debug.skip = 0;
+        machine->debug.state = ON;
+    }
+
+    if (machine->debug.state == ON)
+        debug_show_interface(machine);
+
+    /* Stepping back at the prompt left the machine before the next instruction */
+    machine->history.rewound = FALSE;
+    machine->debug.prev_mode = machine_get_mode(machine);
+    machine->history.count++;
 
     return TRUE;
 }
 
 /* Display debugger interface */
-int debug_show_interface()
+int debug_show_interface(xsm_machine *machine)
 {
-    int done = FALSE, addr;
-    char command[DEBUG_COMMAND_LEN], prev_instr[DEBUG_STRING_LEN], next_instr[DEBUG_STRING_LEN];
+    int done = FALSE;
+    char command[DEBUG_COMMAND_LEN];
 
-    if (_db_status.skip > 0)
+    if (machine->debug.skip > 0)
     {
-        _db_status.skip--;
-        if (_db_status.skip_command == DEBUG_CONTINUE)
-            debug_deactivate();
+        machine->debug.skip--;
+        if (machine->debug.skip_command == DEBUG_CONTINUE)
+            debug_deactivate(machine);
         return TRUE;
     }
 
-    // Get the previous instruction
-    addr = machine_translate_address(_db_status.prev_ip, FALSE, DEBUG_FETCH, _db_status.prev_mode);
-    if (addr >= 0)
-        memory_retrieve_raw_instr(prev_instr, addr);
-    else
-        prev_instr[0] = '\0';
-
-    // Get the next instruction 
-    addr = machine_translate_address(_db_status.ip, FALSE, DEBUG_FETCH, machine_get_mode());
-    if (addr >= 0)
-        memory_retrieve_raw_instr(next_instr, addr);
-    else
-        next_instr[0] = '\0';
-
-    printf("Previous instruction at IP = %d: %s\n", _db_status.prev_ip, prev_instr);
-    printf("Mode: %s \t PID: %d\n", (machine_get_mode() == PRIVILEGE_KERNEL) ? "KERNEL" : "USER", debug_active_process());
-    printf("Next instruction at IP = %d, Page No. = %d: %s\n", _db_status.ip, _db_status.ip / XSM_PAGE_SIZE, next_instr);
+    debug_display_position(machine);
 
     while (!done)
     {
@@ -165,28 +204,53 @@ int debug_show_interface()
         strtok(command, "\n");
 
         if (!strcmp(command, "\n"))
-            strncpy(command, _db_status.command, DEBUG_COMMAND_LEN);
+            strncpy(command, machine->debug.command, DEBUG_COMMAND_LEN);
         else if (!strcmp(command, "exit") || !strcmp(command, "e"))
         {
-            debug_deactivate();
+            debug_deactivate(machine);
             printf("Killing the machine\n");
             exit(0);
             return FALSE;
         }
         else
-            strncpy(_db_status.command, command, DEBUG_COMMAND_LEN);
+            strncpy(machine->debug.command, command, DEBUG_COMMAND_LEN);
 
-        done = debug_command(command);
+        done = debug_command(machine, command);
     }
 
     return TRUE;
 }
 
+/* Display the instructions around the IP */
+void debug_display_position(xsm_machine *machine)
+{
+    int addr;
+    char prev_instr[DEBUG_STRING_LEN], next_instr[DEBUG_STRING_LEN];
+
+    // Get the previous instruction
+    addr = machine_translate_address(machine, machine->debug.prev_ip, FALSE, DEBUG_FETCH, machine->debug.prev_mode);
+    if (addr >= 0)
+        memory_retrieve_raw_instr(machine, prev_instr, addr);
+    else
+        prev_instr[0] = '\0';
+
+    // Get the next instruction 
+    addr = machine_translate_address(machine, machine->debug.ip, FALSE, DEBUG_FETCH, machine_get_mode(machine));
+    if (addr >= 0)
+        memory_retrieve_raw_instr(machine, next_instr, addr);
+    else
+        next_instr[0] = '\0';
+
+    printf("Previous instruction at IP = %d: %s\n", machine->debug.prev_ip, prev_instr);
+    printf("Mode: %s \t PID: %d\n", (machine_get_mode(machine) == PRIVILEGE_KERNEL) ? "KERNEL" : "USER", debug_active_process(machine));
+    printf("Next instruction at IP = %d, Page No. = %d: %s\n", machine->debug.ip, machine->debug.ip / XSM_PAGE_SIZE, next_instr);
+}
+
 /* Call the function based on the given command */
-int debug_command(char *command)
+int debug_command(xsm_machine *machine, char *command)
 {
-    int code;
-    char *arg1, *cmd, *arg2;
+    int code, access, low, high, ip;
+    char *arg1, *cmd, *arg2, *condition;
 
     const char *delim = " \t";
 
@@ -198,29 +262,29 @@ int debug_command(char *command)
     case DEBUG_STEP:
         arg1 = strtok(NULL, delim);
         if (arg1)
-            debug_skip_n(atoi(arg1), DEBUG_STEP);
+            debug_skip_n(machine, atoi(arg1), DEBUG_STEP);
 
         return TRUE;
 
     case DEBUG_CONTINUE:
         arg1 = strtok(NULL, delim);
         if (arg1)
-            debug_skip_n(atoi(arg1), DEBUG_CONTINUE);
+            debug_skip_n(machine, atoi(arg1), DEBUG_CONTINUE);
 
-        debug_deactivate();
+        debug_deactivate(machine);
         return TRUE;
 
     case DEBUG_REG:
         arg1 = strtok(NULL, delim);
         if (!arg1)
-            debug_display_all_registers();
+            debug_display_all_registers(machine);
         else
         {
             arg2 = strtok(NULL, delim);
             if (!arg2)
-                debug_display_register(arg1);
+                debug_display_register(machine, arg1);
             else
-                debug_display_range_reg(arg1, arg2);
+                debug_display_range_reg(machine, arg1, arg2);
         }
         break;
 
@@ -232,90 +296,90 @@ int debug_command(char *command)
         {
             arg2 = strtok(NULL, delim);
             if (!arg2)
-                debug_display_mem_range(atoi(arg1), atoi(arg1));
+                debug_display_mem_range(machine, atoi(arg1), atoi(arg1));
             else
-                debug_display_mem_range(atoi(arg1), atoi(arg2));
+                debug_display_mem_range(machine, atoi(arg1), atoi(arg2));
         }
         break;
 
     case DEBUG_PCB:
         arg1 = strtok(NULL, delim);
         if (!arg1)
-            debug_display_pcb();
+            debug_display_pcb(machine);
         else
-            debug_display_pcb_pid(atoi(arg1));
+            debug_display_pcb_pid(machine, atoi(arg1));
         break;
 
     case DEBUG_PAGETABLE:
         arg1 = strtok(NULL, delim);
         if (!arg1)
-            debug_display_pt_ptbr();
+            debug_display_pt_ptbr(machine);
         else
-            debug_display_pt_pid(atoi(arg1));
+            debug_display_pt_pid(machine, atoi(arg1));
         break;
 
     case DEBUG_FILETABLE:
-        debug_display_ft();
+        debug_display_ft(machine);
         break;
 
     case DEBUG_SEMTABLE:
-        debug_display_st();
+        debug_display_st(machine);
         break;
 
     case DEBUG_FILESTATUS:
-        debug_display_fst();
+        debug_display_fst(machine);
         break;
 
     case DEBUG_DISKSTATUS:
-        debug_display_dst();
+        debug_display_dst(machine);
         break;
 
     case DEBUG_SYSTEMSTATUS:
-        debug_display_sst();
+        debug_display_sst(machine);
         break;
 
     case DEBUG_TERMINALSTATUS:
-        debug_display_tst();
+        debug_display_tst(machine);
         break;
 
     case DEBUG_BUFFERTABLE:
-        debug_display_bt();
+        debug_display_bt(machine);
         break;
 
     case DEBUG_DISKMAPTABLE:
         arg1 = strtok(NULL, delim);
         if (!arg1)
-            debug_display_dmt();
+            debug_display_dmt(machine);
         else
-            debug_dmt_pid(atoi(arg1));
+            debug_dmt_pid(machine, atoi(arg1));
         break;
 
     case DEBUG_ROOTFILE:
-        debug_display_rf();
+        debug_display_rf(machine);
         break;
 
     case DEBUG_RESOURCETABLE:
         arg1 = strtok(NULL, delim);
         if (!arg1)
-            debug_display_rt();
+            debug_display_rt(machine);
         else
-            debug_rt_pid(atoi(arg1));
+            debug_rt_pid(machine, atoi(arg1));
         break;
 
     case DEBUG_MEMFREELIST:
-        debug_display_memlist();
+        debug_display_memlist(machine);
         break;
 
     case DEBUG_DISKFREELIST:
-        debug_display_dfl();
+        debug_display_dfl(machine);
         break;
 
     case DEBUG_INODETABLE:
-        debug_display_inodetable();
+        debug_display_inodetable(machine);
         break;
 
     case DEBUG_USERTABLE:
-        debug_display_usertable();
+        debug_display_usertable(machine);
         break;
 
     case DEBUG_LOCATION:
@@ -323,7 +387,7 @@ int debug_command(char *command)
         if (!arg1)
             debug_invalid_cmd(command);
         else
-            debug_display_location(atoi(arg1));
+            debug_display_location(machine, atoi(arg1));
         break;
 
     case DEBUG_VAL:
@@ -331,27 +395,75 @@ int debug_command(char *command)
         if (!arg1)
             debug_invalid_cmd(command);
         else
-            debug_display_val(arg1);
+            debug_display_val(machine, arg1);
         break;
 
     case DEBUG_WATCH:
+    case DEBUG_READWATCH:
         arg1 = strtok(NULL, delim);
         if (!arg1)
             debug_invalid_cmd(command);
         else
         {
-            debug_watch_add(atoi(arg1));
-            printf("Watch point added at %d.\n", atoi(arg1));
+            access = (code == DEBUG_READWATCH) ? DEBUG_WATCH_READ : DEBUG_WATCH_WRITE;
+            arg2 = strtok(NULL, delim);
+
+            low = atoi(arg1);
+            high = arg2 ? atoi(arg2) : low;
+
+            if (!debug_watch_add(machine, low, high, access))
+                printf("Watch point not added, addresses must be in memory.\n");
+            else if (low == high)
+                printf("%s point added at %d.\n", access == DEBUG_WATCH_READ ? "Read watch" : "Watch", low);
+            else
+                printf("%s point added at %d to %d.\n", access == DEBUG_WATCH_READ ? "Read watch" : "Watch", low, high);
         }
         break;
 
     case DEBUG_WATCHCLEAR:
-        debug_watch_clear();
+        debug_watch_clear(machine);
         printf("Watch points cleared.\n");
         break;
 
+    case DEBUG_BREAK:
+        arg1 = strtok(NULL, delim);
+        if (!arg1)
+        {
+            debug_display_breakpoints(machine);
+            break;
+        }
+
+        arg2 = strtok(NULL, delim);
+        condition = arg2 ? strtok(NULL, "") : NULL;
+        ip = atoi(arg1);
+
+        if (arg2 && (strcmp(arg2, "if") || !condition))
+            debug_invalid_cmd(command);
+        else if (!breakpoint_find(machine, ip) && machine->breakpoints.count >= BREAKPOINT_MAX)
+            printf("Breakpoint not added, at most %d breakpoints set.\n", BREAKPOINT_MAX);
+        else if (!breakpoint_add(machine, ip, condition))
+            printf("Invalid condition \"%s\".\n", condition);
+        else if (breakpoint_find(machine, ip)->length)
+            printf("Breakpoint added at %d if %s.\n", ip, breakpoint_find(machine, ip)->condition);
+        else
+            printf("Breakpoint added at %d.\n", ip);
+        break;
+
+    case DEBUG_BREAKCLEAR:
+        arg1 = strtok(NULL, delim);
+        if (!arg1)
+        {
+            breakpoint_clear(machine);
+            printf("Breakpoints cleared.\n");
+        }
+        else if (breakpoint_remove(machine, atoi(arg1)))
+            printf("Breakpoint at %d cleared.\n", atoi(arg1));
+        else
+            printf("No breakpoint at %d.\n", atoi(arg1));
+        break;
+
     case DEBUG_LIST:
-        debug_display_list();
+        debug_display_list(machine);
         break;
 
     case DEBUG_PAGE:
@@ -366,6 +478,14 @@ int debug_command(char *command)
         debug_display_help();
         break;
 
+    case DEBUG_BACK:
+        arg1 = strtok(NULL, delim);
+        if (!arg1)
+            debug_step_back(machine, 1);
+        else
+            debug_step_back(machine, atoi(arg1));
+        break;
+
     default:
         debug_invalid_cmd(command);
     }
@@ -395,11 +515,11 @@ int debug_command_code(const char *cmd)
 }
 
 /* Retrieve RUNNING process */
-int debug_active_process()
+int debug_active_process(xsm_machine *machine)
 {
     int ptbr, pid;
 
-    ptbr = registers_get_integer("PTBR");
+    ptbr = registers_get_integer(machine, "PTBR");
     pid = (ptbr - DEBUG_PT_BASE) / 20;
 
     if (pid < 0 || pid >= MAX_PROC_NUM)
@@ -409,20 +529,47 @@ int debug_active_process()
 }
 
 /* Debug step/continue command */
-int debug_skip_n(int num, int debug_command)
+int debug_skip_n(xsm_machine *machine, int num, int debug_command)
 {
     num--;
     if (num > 0)
     {
-        _db_status.skip = num;
-        _db_status.skip_command = debug_command;
+        machine->debug.skip = num;
+        machine->debug.skip_command = debug_command;
     }
 
     return TRUE;
 }
 
+/* Debug back command */
+int debug_step_back(xsm_machine *machine, int num)
+{
+    long long moved;
+
+    /* Running forward again would count and record the same instructions twice */
+    if (machine->options.profile || machine->options.trace)
+    {
+        printf("Stepping back is not available with --profile or --trace.\n");
+        return FALSE;
+    }
+
+    moved = history_back(machine, num);
+
+    if (moved < 0)
+    {
+        printf("The machine stopped while running forward again.\n");
+        return FALSE;
+    }
+
+    if (moved < num)
+        printf("Only %lld instructions before this one are kept.\n", moved);
+
+    debug_display_position(machine);
+    return TRUE;
+}
+
 /* Debug reg command */
-int debug_display_all_registers()
+int debug_display_all_registers(xsm_machine *machine)
 {
     int num_regs, i;
     char *content;
@@ -433,7 +580,7 @@ int debug_display_all_registers()
 
     for (i = 0; i < num_regs; ++i)
     {
-        content = registers_get_string(reg_names[i]);
+        content = registers_get_string(machine, reg_names[i]);
         printf("%s: %s\t", reg_names[i], content);
 
         if ((i < 20 && i % 5 == 4) || i == 23 || i == 28)
@@ -445,9 +592,9 @@ int debug_display_all_registers()
 }
 
 /* Debug reg regname command */
-int debug_display_register(const char *regname)
+int debug_display_register(xsm_machine *machine, const char *regname)
 {
-    char *content = registers_get_string(regname);
+    char *content = registers_get_string(machine, regname);
 
     if (!content)
     {
@@ -460,7 +607,7 @@ int debug_display_register(const char *regname)
 }
 
 /* Debug reg reg_b_name reg_e_name command */
-int debug_display_range_reg(const char *reg_b_name, const char *reg_e_name)
+int debug_display_range_reg(xsm_machine *machine, const char *reg_b_name, const char *reg_e_name)
 {
     int num_regs, i;
     char *content;
@@ -475,7 +622,7 @@ int debug_display_range_reg(const char *reg_b_name, const char *reg_e_name)
 
     for (; i < num_regs; ++i)
     {
-        content = registers_get_string(reg_names[i]);
+        content = registers_get_string(machine, reg_names[i]);
         printf("%s: %s\n", reg_names[i], content);
 
         if (!strcmp(reg_e_name, reg_names[i]))
@@ -486,7 +633,7 @@ int debug_display_range_reg(const char *reg_b_name, const char *reg_e_name)
 }
 
 /* Debug mem page_l page_r command */
-int debug_display_mem_range(int page_l, int page_h)
+int debug_display_mem_range(xsm_machine *machine, int page_l, int page_h)
 {
     int i,j;
     int ptr;
@@ -497,7 +644,7 @@ int debug_display_mem_range(int page_l, int page_h)
     for (i = page_l; i <= page_h; ++i)
     {
         printf("Page: %d\n", i);
-    	word = memory_get_page(i);
+    	word = memory_get_page(machine, i);
         if (!word)
     	{
         	printf("No such page.\n");
@@ -508,7 +655,7 @@ int debug_display_mem_range(int page_l, int page_h)
 	// Write to file mem
     	for (j = 0; j < XSM_PAGE_SIZE; j++)
     	{
-        	word = memory_get_word(ptr);
+        	word = memory_get_word(machine, ptr);
         	content = word_get_string(word);
         	fprintf(fp, "%d: %s\n", j, content);
         	ptr++;
@@ -520,7 +667,7 @@ int debug_display_mem_range(int page_l, int page_h)
     return TRUE;
 }
 
-int debug_display_fields(int baseptr, const char **fields, const int *fields_len, int n_fields)
+int debug_display_fields(xsm_machine *machine, int baseptr, const char **fields, const int *fields_len, int n_fields)
 {
     int i, ptr, num;
     xsm_word *word;
@@ -540,7 +687,7 @@ int debug_display_fields(int baseptr, const char **fields, const int *fields_len
         /* Convert STATE to CONSTANT */
         if (!strcmp(fields[i], "State"))
         {
-            word = memory_get_word(ptr);
+            word = memory_get_word(machine, ptr);
             num = word_get_integer(word);
             if (num >= 1 && num <= 12)
                 printf("(%s, ", state[num - 1]);
@@ -548,7 +695,7 @@ int debug_display_fields(int baseptr, const char **fields, const int *fields_len
                 printf("(%s, ", word_get_string(word));
             ptr = ptr + 1;
 
-            word = memory_get_word(ptr);
+            word = memory_get_word(machine, ptr);
             printf("%s)\n", word_get_string(word));
             ptr = ptr + 1;
 
@@ -558,7 +705,7 @@ int debug_display_fields(int baseptr, const char **fields, const int *fields_len
         /* Convert MODE to CONSTANT */
         if (!strcmp(fields[i], "Mode Flag"))
         {
-            word = memory_get_word(ptr);
+            word = memory_get_word(machine, ptr);
             num = word_get_integer(word);
             if (num >= 1 && num <= 28)
                 printf("%s", mode[num - 1]);
@@ -577,7 +724,7 @@ int debug_display_fields(int baseptr, const char **fields, const int *fields_len
         int j;
         for (j = 0; j < fields_len[i]; ++j)
         {
-            word = memory_get_word(ptr);
+            word = memory_get_word(machine, ptr);
             printf("%s ", word_get_string(word));
             ptr = ptr + 1;
         }
@@ -589,7 +736,7 @@ int debug_display_fields(int baseptr, const char **fields, const int *fields_len
 }
 
 /* Debug pcb pid command */
-int debug_display_pcb_pid(int pid)
+int debug_display_pcb_pid(xsm_machine *machine, int pid)
 {
     const char *fields[] = {"Tick", "PID", "PPID", "UserID", "State", "Swap Flag", "Inode Index",
                             "Input Buffer", "Mode Flag", "User Area Swap Status", "User Area Page Number",
@@ -601,17 +748,17 @@ int debug_display_pcb_pid(int pid)
 
     ptr = DEBUG_LOC_PT + pid * PT_ENTRY_SIZE;
 
-    return debug_display_fields(ptr, fields, fields_len, n_fields);
+    return debug_display_fields(machine, ptr, fields, fields_len, n_fields);
 }
 
 /* Debug pcb command */
-int debug_display_pcb()
+int debug_display_pcb(xsm_machine *machine)
 {
-    int pid = debug_active_process();
+    int pid = debug_active_process(machine);
 
     if (pid > -1)
     {
-        debug_display_pcb_pid(pid);
+        debug_display_pcb_pid(machine, pid);
         return TRUE;
     }
 
@@ -620,14 +767,14 @@ int debug_display_pcb()
 }
 
 /* Debug pagetable command */
-int debug_display_pt_ptbr()
+int debug_display_pt_ptbr(xsm_machine *machine)
 {
-    int addr = registers_get_integer("PTBR");
-    return debug_display_pt_at(addr);
+    int addr = registers_get_integer(machine, "PTBR");
+    return debug_display_pt_at(machine, addr);
 }
 
 /* Display Page Table at given addr */
-int debug_display_pt_at(int addr)
+int debug_display_pt_at(xsm_machine *machine, int addr)
 {
     int i, ptr;
     xsm_word *word;
@@ -638,11 +785,11 @@ int debug_display_pt_at(int addr)
     {
         printf("VIRT: %d\t\t", i);
 
-        word = memory_get_word(ptr);
+        word = memory_get_word(machine, ptr);
         printf("PHY: %s\t\t", word_get_string(word));
         ptr = ptr + 1;
 
-        word = memory_get_word(ptr);
+        word = memory_get_word(machine, ptr);
         printf("AUX: %s\t\n", word_get_string(word));
         ptr = ptr + 1;
     }
@@ -651,79 +798,79 @@ int debug_display_pt_at(int addr)
 }
 
 /* Debug pagetable pid command */
-int debug_display_pt_pid(int pid)
+int debug_display_pt_pid(xsm_machine *machine, int pid)
 {
     int ptbr_addr = DEBUG_PT_BASE + pid * MAX_NUM_PAGES * 2;
-    return debug_display_pt_at(ptbr_addr);
+    return debug_display_pt_at(machine, ptbr_addr);
 }
 
 /* Debug diskmaptable command */
-int debug_display_dmt()
+int debug_display_dmt(xsm_machine *machine)
 {
-    int pid = debug_active_process();
+    int pid = debug_active_process(machine);
 
     if (pid > -1)
-        return debug_dmt_pid(pid);
+        return debug_dmt_pid(machine, pid);
 
     printf("No active processes.\n");
     return FALSE;
 }
 
 /* Debug diskmaptable pid command */
-int debug_dmt_pid(int pid)
+int debug_dmt_pid(xsm_machine *machine, int pid)
 {
     int ptr;
     xsm_word *word;
 
     ptr = DEBUG_LOC_DISKMAPTABLE + pid * MAX_NUM_PAGES + 2;
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Heap 1 in Disk: %s\t", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Heap 2 in Disk: %s\n", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Code 1 in Disk: %s\t", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Code 2 in Disk: %s\n", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Code 3 in Disk: %s\t", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Code 4 in Disk: %s\n", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Stack 1 in Disk: %s\t", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Stack 2 in Disk: %s\n", word_get_string(word));
 
     return TRUE;
 }
 
 /* Debug resourcetable command */
-int debug_display_rt()
+int debug_display_rt(xsm_machine *machine)
 {
-    int pid = debug_active_process();
+    int pid = debug_active_process(machine);
 
     if (pid > -1)
-        return debug_rt_pid(pid);
+        return debug_rt_pid(machine, pid);
 
     printf("No active processes.\n");
     return FALSE;
 }
 
 /* Debug resourcetable pid command */
-int debug_rt_pid(int pid)
+int debug_rt_pid(xsm_machine *machine, int pid)
 {
     int ptr, page, rid, i;
     xsm_word *word;
 
     page = DEBUG_LOC_PT + pid * PT_ENTRY_SIZE + 11;
-    word = memory_get_word(page);
+    word = memory_get_word(machine, page);
     page = word_get_integer(word);
 
     if (page < 0 || page >= XSM_MEMORY_NUMPAGES)
@@ -738,7 +885,7 @@ int debug_rt_pid(int pid)
     {
         printf("%d. ", i);
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         rid = word_get_integer(word);
         printf("Resource Identifier: ");
 
@@ -755,7 +902,7 @@ int debug_rt_pid(int pid)
             break;
         }
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("Index of Table Entry: %s\n", word_get_string(word));
     }
 
@@ -763,7 +910,7 @@ int debug_rt_pid(int pid)
 }
 
 /* Debug filetable command */
-int debug_display_ft()
+int debug_display_ft(xsm_machine *machine)
 {
     int ptr, i;
     xsm_word *word;
@@ -774,13 +921,13 @@ int debug_display_ft()
     {
         printf("%d. ", i);
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("Inode Index: %s\t", word_get_string(word));
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("Open Instance Count: %s\t", word_get_string(word));
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("Lseek: %s\n", word_get_string(word));
 
         ptr++; /* Unused field. */
@@ -790,7 +937,7 @@ int debug_display_ft()
 }
 
 /* Debug semtable command */
-int debug_display_st()
+int debug_display_st(xsm_machine *machine)
 {
     int ptr, i;
     xsm_word *word;
@@ -801,10 +948,10 @@ int debug_display_st()
     {
         printf("%d. ", i);
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("Locking PID: %s\t", word_get_string(word));
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("Process Count: %s\n", word_get_string(word));
 
         ptr += 2; /* Unused field. */
@@ -814,7 +961,7 @@ int debug_display_st()
 }
 
 /* Debug memfreelist command */
-int debug_display_memlist()
+int debug_display_memlist(xsm_machine *machine)
 {
     int i, ptr;
     xsm_word *word;
@@ -823,16 +970,16 @@ int debug_display_memlist()
 
     for (i = 0; i < MAX_MEM_PAGE;)
     {
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("%d\t%s\t\t", i, word_get_string(word));
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("%d\t%s\t\t", i + 1, word_get_string(word));
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("%d\t%s\t\t", i + 2, word_get_string(word));
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("%d\t%s\n", i + 3, word_get_string(word));
 
         i = i + 4;
@@ -842,7 +989,7 @@ int debug_display_memlist()
 }
 
 /* Debug filestatus command */
-int debug_display_fst()
+int debug_display_fst(xsm_machine *machine)
 {
     int ptr, i;
     xsm_word *word;
@@ -853,10 +1000,10 @@ int debug_display_fst()
     {
         printf("%d. ", i);
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("Locking PID: %s\t", word_get_string(word));
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("File Open Count: %s\n", word_get_string(word));
 
         ptr += 2; /* Unused field. */
@@ -866,26 +1013,26 @@ int debug_display_fst()
 }
 
 /* Debug diskstatus command */
-int debug_display_dst()
+int debug_display_dst(xsm_machine *machine)
 {
     int ptr, i;
     xsm_word *word;
 
     ptr = DEBUG_LOC_DISKSTATUS;
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Status: %s\n", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Load/Store Bit: %s\n", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Page Number: %s\n", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Block Number: %s\n", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("PID: %s\n", word_get_string(word));
 
     ptr += 3; /* Unused field. */
@@ -894,29 +1041,29 @@ int debug_display_dst()
 }
 
 /* Debug systemstatus command */
-int debug_display_sst()
+int debug_display_sst(xsm_machine *machine)
 {
     int ptr, i;
     xsm_word *word;
 
     ptr = DEBUG_LOC_SYSTEMSTATUS;
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Current User ID: %s\n", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Current PID: %s\n", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Memory Free Count: %s\n", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Wait Memory Count: %s\n", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Swapped Count: %s\n", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Paging Status: %s\n", word_get_string(word));
 
     ptr += 2; /* Unused field. */
@@ -925,17 +1072,17 @@ int debug_display_sst()
 }
 
 /* Debug terminalstatus command */
-int debug_display_tst()
+int debug_display_tst(xsm_machine *machine)
 {
     int ptr, i;
     xsm_word *word;
 
     ptr = DEBUG_LOC_TERMINALSTATUS;
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("Status: %s\t", word_get_string(word));
 
-    word = memory_get_word(ptr++);
+    word = memory_get_word(machine, ptr++);
     printf("PID: %s\n", word_get_string(word));
 
     ptr += 2; /* Unused field. */
@@ -944,7 +1091,7 @@ int debug_display_tst()
 }
 
 /* Debug buffertable command */
-int debug_display_bt()
+int debug_display_bt(xsm_machine *machine)
 {
     int ptr, i;
     xsm_word *word;
@@ -955,13 +1102,13 @@ int debug_display_bt()
     {
         printf("%d. ", i);
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("Block Number: %s\t", word_get_string(word));
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("Dirty Bit: %s\t", word_get_string(word));
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("Locking PID: %s\n", word_get_string(word));
 
         ptr += 1; /* Unused field. */
@@ -971,7 +1118,7 @@ int debug_display_bt()
 }
 
 /* Debug inodetable command */
-int debug_display_inodetable()
+int debug_display_inodetable(xsm_machine *machine)
 {
     int i, ptr;
     const char *fields[] = {
@@ -985,7 +1132,7 @@ int debug_display_inodetable()
 
     for (i = 0; i < MAX_FILE_NUM; i++)
     {
-        debug_display_fields(ptr, fields, fields_len, n_fields);
+        debug_display_fields(machine, ptr, fields, fields_len, n_fields);
         printf("\n");
 
         /* Size of each entry is 16 */
@@ -996,7 +1143,7 @@ int debug_display_inodetable()
 }
 
 /* Debug usertable command */
-int debug_display_usertable()
+int debug_display_usertable(xsm_machine *machine)
 {
     const char *fields[] = {
         "User name", "Encrypted Password"};
@@ -1010,7 +1157,7 @@ int debug_display_usertable()
 
     for (i = 0; i < MAX_USER_NUM; i++)
     {
-        debug_display_fields(ptr, fields, fields_len, n_fields);
+        debug_display_fields(machine, ptr, fields, fields_len, n_fields);
         printf("\n");
 
         /* Update ptr */
@@ -1021,7 +1168,7 @@ int debug_display_usertable()
 }
 
 /* Debug diskfreelist command */
-int debug_display_dfl()
+int debug_display_dfl(xsm_machine *machine)
 {
     int i, ptr;
     xsm_word *word;
@@ -1030,23 +1177,23 @@ int debug_display_dfl()
 
     for (i = 0; i < XSM_DISK_BLOCK_SIZE; i += 4)
     {
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("%d\t%s\t\t", i, word_get_string(word));
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("%d\t%s\t\t", i + 1, word_get_string(word));
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("%d\t%s\t\t", i + 2, word_get_string(word));
 
-        word = memory_get_word(ptr++);
+        word = memory_get_word(machine, ptr++);
         printf("%d\t%s\n", i + 3, word_get_string(word));
     }
 
     return TRUE;
 }
 
-int debug_display_rf()
+int debug_display_rf(xsm_machine *machine)
 {
     const char *fields[] = {
         "File Name",
@@ -1071,7 +1218,7 @@ int debug_display_rf()
 
     for (i = 0; i < MAX_FILE_NUM; ++i)
     {
-        debug_display_fields(ptr, fields, fields_len, n_fields);
+        debug_display_fields(machine, ptr, fields, fields_len, n_fields);
         printf("\n");
 
         /* Size of each entry is 16 */
@@ -1082,20 +1229,20 @@ int debug_display_rf()
 }
 
 /* Display location command */
-int debug_display_location(int loc)
+int debug_display_location(xsm_machine *machine, int loc)
 {
     int mode, ptbr, ptlr, tr_loc;
     xsm_word *word;
 
-    mode = machine_get_mode();
+    mode = machine_get_mode(machine);
 
     if (mode == PRIVILEGE_KERNEL)
-        word = memory_get_word(loc);
+        word = memory_get_word(machine, loc);
     else
     {
-        ptbr = registers_get_integer("PTBR");
-        ptlr = registers_get_integer("PTLR");
-        tr_loc = memory_translate_address(ptbr, ptlr, loc, FALSE);
+        ptbr = registers_get_integer(machine, "PTBR");
+        ptlr = registers_get_integer(machine, "PTLR");
+        tr_loc = memory_translate_address(machine, ptbr, ptlr, loc, FALSE);
 
         if (tr_loc < 0)
         {
@@ -1103,7 +1250,7 @@ int debug_display_location(int loc)
             return FALSE;
         }
 
-        word = memory_get_word(tr_loc);
+        word = memory_get_word(machine, tr_loc);
     }
 
     printf("%s\n", word_get_string(word));
@@ -1111,64 +1258,175 @@ int debug_display_location(int loc)
 }
 
 /* debug val command */
-int debug_display_val(char *mem)
+int debug_display_val(xsm_machine *machine, char *mem)
 {
-    xsm_word *mword = memory_get_word(atoi(mem));
+    xsm_word *mword = memory_get_word(machine, atoi(mem));
     printf("%s\n", word_get_string(mword));
 
     return TRUE;
 }
 
 /* Debug watch command */
-int debug_watch_add(int loc)
+int debug_watch_add(xsm_machine *machine, int low, int high, int access)
 {
-    if (_db_status.wp_size >= DEBUG_MAX_WP)
+    debug_status *debug = &machine->debug;
+    int i, page, reach, max;
+    debug_watch *wp;
+    int *wp_reach;
+
+    if (low < 0 || low > high || high >= XSM_MEMORY_SIZE)
         return FALSE;
 
-    _db_status.wp[_db_status.wp_size] = loc;
-    _db_status.wp_size++;
+    /* Grow both arrays together when full */
+    if (debug->wp_size == debug->wp_max)
+    {
+        max = debug->wp_max ? debug->wp_max * 2 : DEBUG_WP_INITIAL;
+        wp = (debug_watch *)realloc(debug->wp, max * sizeof(debug_watch));
+
+        if (!wp)
+            return FALSE;
+
+        debug->wp = wp;
+        wp_reach = (int *)realloc(debug->wp_reach, max * sizeof(int));
+
+        if (!wp_reach)
+            return FALSE;
+
+        debug->wp_reach = wp_reach;
+        debug->wp_max = max;
+    }
+
+    /* Kept in order of the lowest address */
+    for (i = debug->wp_size; i > 0 && debug->wp[i - 1].low > low; --i)
+        debug->wp[i] = debug->wp[i - 1];
+
+    debug->wp[i].low = low;
+    debug->wp[i].high = high;
+    debug->wp[i].access = access;
+    debug->wp_size++;
+
+    reach = -1;
+
+    for (i = 0; i < debug->wp_size; ++i)
+    {
+        if (debug->wp[i].high > reach)
+            reach = debug->wp[i].high;
+
+        debug->wp_reach[i] = reach;
+    }
+
+    for (page = low / XSM_PAGE_SIZE; page <= high / XSM_PAGE_SIZE; ++page)
+        debug->wp_pages[access][page / 8] |= 1 << (page % 8);
 
     return TRUE;
 }
 
 /* Debug watchclear command */
-void debug_watch_clear()
+void debug_watch_clear(xsm_machine *machine)
 {
-    _db_status.wp_size = 0;
+    machine->debug.wp_size = 0;
+    machine->debug.wp_hit = DEBUG_ERROR;
+    memset(machine->debug.wp_pages, 0, sizeof(machine->debug.wp_pages));
 }
 
-/* Check if any watch points have been triggered */
-int debug_watch_test(int mem_left, int mem_right)
+/* Called for every access to physical memory while debugging */
+void debug_watch_access(xsm_machine *machine, int low, int high, int access)
 {
-    int i;
+    debug_status *debug = &machine->debug;
+    int page, wp;
+
+    /* Nearly every access is to a page nothing is watched in */
+    for (page = low / XSM_PAGE_SIZE; page <= high / XSM_PAGE_SIZE; ++page)
+        if ((debug->wp_pages[access][page / 8] >> (page % 8)) & 1)
+            break;
+
+    if (page > high / XSM_PAGE_SIZE || debug->wp_hit >= 0)
+        return;
+
+    wp = debug_watch_find(machine, low, high, access);
+
+    if (wp < 0)
+        return;
+
+    debug->wp_hit = wp;
+    debug->wp_address = (low > debug->wp[wp].low) ? low : debug->wp[wp].low;
+}
+
+/* Find a watch point on the given kind of access within the range of addresses */
+int debug_watch_find(xsm_machine *machine, int low, int high, int access)
+{
+    debug_status *debug = &machine->debug;
+    int first, last, middle, i;
+
+    /* Past the last watch point starting at or before the range */
+    first = 0;
+    last = debug->wp_size;
+
+    while (first < last)
+    {
+        middle = (first + last) / 2;
 
-    if (mem_left < 0)
-        return DEBUG_ERROR;
+        if (debug->wp[middle].low <= high)
+            first = middle + 1;
+        else
+            last = middle;
+    }
 
-    for (i = 0; i < _db_status.wp_size; ++i)
-        if (mem_left == _db_status.wp[i] || _db_status.wp[i] == mem_right)
+    /* None before one that reaches no further than the range starts can overlap it */
+    for (i = first - 1; i >= 0 && debug->wp_reach[i] >= low; --i)
+        if (debug->wp[i].access == access && debug->wp[i].high >= low)
             return i;
 
     return DEBUG_ERROR;
 }
 
+/* List the breakpoints by address */
+void debug_display_breakpoints(xsm_machine *machine)
+{
+    xsm_breakpoints *breakpoints = &machine->breakpoints;
+    int i, j, low, ip;
+
+    if (breakpoints->count == 0)
+    {
+        printf("No breakpoints set.\n");
+        return;
+    }
+
+    ip = 0;
+
+    /* Few enough to find the next lowest each time */
+    for (i = 0; i < breakpoints->count; ++i)
+    {
+        for (j = 0, low = -1; j < BREAKPOINT_SLOTS; ++j)
+            if (breakpoints->slots[j].used && (i == 0 || breakpoints->slots[j].ip > ip) && (low < 0 || breakpoints->slots[j].ip < breakpoints->slots[low].ip))
+                low = j;
+
+        ip = breakpoints->slots[low].ip;
+
+        if (breakpoints->slots[low].length)
+            printf("Breakpoint at %d if %s\n", ip, breakpoints->slots[low].condition);
+        else
+            printf("Breakpoint at %d\n", ip);
+    }
+}
+
 /* Debug list command */
-int debug_display_list()
+int debug_display_list(xsm_machine *machine)
 {
     int i, addr;
     char instr[DEBUG_STRING_LEN];
 
     for (i = 0; i <= 2 * DEBUG_LIST_LEN; i++)
     {
-        addr = machine_translate_address(_db_status.ip + (i - DEBUG_LIST_LEN) * XSM_INSTRUCTION_SIZE, FALSE, DEBUG_FETCH, machine_get_mode());
+        addr = machine_translate_address(machine, machine->debug.ip + (i - DEBUG_LIST_LEN) * XSM_INSTRUCTION_SIZE, FALSE, DEBUG_FETCH, machine_get_mode(machine));
         if (addr >= 0)
-            memory_retrieve_raw_instr(instr, addr);
+            memory_retrieve_raw_instr(machine, instr, addr);
         else
             instr[0] = '\0';
         if (i == DEBUG_LIST_LEN)
-            printf("%d* \t %s \n", _db_status.ip + (i - DEBUG_LIST_LEN) * XSM_INSTRUCTION_SIZE, instr);
+            printf("%d* \t %s \n", machine->debug.ip + (i - DEBUG_LIST_LEN) * XSM_INSTRUCTION_SIZE, instr);
         else
-            printf("%d \t %s \n", _db_status.ip + (i - DEBUG_LIST_LEN) * XSM_INSTRUCTION_SIZE, instr);
+            printf("%d \t %s \n", machine->debug.ip + (i - DEBUG_LIST_LEN) * XSM_INSTRUCTION_SIZE, instr);
     }
 
     return TRUE;
@@ -1192,6 +1450,8 @@ void debug_display_help()
 {
     printf(" step / s \n\t Execution proceeds by a single step \n");
     printf(" step / s <N> \n\t Execution proceeds by N number of steps \n");
+    printf(" back / rs \n\t Execution goes back by a single step \n");
+    printf(" back / rs <N> \n\t Execution goes back by N number of steps \n");
     printf(" continue / c \n\t Execution proceeds till the next BRKP instruction \n");
     printf(" continue / c <N> \n\t Execution proceeds till the next N'th occurence of the BRKP instruction \n");
     printf(" reg / r \n\t Displays the contents of all the machine registers \n");
@@ -1221,7 +1481,15 @@ void debug_display_help()
     printf(" location / loc <address> \n\t Displays the content at memory address (address translation takes place if used in USER mode) \n");
     printf(" val / v <address> \n\t Displays the content at memory address (no address translation occurs) \n");
     printf(" watch / w <physical_address> \n\t Sets a watch point at this address \n");
+    printf(" watch / w <physical_address_1> <physical_address_2> \n\t Sets a watch point on the addresses from <physical_address_1> to <physical_address_2> \n");
+    printf(" readwatch / rw <physical_address> \n\t Sets a watch point on reads of this address \n");
+    printf(" readwatch / rw <physical_address_1> <physical_address_2> \n\t Sets a watch point on reads of the addresses from <physical_address_1> to <physical_address_2> \n");
     printf(" watchclear / wc \n\t Clears all the watch points \n");
+    printf(" break / b \n\t Lists the breakpoints \n");
+    printf(" break / b <address> \n\t Stops before the instruction at this logical address \n");
+    printf(" break / b <address> if <condition> \n\t Stops there only if the condition holds, eg. R1 == 5 && [SP] > 100 \n");
+    printf(" breakclear / bc \n\t Clears all the breakpoints \n");
+    printf(" breakclear / bc <address> \n\t Clears the breakpoint at this address \n");
     printf(" list / l \n\t List 10 instructions before and after the current instruction \n");
     printf(" page / pg <address> \n\t Displays the Page Number and Offset for the given <address> \n");
     printf(" exit / e \n\t Exits the debug prompt and halts the machine \n");
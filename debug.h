@@ -2,8 +2,8 @@
 
 #define XSM_DEBUG_H
 
-#include "machine.h"
 #include "constants.h"
+#include "types.h"
 
 #define OFF FALSE
 #define ON TRUE
@@ -39,8 +39,12 @@
 #define DEBUG_PAGE 25
 #define DEBUG_EXIT 26
 #define DEBUG_HELP 27
+#define DEBUG_BACK 28
+#define DEBUG_READWATCH 29
+#define DEBUG_BREAK 30
+#define DEBUG_BREAKCLEAR 31
 
-#define DEBUG_COUNT 28
+#define DEBUG_COUNT 32
 
 #define DEBUG_LOC_PT 28672
 #define MAX_PROC_NUM 16
@@ -74,13 +78,24 @@
 #define MAX_BUFFER 4
 #define MAX_RESOURCE 8
 
-#define DEBUG_MAX_WP 16
+#define DEBUG_WP_INITIAL 16
 #define DEBUG_ERROR -1
 
+/* Kinds of memory access a watch point is set on */
+#define DEBUG_WATCH_WRITE 0
+#define DEBUG_WATCH_READ 1
+
 struct _xsm_cpu;
 
 typedef struct _xsm_cpu xsm_cpu;
 
+/* Watch point on a range of physical addresses */
+typedef struct _debug_watch
+{
+    int low, high;
+    int access;
+} debug_watch;
+
 typedef struct _debug_status
 {
     int state;
@@ -88,54 +103,69 @@ typedef struct _debug_status
     int prev_mode;
     int skip;
     int skip_command;
-    int wp[16];
-    int wp_size;
+
+    /* Watch points by their lowest address, and the highest address any of the first i + 1 reach */
+    debug_watch *wp;
+    int *wp_reach;
+    int wp_size, wp_max;
+
+    /* Pages holding a watched address, for each kind of access */
+    unsigned char wp_pages[2][XSM_MEMORY_NUMPAGES / 8];
+
+    /* Watch point the last instruction triggered and the address it accessed */
+    int wp_hit, wp_address;
+
     char command[DEBUG_COMMAND_LEN];
 } debug_status;
 
-int debug_init();
-void debug_activate();
-void debug_deactivate();
-int debug_next_step(int curr_ip);
-int debug_show_interface();
-int debug_command(char *command);
+int debug_init(xsm_machine *machine);
+void debug_activate(xsm_machine *machine);
+void debug_deactivate(xsm_machine *machine);
+void debug_destroy(xsm_machine *machine);
+int debug_next_step(xsm_machine *machine, int curr_ip);
+int debug_show_interface(xsm_machine *machine);
+int debug_command(xsm_machine *machine, char *command);
 int debug_command_code(const char *cmd);
 void debug_invalid_cmd(const char *cmd);
-int debug_active_process();
-int debug_skip_n(int num, int debug_command);
-int debug_display_all_registers();
-int debug_display_register(const char *regname);
-int debug_display_range_reg(const char *reg_b_name, const char *reg_e_name);
-int debug_display_mem(int page);
-int debug_display_mem_range(int page_l, int page_h);
-int debug_display_fields(int baseptr, const char **fields, const int *fields_len, int n_fields);
-int debug_display_pcb_pid(int pid);
-int debug_display_pcb();
-int debug_display_pt_ptbr();
-int debug_display_pt_at(int addr);
-int debug_display_pt_pid(int pid);
-int debug_display_dmt();
-int debug_dmt_pid(int pid);
-int debug_display_rt();
-int debug_rt_pid(int pid);
-int debug_display_ft();
-int debug_display_st();
-int debug_display_memlist();
-int debug_display_fst();
-int debug_display_dst();
-int debug_display_sst();
-int debug_display_tst();
-int debug_display_bt();
-int debug_display_inodetable();
-int debug_display_usertable();
-int debug_display_dfl();
-int debug_display_rf();
-int debug_display_location(int loc);
-int debug_display_val(char *mem);
-int debug_watch_add(int loc);
-void debug_watch_clear();
-int debug_watch_test(int mem_min, int mem_max);
-int debug_display_list();
+int debug_active_process(xsm_machine *machine);
+int debug_skip_n(xsm_machine *machine, int num, int debug_command);
+int debug_step_back(xsm_machine *machine, int num);
+void debug_display_position(xsm_machine *machine);
+int debug_display_all_registers(xsm_machine *machine);
+int debug_display_register(xsm_machine *machine, const char *regname);
+int debug_display_range_reg(xsm_machine *machine, const char *reg_b_name, const char *reg_e_name);
+int debug_display_mem(xsm_machine *machine, int page);
+int debug_display_mem_range(xsm_machine *machine, int page_l, int page_h);
+int debug_display_fields(xsm_machine *machine, int baseptr, const char **fields, const int *fields_len, int n_fields);
+int debug_display_pcb_pid(xsm_machine *machine, int pid);
+int debug_display_pcb(xsm_machine *machine);
+int debug_display_pt_ptbr(xsm_machine *machine);
+int debug_display_pt_at(xsm_machine *machine, int addr);
+int debug_display_pt_pid(xsm_machine *machine, int pid);
+int debug_display_dmt(xsm_machine *machine);
+int debug_dmt_pid(xsm_machine *machine, int pid);
+int debug_display_rt(xsm_machine *machine);
+int debug_rt_pid(xsm_machine *machine, int pid);
+int debug_display_ft(xsm_machine *machine);
+int debug_display_st(xsm_machine *machine);
+int debug_display_memlist(xsm_machine *machine);
+int debug_display_fst(xsm_machine *machine);
+int debug_display_dst(xsm_machine *machine);
+int debug_display_sst(xsm_machine *machine);
+int debug_display_tst(xsm_machine *machine);
+int debug_display_bt(xsm_machine *machine);
+int debug_display_inodetable(xsm_machine *machine);
+int debug_display_usertable(xsm_machine *machine);
+int debug_display_dfl(xsm_machine *machine);
+int debug_display_rf(xsm_machine *machine);
+int debug_display_location(xsm_machine *machine, int loc);
+int debug_display_val(xsm_machine *machine, char *mem);
+int debug_watch_add(xsm_machine *machine, int low, int high, int access);
+void debug_watch_clear(xsm_machine *machine);
+void debug_watch_access(xsm_machine *machine, int low, int high, int access);
+int debug_watch_find(xsm_machine *machine, int low, int high, int access);
+void debug_display_breakpoints(xsm_machine *machine);
+int debug_display_list(xsm_machine *machine);
 int debug_display_page(int ip);
 void debug_display_help();
 
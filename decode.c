@@ -0,0 +1,462 @@
+/*
+Decoded instruction cache. Instructions are tokenized once and looked up by physical address.
+*/
+
+#include "decode.h"
+
+#include "machine.h"
+#include "memory.h"
+#include "registers.h"
+#include "tokenize.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const int _operand_count[XSM_INSTRUCTION_COUNT] = {
+    2, /* MOV */
+    2, /* ADD */
+    2, /* SUB */
+    2, /* MUL */
+    2, /* DIV */
+    2, /* MOD */
+    1, /* INR */
+    1, /* DCR */
+    2, /* LT */
+    2, /* GT */
+    2, /* EQ */
+    2, /* NE */
+    2, /* GE */
+    2, /* LE */
+    2, /* JZ */
+    2, /* JNZ */
+    1, /* JMP */
+    1, /* PUSH */
+    1, /* POP */
+    1, /* CALL */
+    0, /* RET */
+    0, /* BRKP */
+    1, /* INT */
+
+    2, /* LOADI */
+    2, /* LOAD */
+    2, /* STORE */
+    1, /* ENCRYPT */
+    0, /* BACKUP */
+    0, /* RESTORE */
+    2, /* PORT */
+    0, /* IN */
+    0, /* INI */
+    0, /* OUT */
+    0, /* IRET */
+    0, /* HALT */
+    0  /* NOP */
+};
+
+/* Initialise the instruction cache */
+int decode_init(xsm_machine *machine)
+{
+    memset(machine->decode.pages, 0, sizeof(machine->decode.pages));
+    return XSM_SUCCESS;
+}
+
+/* Returns the cached instruction at the given physical address */
+xsm_instruction *decode_fetch(xsm_machine *machine, int address)
+{
+    xsm_instruction *page;
+
+    page = machine->decode.pages[address / XSM_PAGE_SIZE];
+
+    if (!page || !page[address % XSM_PAGE_SIZE].valid)
+        return NULL;
+
+    return &page[address % XSM_PAGE_SIZE];
+}
+
+/* Returns the cache slot for the given physical address */
+xsm_instruction *decode_store(xsm_machine *machine, int address)
+{
+    int page = address / XSM_PAGE_SIZE;
+
+    if (!machine->decode.pages[page])
+    {
+        machine->decode.pages[page] = (xsm_instruction *)calloc(XSM_PAGE_SIZE, sizeof(xsm_instruction));
+
+        if (!machine->decode.pages[page])
+            return &machine->decode.scratch;
+    }
+
+    return &machine->decode.pages[page][address % XSM_PAGE_SIZE];
+}
+
+/* Decode the instruction in the token stream */
+int decode_instruction(xsm_machine *machine, xsm_instruction *instr)
+{
+    int token, count, i;
+    YYSTYPE token_info;
+
+    instr->num_operands = 0;
+    instr->kind = XSM_KIND_GENERIC;
+    instr->error = NULL;
+
+    token = tokenize_next_token(machine, &token_info);
+
+    if (token != TOKEN_INSTRUCTION)
+    {
+        instr->opcode = XSM_ILLINSTR;
+        instr->error = "The simulator has encountered an illegal instruction";
+        return XSM_FAILURE;
+    }
+
+    instr->opcode = machine_get_opcode(token_info.str);
+
+    if (instr->opcode == XSM_ILLINSTR)
+    {
+        instr->error = "The instruction is not available in this architecture";
+        return XSM_FAILURE;
+    }
+
+    count = decode_operand_count(instr->opcode);
+
+    for (i = 0; i < count; ++i)
+    {
+        /* Operands are separated by a comma */
+        if (i > 0 && tokenize_next_token(machine, &token_info) != TOKEN_COMMA)
+        {
+            instr->error = "Malformed instruction";
+            return XSM_FAILURE;
+        }
+
+        if (!decode_operand(machine, &instr->operands[i]))
+        {
+            instr->error = "Malformed instruction";
+            return XSM_FAILURE;
+        }
+
+        instr->num_operands++;
+    }
+
+    decode_specialize(machine, instr);
+    return XSM_SUCCESS;
+}
+
+/* Decode the next operand in the token stream */
+int decode_operand(xsm_machine *machine, xsm_operand *operand)
+{
+    int token;
+    YYSTYPE token_info;
+
+    token = tokenize_next_token(machine, &token_info);
+
+    switch (token)
+    {
+    case TOKEN_REGISTER:
+        operand->type = XSM_OPERAND_REGISTER;
+        operand->val = registers_get_register_code(token_info.str);
+        break;
+
+    case TOKEN_NUMBER:
+        operand->type = XSM_OPERAND_NUMBER;
+        operand->val = token_info.val;
+        break;
+
+    case TOKEN_STRING:
+        operand->type = XSM_OPERAND_STRING;
+        strncpy(operand->str, token_info.str, XSM_WORD_SIZE);
+        break;
+
+    case TOKEN_DREF_L:
+        token = tokenize_next_token(machine, &token_info);
+
+        if (token == TOKEN_REGISTER)
+        {
+            operand->type = XSM_OPERAND_DREF_REGISTER;
+            operand->val = registers_get_register_code(token_info.str);
+        }
+        else if (token == TOKEN_NUMBER)
+        {
+            operand->type = XSM_OPERAND_DREF_NUMBER;
+            operand->val = token_info.val;
+        }
+        else
+            return XSM_FAILURE;
+
+        /* The closing square bracket */
+        if (tokenize_next_token(machine, &token_info) != TOKEN_DREF_R)
+            return XSM_FAILURE;
+        break;
+
+    default:
+        operand->type = XSM_OPERAND_NONE;
+        return XSM_FAILURE;
+    }
+
+    return XSM_SUCCESS;
+}
+
+/* Returns the number of operands the instruction takes */
+int decode_operand_count(int opcode)
+{
+    if (opcode < 0 || opcode >= XSM_INSTRUCTION_COUNT)
+        return 0;
+
+    return _operand_count[opcode];
+}
+
+/* Checks whether the operand is a register every mode may use */
+int decode_register_ok(xsm_machine *machine, xsm_operand *operand)
+{
+    if (operand->type != XSM_OPERAND_REGISTER || operand->val == IP)
+        return FALSE;
+
+    return registers_umode_by_code(machine, operand->val);
+}
+
+/* Select the threaded interpreter handler for the operand kinds of the instruction */
+int decode_specialize(xsm_machine *machine, xsm_instruction *instr)
+{
+    int left_reg, right_reg, right_imm, left_dref, right_dref;
+    xsm_operand *left, *right;
+
+    left = &instr->operands[0];
+    right = &instr->operands[1];
+
+    left_reg = decode_register_ok(machine, left);
+    left_dref = (left->type == XSM_OPERAND_DREF_REGISTER || left->type == XSM_OPERAND_DREF_NUMBER);
+    right_reg = decode_register_ok(machine, right);
+    right_imm = (right->type == XSM_OPERAND_NUMBER);
+    right_dref = (right->type == XSM_OPERAND_DREF_REGISTER || right->type == XSM_OPERAND_DREF_NUMBER);
+
+    if (left_dref && left->type == XSM_OPERAND_DREF_REGISTER && !registers_get_register_by_code(machine, left->val))
+        left_dref = FALSE;
+
+    if (right_dref && right->type == XSM_OPERAND_DREF_REGISTER && !registers_get_register_by_code(machine, right->val))
+        right_dref = FALSE;
+
+    instr->kind = XSM_KIND_GENERIC;
+
+    switch (instr->opcode)
+    {
+    case MOV:
+        if (left_reg && right_reg)
+            instr->kind = XSM_KIND_MOV_RR;
+        else if (left_reg && right_imm)
+            instr->kind = XSM_KIND_MOV_RI;
+        else if (left_reg && right->type == XSM_OPERAND_STRING)
+            instr->kind = XSM_KIND_MOV_RS;
+        else if (left_reg && right_dref)
+            instr->kind = XSM_KIND_MOV_RD;
+        else if (left_dref && right_reg)
+            instr->kind = XSM_KIND_MOV_DR;
+        else if (left_dref && right_imm)
+            instr->kind = XSM_KIND_MOV_DI;
+        break;
+
+    case ADD:
+        if (left_reg && right_reg)
+            instr->kind = XSM_KIND_ADD_RR;
+        else if (left_reg && right_imm)
+            instr->kind = XSM_KIND_ADD_RI;
+        break;
+
+    case SUB:
+        if (left_reg && right_reg)
+            instr->kind = XSM_KIND_SUB_RR;
+        else if (left_reg && right_imm)
+            instr->kind = XSM_KIND_SUB_RI;
+        break;
+
+    case MUL:
+        if (left_reg && right_reg)
+            instr->kind = XSM_KIND_MUL_RR;
+        else if (left_reg && right_imm)
+            instr->kind = XSM_KIND_MUL_RI;
+        break;
+
+    case INR:
+        if (left_reg)
+            instr->kind = XSM_KIND_INR_R;
+        break;
+
+    case DCR:
+        if (left_reg)
+            instr->kind = XSM_KIND_DCR_R;
+        break;
+
+    case LT:
+    case GT:
+    case EQ:
+    case NE:
+    case GE:
+    case LE:
+        if (left_reg && right_reg)
+            instr->kind = XSM_KIND_LT_RR + (instr->opcode - LT);
+        break;
+
+    case JMP:
+        if (left->type == XSM_OPERAND_NUMBER)
+            instr->kind = XSM_KIND_JMP_I;
+        break;
+
+    case JZ:
+        if (left_reg && right_imm)
+            instr->kind = XSM_KIND_JZ_RI;
+        break;
+
+    case JNZ:
+        if (left_reg && right_imm)
+            instr->kind = XSM_KIND_JNZ_RI;
+        break;
+
+    case PUSH:
+        if (left_reg)
+            instr->kind = XSM_KIND_PUSH_R;
+        break;
+
+    case POP:
+        if (left_reg)
+            instr->kind = XSM_KIND_POP_R;
+        break;
+
+    case CALL:
+        if (left->type == XSM_OPERAND_NUMBER)
+            instr->kind = XSM_KIND_CALL_I;
+        break;
+
+    case RET:
+        instr->kind = XSM_KIND_RET;
+        break;
+
+    case NOP:
+        instr->kind = XSM_KIND_NOP;
+        break;
+    }
+
+    return instr->kind;
+}
+
+/* Returns the fused kind of an instruction followed by one of next_kind */
+int decode_fuse_kind(int kind, int next_kind)
+{
+    switch (kind)
+    {
+    case XSM_KIND_LT_RR:
+    case XSM_KIND_GT_RR:
+    case XSM_KIND_EQ_RR:
+    case XSM_KIND_NE_RR:
+    case XSM_KIND_GE_RR:
+    case XSM_KIND_LE_RR:
+    case XSM_KIND_CMP_JCC:
+        if (next_kind == XSM_KIND_JZ_RI || next_kind == XSM_KIND_JNZ_RI)
+            return XSM_KIND_CMP_JCC;
+        break;
+
+    case XSM_KIND_INR_R:
+    case XSM_KIND_INR_JMP:
+        if (next_kind == XSM_KIND_JMP_I)
+            return XSM_KIND_INR_JMP;
+        break;
+
+    case XSM_KIND_DCR_R:
+    case XSM_KIND_DCR_JMP:
+        if (next_kind == XSM_KIND_JMP_I)
+            return XSM_KIND_DCR_JMP;
+        break;
+
+    case XSM_KIND_PUSH_R:
+    case XSM_KIND_PUSH_RUN:
+        if (next_kind == XSM_KIND_PUSH_R || next_kind == XSM_KIND_PUSH_RUN)
+            return XSM_KIND_PUSH_RUN;
+        break;
+
+    case XSM_KIND_POP_R:
+    case XSM_KIND_POP_RUN:
+        if (next_kind == XSM_KIND_POP_R || next_kind == XSM_KIND_POP_RUN)
+            return XSM_KIND_POP_RUN;
+        break;
+    }
+
+    return XSM_KIND_GENERIC;
+}
+
+/* Fuse the newly decoded instruction at the given address with its neighbours */
+void decode_fuse(xsm_machine *machine, int address)
+{
+    decode_fuse_at(machine, address - XSM_INSTRUCTION_SIZE);
+    decode_fuse_at(machine, address);
+}
+
+/* Fuse the instruction at the given address with the one after it */
+void decode_fuse_at(xsm_machine *machine, int address)
+{
+    int fused;
+    xsm_instruction *instr, *next;
+
+    /* Both instructions have to be in the same page */
+    if (address < 0 || address % XSM_PAGE_SIZE > XSM_PAGE_SIZE - 2 * XSM_INSTRUCTION_SIZE)
+        return;
+
+    instr = decode_fetch(machine, address);
+
+    if (!instr || instr->error)
+        return;
+
+    decode_specialize(machine, instr);
+    next = decode_fetch(machine, address + XSM_INSTRUCTION_SIZE);
+
+    if (!next)
+        return;
+
+    fused = decode_fuse_kind(instr->kind, next->kind);
+
+    if (fused != XSM_KIND_GENERIC)
+        instr->kind = fused;
+}
+
+/* Drop the cached instructions overlapping the given address */
+void decode_invalidate(xsm_machine *machine, int address)
+{
+    int i, addr;
+    xsm_instruction *page;
+
+    /* An instruction spans two words */
+    for (i = 0; i < XSM_INSTRUCTION_SIZE; ++i)
+    {
+        addr = address - i;
+
+        if (addr < 0 || addr >= XSM_MEMORY_SIZE)
+            continue;
+
+        page = machine->decode.pages[addr / XSM_PAGE_SIZE];
+
+        if (page)
+            page[addr % XSM_PAGE_SIZE].valid = FALSE;
+    }
+}
+
+/* Drop the cached instructions in the given page */
+void decode_invalidate_page(xsm_machine *machine, int page)
+{
+    int i;
+
+    if (page < 0 || page >= XSM_MEMORY_NUMPAGES)
+        return;
+
+    if (machine->decode.pages[page])
+        for (i = 0; i < XSM_PAGE_SIZE; ++i)
+            machine->decode.pages[page][i].valid = FALSE;
+
+    /* The last instruction of the previous page may spill over */
+    decode_invalidate(machine, page * XSM_PAGE_SIZE);
+}
+
+/* Deallocate the instruction cache */
+void decode_destroy(xsm_machine *machine)
+{
+    int i;
+
+    for (i = 0; i < XSM_MEMORY_NUMPAGES; ++i)
+    {
+        free(machine->decode.pages[i]);
+        machine->decode.pages[i] = NULL;
+    }
+}
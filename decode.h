@@ -0,0 +1,103 @@
+#ifndef XSM_DECODE_H
+
+#define XSM_DECODE_H
+
+#include "types.h"
+
+#define XSM_OPERAND_NONE 0
+#define XSM_OPERAND_REGISTER 1
+#define XSM_OPERAND_NUMBER 2
+#define XSM_OPERAND_STRING 3
+#define XSM_OPERAND_DREF_REGISTER 4
+#define XSM_OPERAND_DREF_NUMBER 5
+
+#define XSM_MAX_OPERANDS 2
+
+/*
+Handler kinds of the threaded interpreter, by operand kind.
+R register, I immediate, S string, D memory dereference.
+*/
+#define XSM_KIND_GENERIC 0
+#define XSM_KIND_MOV_RR 1
+#define XSM_KIND_MOV_RI 2
+#define XSM_KIND_MOV_RS 3
+#define XSM_KIND_MOV_RD 4
+#define XSM_KIND_MOV_DR 5
+#define XSM_KIND_MOV_DI 6
+#define XSM_KIND_ADD_RR 7
+#define XSM_KIND_ADD_RI 8
+#define XSM_KIND_SUB_RR 9
+#define XSM_KIND_SUB_RI 10
+#define XSM_KIND_MUL_RR 11
+#define XSM_KIND_MUL_RI 12
+#define XSM_KIND_INR_R 13
+#define XSM_KIND_DCR_R 14
+#define XSM_KIND_LT_RR 15
+#define XSM_KIND_GT_RR 16
+#define XSM_KIND_EQ_RR 17
+#define XSM_KIND_NE_RR 18
+#define XSM_KIND_GE_RR 19
+#define XSM_KIND_LE_RR 20
+#define XSM_KIND_JMP_I 21
+#define XSM_KIND_JZ_RI 22
+#define XSM_KIND_JNZ_RI 23
+#define XSM_KIND_PUSH_R 24
+#define XSM_KIND_POP_R 25
+#define XSM_KIND_CALL_I 26
+#define XSM_KIND_RET 27
+#define XSM_KIND_NOP 28
+
+/* Instructions fused with the one after them */
+#define XSM_KIND_CMP_JCC 29
+#define XSM_KIND_INR_JMP 30
+#define XSM_KIND_DCR_JMP 31
+#define XSM_KIND_PUSH_RUN 32
+#define XSM_KIND_POP_RUN 33
+
+#define XSM_KIND_COUNT 34
+
+typedef struct _xsm_operand
+{
+    int type;
+
+    /* Register code or immediate value */
+    int val;
+    char str[XSM_WORD_SIZE];
+} xsm_operand;
+
+typedef struct _xsm_instruction
+{
+    int valid;
+    int opcode;
+    int kind;
+    int num_operands;
+    xsm_operand operands[XSM_MAX_OPERANDS];
+
+    /* Set if the instruction could not be decoded */
+    char *error;
+} xsm_instruction;
+
+typedef struct _xsm_decode_cache
+{
+    xsm_instruction *pages[XSM_MEMORY_NUMPAGES];
+
+    /* Used when a page of the cache can not be allocated */
+    xsm_instruction scratch;
+} xsm_decode_cache;
+
+int decode_init(xsm_machine *machine);
+xsm_instruction *decode_fetch(xsm_machine *machine, int address);
+xsm_instruction *decode_store(xsm_machine *machine, int address);
+int decode_instruction(xsm_machine *machine, xsm_instruction *instr);
+int decode_operand(xsm_machine *machine, xsm_operand *operand);
+int decode_operand_count(int opcode);
+int decode_specialize(xsm_machine *machine, xsm_instruction *instr);
+int decode_register_ok(xsm_machine *machine, xsm_operand *operand);
+int decode_fuse_kind(int kind, int next_kind);
+void decode_fuse(xsm_machine *machine, int address);
+void decode_fuse_at(xsm_machine *machine, int address);
+void decode_invalidate(xsm_machine *machine, int address);
+void decode_invalidate_page(xsm_machine *machine, int page);
+void decode_destroy(xsm_machine *machine);
+
+#endif
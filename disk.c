@@ -4,84 +4,209 @@ The XFS disk.
 
 #include "disk.h"
 
+#include "machine.h"
+
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-
-static xsm_word *_disk_mem_copy;
-
-static FILE *_file;
-
-static int _mem_size;
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /* Initialise disk */
-int disk_init(const char *filename)
+int disk_init(xsm_machine *machine, const char *filename, int overlay)
 {
-    _mem_size = sizeof(xsm_word) * XSM_DISK_BLOCK_SIZE * XSM_DISK_BLOCK_NUM;
+    struct stat st;
+    void *map;
+    ssize_t read_bytes;
+    int block;
 
-    /* Acquire memory for saving the memory copy. */
-    _disk_mem_copy = (xsm_word *)malloc(_mem_size);
+    machine->disk.mem_size = XSM_WORD_SIZE * XSM_DISK_BLOCK_SIZE * XSM_DISK_BLOCK_NUM;
+    memset(machine->disk.dirty, 0, sizeof(machine->disk.dirty));
 
-    if (!_disk_mem_copy)
-        return XSM_FAILURE;
+    machine->disk.overlay = overlay;
+    machine->disk.filename = NULL;
 
-    memset(_disk_mem_copy, 0, _mem_size);
-    _file = fopen(filename, "rb+");
+    /* A disk without a file starts blank and has nowhere to be written back */
+    if (filename)
+    {
+        machine->disk.filename = strdup(filename);
 
-    if (_file)
-        fread(_disk_mem_copy, 1, _mem_size, _file);
+        if (!machine->disk.filename)
+            return XSM_FAILURE;
+    }
+
+    /* An overlay never writes to the base image, it need not even exist */
+    if (!filename)
+        machine->disk.fd = -1;
+    else if (overlay != XSM_DISK_OVERLAY_NONE)
+        machine->disk.fd = open(filename, O_RDONLY);
     else
+        machine->disk.fd = open(filename, O_RDWR | O_CREAT, 0666);
+
+    /* An image that can not be opened leaves a blank disk that is never written back */
+    if (machine->disk.fd < 0)
+        st.st_size = 0;
+    else if (fstat(machine->disk.fd, &st) < 0)
+        return disk_abort(machine);
+
+    /*
+    Map a full image privately, blocks are only read in when touched and
+    writes stay in memory until disk_close(machine).
+    */
+    if (st.st_size >= machine->disk.mem_size)
     {
-        /* If the file does not exist, create one */
-        _file = fopen(filename, "wb+");
-        if (!_file)
-            return XSM_FAILURE;
+        map = mmap(NULL, machine->disk.mem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, machine->disk.fd, 0);
+
+        if (map != MAP_FAILED)
+        {
+            machine->disk.mem_copy = (char *)map;
+            machine->disk.mapped = TRUE;
+            return XSM_SUCCESS;
+        }
+    }
+
+    /* A short or new image is read into memory and written back in full */
+    machine->disk.mem_copy = (char *)calloc(machine->disk.mem_size, 1);
+    machine->disk.mapped = FALSE;
+
+    if (!machine->disk.mem_copy)
+        return disk_abort(machine);
+
+    if (machine->disk.fd >= 0)
+    {
+        read_bytes = pread(machine->disk.fd, machine->disk.mem_copy, machine->disk.mem_size, 0);
+
+        if (read_bytes < 0)
+            return disk_abort(machine);
     }
 
+    for (block = 0; block < XSM_DISK_BLOCK_NUM; ++block)
+        disk_set_dirty(machine, block);
+
     return XSM_SUCCESS;
 }
 
+/* Release what disk_init() acquired before it failed */
+int disk_abort(xsm_machine *machine)
+{
+    free(machine->disk.mem_copy);
+    machine->disk.mem_copy = NULL;
+
+    if (machine->disk.fd >= 0)
+        close(machine->disk.fd);
+
+    machine->disk.fd = -1;
+
+    free(machine->disk.filename);
+    machine->disk.filename = NULL;
+
+    return XSM_FAILURE;
+}
+
+/* Change what happens to the written blocks when the disk is closed */
+void disk_set_overlay(xsm_machine *machine, int overlay)
+{
+    machine->disk.overlay = overlay;
+}
+
 /* Writes page to the given block */
-int disk_write_page(xsm_word *page, int block_num)
+int disk_write_page(xsm_machine *machine, xsm_word *page, int block_num)
 {
-    xsm_word *block = disk_get_block(block_num);
-    memcpy(block, page, XSM_PAGE_SIZE * XSM_WORD_SIZE);
+    int i;
+    char *block = disk_get_block(machine, block_num);
+
+    for (i = 0; i < XSM_PAGE_SIZE; ++i)
+        word_retrieve_raw(block + i * XSM_WORD_SIZE, &page[i]);
+
+    disk_set_dirty(machine, block_num);
     return TRUE;
 }
 
 /* Retrieve the block for the given block number */
-xsm_word *disk_get_block(int block)
+char *disk_get_block(xsm_machine *machine, int block)
 {
-    char *addr, *block_base;
     size_t offset;
 
-    addr = (char *)_disk_mem_copy;
     offset = block * XSM_DISK_BLOCK_SIZE * XSM_WORD_SIZE;
-    block_base = addr + offset;
-
-    return (xsm_word *)block_base;
+    return machine->disk.mem_copy + offset;
 }
 
 /* Writes from block to the given page */
-int disk_read_block(xsm_word *page, int block_num)
+int disk_read_block(xsm_machine *machine, xsm_word *page, int block_num)
 {
-    xsm_word *block = disk_get_block(block_num);
-    memcpy(page, block, XSM_PAGE_SIZE * XSM_WORD_SIZE);
+    int i;
+    char *block = disk_get_block(machine, block_num);
+
+    for (i = 0; i < XSM_PAGE_SIZE; ++i)
+        word_store_raw(&page[i], block + i * XSM_WORD_SIZE);
+
     return TRUE;
 }
 
+/* Mark the given block as written */
+void disk_set_dirty(xsm_machine *machine, int block)
+{
+    machine->disk.dirty[block / 8] |= 1 << (block % 8);
+}
+
+/* Checks whether the given block has been written */
+int disk_is_dirty(xsm_machine *machine, int block)
+{
+    return (machine->disk.dirty[block / 8] >> (block % 8)) & 1;
+}
+
 /* Deallocate the disk */
-int disk_close()
+int disk_close(xsm_machine *machine)
 {
-    int result;
+    int block, result;
+    size_t block_size;
+    struct stat st;
+
+    block_size = XSM_DISK_BLOCK_SIZE * XSM_WORD_SIZE;
+    result = XSM_SUCCESS;
 
-    /* Clean the disk */
-    fclose(_file);
+    /* The base image was opened read-only, reopen it to commit the overlay */
+    if (machine->disk.overlay == XSM_DISK_OVERLAY_COMMIT && machine->disk.filename)
+    {
+        if (machine->disk.fd >= 0)
+            close(machine->disk.fd);
 
-    /* Commit changes to disk */
-    _file = fopen(XSM_DEFAULT_DISK, "w");
-    result = fwrite(_disk_mem_copy, 1, _mem_size, _file);
-    fclose(_file);
+        machine->disk.fd = open(machine->disk.filename, O_RDWR | O_CREAT, 0666);
+
+        if (machine->disk.fd < 0)
+            result = XSM_FAILURE;
+    }
+
+    if (machine->disk.overlay != XSM_DISK_OVERLAY_DISCARD && machine->disk.fd >= 0)
+    {
+        /* Commit the written blocks to the image that was opened */
+        for (block = 0; block < XSM_DISK_BLOCK_NUM; ++block)
+            if (disk_is_dirty(machine, block))
+                if (pwrite(machine->disk.fd, disk_get_block(machine, block), block_size, block * block_size) != (ssize_t)block_size)
+                    result = XSM_FAILURE;
+
+        /* The image holds exactly the disk */
+        if (fstat(machine->disk.fd, &st) == 0 && st.st_size > machine->disk.mem_size)
+            if (ftruncate(machine->disk.fd, machine->disk.mem_size) < 0)
+                result = XSM_FAILURE;
+    }
+
+    if (machine->disk.mapped)
+        munmap(machine->disk.mem_copy, machine->disk.mem_size);
+    else
+        free(machine->disk.mem_copy);
+
+    machine->disk.mem_copy = NULL;
+
+    if (machine->disk.fd >= 0)
+        close(machine->disk.fd);
+
+    machine->disk.fd = -1;
+
+    free(machine->disk.filename);
+    machine->disk.filename = NULL;
 
     return result;
-}
\ No newline at end of file
+}
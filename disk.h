@@ -3,14 +3,44 @@
 #define XSM_DISK_H
 
 #include "types.h"
+#include "word.h"
 
 #define XSM_DISK_BLOCK_NUM 512
 #define XSM_DISK_BLOCK_SIZE XSM_PAGE_SIZE
 
-int disk_init(const char *filename);
-int disk_write_page(xsm_word *page, int block_num);
-xsm_word *disk_get_block(int block);
-int disk_read_block(xsm_word *page, int block_num);
-int disk_close();
+typedef struct _xsm_disk
+{
+    /* Raw disk contents, XSM_WORD_SIZE bytes per word */
+    char *mem_copy;
+
+    /* Set if the contents are a private mapping of the image file */
+    int mapped;
+
+    int fd;
+
+    /* Overlay mode and the name of the image, for committing the overlay */
+    int overlay;
+    char *filename;
+
+    int mem_size;
+
+    /* Blocks written since the image was opened, one bit per block */
+    unsigned char dirty[XSM_DISK_BLOCK_NUM / 8];
+} xsm_disk;
+
+/* What happens to the blocks written to a read-only base image */
+#define XSM_DISK_OVERLAY_NONE 0
+#define XSM_DISK_OVERLAY_DISCARD 1
+#define XSM_DISK_OVERLAY_COMMIT 2
+
+int disk_init(xsm_machine *machine, const char *filename, int overlay);
+int disk_abort(xsm_machine *machine);
+void disk_set_overlay(xsm_machine *machine, int overlay);
+int disk_write_page(xsm_machine *machine, xsm_word *page, int block_num);
+char *disk_get_block(xsm_machine *machine, int block);
+int disk_read_block(xsm_machine *machine, xsm_word *page, int block_num);
+void disk_set_dirty(xsm_machine *machine, int block);
+int disk_is_dirty(xsm_machine *machine, int block);
+int disk_close(xsm_machine *machine);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,106 @@
+/*
+The device event queue. Events fire at a given machine cycle.
+*/
+
+#include "event.h"
+
+#include "machine.h"
+
+#include <string.h>
+
+/* Initialise the event queue */
+int event_init(xsm_machine *machine)
+{
+    machine->queue.num_events = 0;
+    machine->queue.next_time = XSM_EVENT_NEVER;
+
+    return XSM_SUCCESS;
+}
+
+/* Add the given event to the queue */
+int event_schedule(xsm_machine *machine, xsm_event *event)
+{
+    if (machine->queue.num_events >= XSM_EVENT_MAX)
+        return XSM_FAILURE;
+
+    machine->queue.events[machine->queue.num_events++] = *event;
+
+    if (event->time < machine->queue.next_time)
+        machine->queue.next_time = event->time;
+
+    return XSM_SUCCESS;
+}
+
+/* Returns the cycle of the earliest event */
+long long event_next_time(xsm_machine *machine)
+{
+    return machine->queue.next_time;
+}
+
+/* Returns the due event with the highest priority */
+xsm_event *event_due(xsm_machine *machine, long long now)
+{
+    int i;
+    xsm_event *event = NULL;
+
+    if (now < machine->queue.next_time)
+        return NULL;
+
+    for (i = 0; i < machine->queue.num_events; ++i)
+    {
+        if (machine->queue.events[i].time > now)
+            continue;
+
+        if (!event || machine->queue.events[i].type < event->type)
+            event = &machine->queue.events[i];
+    }
+
+    return event;
+}
+
+/* Remove the given event from the queue */
+void event_remove(xsm_machine *machine, xsm_event *event)
+{
+    int i, index;
+
+    index = event - machine->queue.events;
+
+    if (index < 0 || index >= machine->queue.num_events)
+        return;
+
+    memmove(&machine->queue.events[index], &machine->queue.events[index + 1], sizeof(xsm_event) * (machine->queue.num_events - index - 1));
+    machine->queue.num_events--;
+
+    machine->queue.next_time = XSM_EVENT_NEVER;
+
+    for (i = 0; i < machine->queue.num_events; ++i)
+        if (machine->queue.events[i].time < machine->queue.next_time)
+            machine->queue.next_time = machine->queue.events[i].time;
+}
+
+/* Returns the number of queued events of the given type */
+int event_pending(xsm_machine *machine, int type)
+{
+    int i, count = 0;
+
+    for (i = 0; i < machine->queue.num_events; ++i)
+        if (machine->queue.events[i].type == type)
+            count++;
+
+    return count;
+}
+
+/* Returns the number of queued events */
+int event_count(xsm_machine *machine)
+{
+    return machine->queue.num_events;
+}
+
+/* Returns the queued event at the given index */
+xsm_event *event_get(xsm_machine *machine, int index)
+{
+    if (index < 0 || index >= machine->queue.num_events)
+        return NULL;
+
+    return &machine->queue.events[index];
+}
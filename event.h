@@ -0,0 +1,59 @@
+#ifndef XSM_EVENT_H
+
+#define XSM_EVENT_H
+
+#include <limits.h>
+
+#include "types.h"
+
+/* Event types, in the order of priority */
+#define XSM_EVENT_TIMER 0
+#define XSM_EVENT_DISK 1
+#define XSM_EVENT_CONSOLE 2
+#define XSM_EVENT_FORK 3
+
+#define XSM_EVENT_MAX 16
+#define XSM_EVENT_NEVER LLONG_MAX
+
+typedef struct _disk_operation
+{
+    int src_block;
+    int dest_page;
+    int operation;
+} disk_operation;
+
+typedef struct _console_operation
+{
+    xsm_word word;
+    int operation;
+} console_operation;
+
+typedef struct _xsm_event
+{
+    /* Cycle at which the event fires */
+    long long time;
+    int type;
+
+    disk_operation disk_op;
+    console_operation console_op;
+} xsm_event;
+
+typedef struct _xsm_event_queue
+{
+    xsm_event events[XSM_EVENT_MAX];
+    int num_events;
+
+    /* Cycle of the earliest event in the queue */
+    long long next_time;
+} xsm_event_queue;
+
+int event_init(xsm_machine *machine);
+int event_schedule(xsm_machine *machine, xsm_event *event);
+long long event_next_time(xsm_machine *machine);
+xsm_event *event_due(xsm_machine *machine, long long now);
+void event_remove(xsm_machine *machine, xsm_event *event);
+int event_pending(xsm_machine *machine, int type);
+int event_count(xsm_machine *machine);
+xsm_event *event_get(xsm_machine *machine, int index);
+
+#endif
@@ -4,52 +4,58 @@ An interface for handling exceptions.
 
 #include "exception.h"
 
-#include <stdio.h>
+#include "machine.h"
 
-static xsm_exception _exception;
+#include <stdio.h>
 
 /* Set the exception variables */
-int exception_set(char *message, int type, int mode)
+int exception_set(xsm_machine *machine, char *message, int type, int mode)
 {
-    _exception.message = message;
-    _exception.type = type;
-    _exception.mode = mode;
+    machine->exception.message = message;
+    machine->exception.type = type;
+    machine->exception.mode = mode;
 
     return XSM_SUCCESS;
 }
 
 /* Retrieve the exception message */
-char *exception_message()
+char *exception_message(xsm_machine *machine)
 {
-    return _exception.message;
+    return machine->exception.message;
 }
 
 /* Retrieve the exception type */
-int exception_code()
+int exception_code(xsm_machine *machine)
+{
+    return machine->exception.type;
+}
+
+/* Retrieve the mode the exception occured in */
+int exception_mode(xsm_machine *machine)
 {
-    return _exception.type;
+    return machine->exception.mode;
 }
 
 /* Set memory address */
-void exception_set_ma(int address)
+void exception_set_ma(xsm_machine *machine, int address)
 {
-    _exception.ma = address;
+    machine->exception.ma = address;
 }
 
 /* Set exception page number */
-void exception_set_epn(int page)
+void exception_set_epn(xsm_machine *machine, int page)
 {
-    _exception.epn = page;
+    machine->exception.epn = page;
 }
 
 /* Retrieve memory address */
-int exception_get_ma()
+int exception_get_ma(xsm_machine *machine)
 {
-    return _exception.ma;
+    return machine->exception.ma;
 }
 
 /* Retrieve exception page number */
-int exception_get_epn()
+int exception_get_epn(xsm_machine *machine)
 {
-    return _exception.epn;
+    return machine->exception.epn;
 }
\ No newline at end of file
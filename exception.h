@@ -18,12 +18,13 @@ typedef struct _xsm_exception
     int epn;
 } xsm_exception;
 
-int exception_set(char *message, int type, int mode);
-char *exception_message();
-int exception_code();
-void exception_set_ma(int address);
-void exception_set_epn(int page);
-int exception_get_ma();
-int exception_get_epn();
+int exception_set(xsm_machine *machine, char *message, int type, int mode);
+char *exception_message(xsm_machine *machine);
+int exception_code(xsm_machine *machine);
+int exception_mode(xsm_machine *machine);
+void exception_set_ma(xsm_machine *machine, int address);
+void exception_set_epn(xsm_machine *machine, int page);
+int exception_get_ma(xsm_machine *machine);
+int exception_get_epn(xsm_machine *machine);
 
 #endif
\ No newline at end of file
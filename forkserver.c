@@ -0,0 +1,99 @@
+/*
+The fork server. Once the machine has booted to the designated point it
+stops and serves run requests read from stdin, one per line:
+
+    <input file> <output file> [<error file>]
+
+Every request is run by a forked copy of the booted machine, with console
+input read from the input file and console output written to the output
+file. Errors go to the error file if given, else to the output file. The
+exit status of the run is written to stdout when it finishes.
+*/
+
+#include "forkserver.h"
+
+#include "disk.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Serve run requests, returns in every child and exits at the end of the requests */
+void forkserver_serve(xsm_machine *machine)
+{
+    char line[3 * FORKSERVER_PATH_LEN];
+    char input[FORKSERVER_PATH_LEN], output[FORKSERVER_PATH_LEN], errors[FORKSERVER_PATH_LEN];
+    int fields, status;
+    pid_t pid;
+
+    /* Every run starts from the disk as it is now */
+    disk_set_overlay(machine, XSM_DISK_OVERLAY_DISCARD);
+
+    printf("ready\n");
+    fflush(stdout);
+
+    while (fgets(line, sizeof(line), stdin))
+    {
+        fields = sscanf(line, "%1023s %1023s %1023s", input, output, errors);
+
+        if (fields < 2)
+        {
+            printf("error\n");
+            fflush(stdout);
+            continue;
+        }
+
+        fflush(stdout);
+        fflush(stderr);
+
+        pid = fork();
+
+        if (pid == 0)
+        {
+            if (!forkserver_start_child(input, output, fields == 3 ? errors : NULL))
+                _exit(EXIT_FAILURE);
+
+            return;
+        }
+
+        if (pid < 0 || waitpid(pid, &status, 0) < 0)
+            printf("error\n");
+        else if (WIFEXITED(status))
+            printf("%d\n", WEXITSTATUS(status));
+        else
+            printf("%d\n", 128 + WTERMSIG(status));
+
+        fflush(stdout);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+/* Point the console of a forked machine at the files of its request */
+int forkserver_start_child(const char *input, const char *output, const char *errors)
+{
+    if (!freopen(input, "r", stdin))
+        return XSM_FAILURE;
+
+    if (!freopen(output, "w", stdout))
+        return XSM_FAILURE;
+
+    if (errors)
+    {
+        if (!freopen(errors, "w", stderr))
+            return XSM_FAILURE;
+
+        return XSM_SUCCESS;
+    }
+
+    /* Keep the order of output and errors as on a terminal */
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    if (dup2(fileno(stdout), fileno(stderr)) < 0)
+        return XSM_FAILURE;
+
+    return XSM_SUCCESS;
+}
@@ -0,0 +1,13 @@
+#ifndef XSM_FORKSERVER_H
+
+#define XSM_FORKSERVER_H
+
+#include "types.h"
+
+/* Longest file name in a run request */
+#define FORKSERVER_PATH_LEN 1024
+
+void forkserver_serve(xsm_machine *machine);
+int forkserver_start_child(const char *input, const char *output, const char *errors);
+
+#endif
@@ -0,0 +1,438 @@
+/*
+Execution history of the debugger, to step back with. Every HISTORY_INTERVAL
+instructions a checkpoint keeps the CPU, the pending device operations and
+the memory pages and disk blocks written since the checkpoint before.
+Stepping back restores the nearest checkpoint before the instruction asked
+for and runs forward from it. The device clock times everything else the
+machine does, so the run repeats itself as long as the console words read
+are fed in again, they are kept here as well.
+*/
+
+#include "history.h"
+
+#include "machine.h"
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Initialise the history, the first checkpoint is taken at the first instruction */
+int history_init(xsm_machine *machine)
+{
+    xsm_history *history = &machine->history;
+
+    memset(history, 0, sizeof(xsm_history));
+
+    history->checkpoints = (history_checkpoint *)malloc(HISTORY_MAX_CHECKPOINTS * sizeof(history_checkpoint));
+
+    if (!history->checkpoints)
+        return XSM_FAILURE;
+
+    return XSM_SUCCESS;
+}
+
+/* Take a checkpoint before the next instruction if one is due */
+void history_step(xsm_machine *machine)
+{
+    xsm_history *history = &machine->history;
+    int last = history->num_checkpoints - 1;
+
+    if (last < 0 || history->count - history->checkpoints[last].count >= HISTORY_INTERVAL)
+        history_save(machine);
+}
+
+/* Keep the state of the machine before the next instruction */
+int history_save(xsm_machine *machine)
+{
+    xsm_history *history = &machine->history;
+    history_checkpoint *checkpoint;
+    history_copy *pages, *blocks, *copy;
+    size_t page_size, block_size;
+    int i;
+
+    page_size = XSM_PAGE_SIZE * sizeof(xsm_word);
+    block_size = XSM_DISK_BLOCK_SIZE * XSM_WORD_SIZE;
+    pages = NULL;
+    blocks = NULL;
+
+    if (history->num_checkpoints == 0)
+    {
+        history->memory = (xsm_word *)malloc(XSM_MEMORY_NUMPAGES * page_size);
+
+        if (!history->memory)
+            return XSM_FAILURE;
+
+        memcpy(history->memory, memory_get_page(machine, 0), XSM_MEMORY_NUMPAGES * page_size);
+    }
+    else
+    {
+        /* What can not be kept is kept at the next checkpoint instead */
+        for (i = 0; i < XSM_MEMORY_NUMPAGES; ++i)
+            if ((history->dirty_pages[i / 8] >> (i % 8)) & 1)
+            {
+                copy = history_copy_new(i, memory_get_page(machine, i), page_size, pages);
+
+                if (!copy)
+                {
+                    history_copy_free(pages);
+                    return XSM_FAILURE;
+                }
+
+                pages = copy;
+            }
+
+        for (i = 0; i < XSM_DISK_BLOCK_NUM; ++i)
+            if ((history->dirty_blocks[i / 8] >> (i % 8)) & 1)
+            {
+                copy = history_copy_new(i, disk_get_block(machine, i), block_size, blocks);
+
+                if (!copy)
+                {
+                    history_copy_free(pages);
+                    history_copy_free(blocks);
+                    return XSM_FAILURE;
+                }
+
+                blocks = copy;
+            }
+    }
+
+    if (history->num_checkpoints == HISTORY_MAX_CHECKPOINTS)
+        history_merge(machine);
+
+    checkpoint = &history->checkpoints[history->num_checkpoints++];
+
+    checkpoint->count = history->count;
+    checkpoint->input = history->next_input;
+
+    checkpoint->mode = machine_get_mode(machine);
+    checkpoint->cycles = machine_get_cycles(machine);
+    memcpy(checkpoint->regs, machine->cpu.regs, sizeof(checkpoint->regs));
+
+    checkpoint->exception = machine->exception;
+    checkpoint->queue = machine->queue;
+
+    checkpoint->debug_ip = machine->debug.ip;
+    checkpoint->debug_mode = machine->debug.prev_mode;
+
+    checkpoint->pages = pages;
+    checkpoint->blocks = blocks;
+
+    memset(history->dirty_pages, 0, sizeof(history->dirty_pages));
+    memset(history->dirty_blocks, 0, sizeof(history->dirty_blocks));
+
+    return XSM_SUCCESS;
+}
+
+/* Fold the second checkpoint into the first to make room for another */
+void history_merge(xsm_machine *machine)
+{
+    xsm_history *history = &machine->history;
+    history_checkpoint *second = &history->checkpoints[1];
+    history_copy *copy;
+
+    for (copy = second->pages; copy; copy = copy->next)
+        memcpy(history->memory + copy->index * XSM_PAGE_SIZE, copy->data, XSM_PAGE_SIZE * sizeof(xsm_word));
+
+    /* The block copies become the ones of the first checkpoint */
+    for (copy = second->blocks; copy; copy = copy->next)
+    {
+        free(history->blocks[copy->index]);
+        history->blocks[copy->index] = (char *)copy->data;
+        copy->data = NULL;
+    }
+
+    history_copy_free(second->pages);
+    history_copy_free(second->blocks);
+
+    second->pages = NULL;
+    second->blocks = NULL;
+    history->checkpoints[0] = *second;
+
+    memmove(second, second + 1, (history->num_checkpoints - 2) * sizeof(history_checkpoint));
+    history->num_checkpoints--;
+}
+
+/* Copy a page or a block in front of the given list */
+history_copy *history_copy_new(int index, const void *data, size_t size, history_copy *next)
+{
+    history_copy *copy;
+
+    copy = (history_copy *)malloc(sizeof(history_copy));
+
+    if (!copy)
+        return NULL;
+
+    copy->data = malloc(size);
+
+    if (!copy->data)
+    {
+        free(copy);
+        return NULL;
+    }
+
+    memcpy(copy->data, data, size);
+    copy->index = index;
+    copy->next = next;
+
+    return copy;
+}
+
+/* Deallocate a list of copies */
+void history_copy_free(history_copy *copy)
+{
+    history_copy *next;
+
+    while (copy)
+    {
+        next = copy->next;
+        free(copy->data);
+        free(copy);
+        copy = next;
+    }
+}
+
+/* A word of memory has been written */
+void history_write(xsm_machine *machine, int address)
+{
+    history_page_write(machine, address / XSM_PAGE_SIZE);
+}
+
+/* A page of memory has been written */
+void history_page_write(xsm_machine *machine, int page)
+{
+    machine->history.dirty_pages[page / 8] |= 1 << (page % 8);
+}
+
+/* A disk block is about to be written, the first checkpoint keeps it as it was */
+void history_block_write(xsm_machine *machine, int block)
+{
+    xsm_history *history = &machine->history;
+    size_t block_size = XSM_DISK_BLOCK_SIZE * XSM_WORD_SIZE;
+
+    if (!history->blocks[block])
+    {
+        history->blocks[block] = (char *)malloc(block_size);
+
+        if (history->blocks[block])
+            memcpy(history->blocks[block], disk_get_block(machine, block), block_size);
+    }
+
+    history->dirty_blocks[block / 8] |= 1 << (block % 8);
+}
+
+/* Give the console word read here before stepping back, returns FALSE if it is yet to be read */
+int history_read_input(xsm_machine *machine, char *input, int *ok)
+{
+    xsm_history *history = &machine->history;
+    history_input *entry;
+
+    if (history->next_input >= history->num_inputs)
+        return FALSE;
+
+    entry = &history->inputs[history->next_input++];
+
+    strcpy(input, entry->text);
+    *ok = entry->ok;
+
+    return TRUE;
+}
+
+/* Keep a console word read for the first time */
+void history_record_input(xsm_machine *machine, const char *input, int ok)
+{
+    xsm_history *history = &machine->history;
+    history_input *inputs;
+    int size;
+
+    if (history->num_inputs == history->max_inputs)
+    {
+        size = history->max_inputs ? 2 * history->max_inputs : HISTORY_INPUTS;
+        inputs = (history_input *)realloc(history->inputs, size * sizeof(history_input));
+
+        /* The input can not be read again, stepping back past it replays another run */
+        if (!inputs)
+            return;
+
+        history->inputs = inputs;
+        history->max_inputs = size;
+    }
+
+    strncpy(history->inputs[history->num_inputs].text, input, XSM_WORD_SIZE - 1);
+    history->inputs[history->num_inputs].text[XSM_WORD_SIZE - 1] = '\0';
+    history->inputs[history->num_inputs].ok = ok;
+
+    history->num_inputs++;
+    history->next_input = history->num_inputs;
+}
+
+/* Move the machine back by the given number of instructions, returns the number moved or -1 */
+long long history_back(xsm_machine *machine, long long num)
+{
+    xsm_history *history = &machine->history;
+    long long target, count;
+    int index;
+
+    if (history->num_checkpoints == 0 || num <= 0)
+        return 0;
+
+    count = history->count;
+    target = count - num;
+
+    if (target < history->checkpoints[0].count)
+        target = history->checkpoints[0].count;
+
+    for (index = history->num_checkpoints - 1; index > 0; --index)
+        if (history->checkpoints[index].count <= target)
+            break;
+
+    history_restore(machine, index);
+
+    if (!history_forward(machine, target))
+        return -1;
+
+    /* Where the machine now stands, what the instruction before it accessed is not news */
+    machine->debug.wp_hit = DEBUG_ERROR;
+    machine->debug.prev_ip = machine->debug.ip;
+    machine->debug.ip = word_get_integer(machine_get_ipreg(machine));
+    history->rewound = TRUE;
+
+    return count - target;
+}
+
+/* Put the machine back to the given checkpoint, the ones after it are dropped */
+void history_restore(xsm_machine *machine, int index)
+{
+    xsm_history *history = &machine->history;
+    history_checkpoint *checkpoint = &history->checkpoints[index];
+    unsigned char pages[sizeof(history->dirty_pages)], blocks[sizeof(history->dirty_blocks)];
+    history_copy *copy;
+    const void *data;
+    int i;
+
+    /* Everything written since the checkpoint */
+    memcpy(pages, history->dirty_pages, sizeof(pages));
+    memcpy(blocks, history->dirty_blocks, sizeof(blocks));
+
+    for (i = index + 1; i < history->num_checkpoints; ++i)
+    {
+        for (copy = history->checkpoints[i].pages; copy; copy = copy->next)
+            pages[copy->index / 8] |= 1 << (copy->index % 8);
+
+        for (copy = history->checkpoints[i].blocks; copy; copy = copy->next)
+            blocks[copy->index / 8] |= 1 << (copy->index % 8);
+    }
+
+    for (i = 0; i < XSM_MEMORY_NUMPAGES; ++i)
+        if ((pages[i / 8] >> (i % 8)) & 1)
+        {
+            memcpy(memory_get_page(machine, i), history_find(history, i, FALSE, index), XSM_PAGE_SIZE * sizeof(xsm_word));
+            decode_invalidate_page(machine, i);
+        }
+
+    /* A block not kept before it was first written can not be put back */
+    for (i = 0; i < XSM_DISK_BLOCK_NUM; ++i)
+        if ((blocks[i / 8] >> (i % 8)) & 1)
+        {
+            data = history_find(history, i, TRUE, index);
+
+            if (data)
+                memcpy(disk_get_block(machine, i), data, XSM_DISK_BLOCK_SIZE * XSM_WORD_SIZE);
+        }
+
+    for (i = index + 1; i < history->num_checkpoints; ++i)
+    {
+        history_copy_free(history->checkpoints[i].pages);
+        history_copy_free(history->checkpoints[i].blocks);
+    }
+
+    history->num_checkpoints = index + 1;
+    memset(history->dirty_pages, 0, sizeof(history->dirty_pages));
+    memset(history->dirty_blocks, 0, sizeof(history->dirty_blocks));
+
+    history->count = checkpoint->count;
+    history->next_input = checkpoint->input;
+
+    machine_set_mode(machine, checkpoint->mode);
+    machine_set_cycles(machine, checkpoint->cycles);
+    memcpy(machine->cpu.regs, checkpoint->regs, sizeof(checkpoint->regs));
+
+    machine->exception = checkpoint->exception;
+    machine->queue = checkpoint->queue;
+
+    machine->debug.ip = checkpoint->debug_ip;
+    machine->debug.prev_mode = checkpoint->debug_mode;
+
+    /* Nothing cached from the later state is valid any more */
+    memory_tlb_flush(machine);
+    machine_idle_reset(machine);
+}
+
+/* Find a page or block as it was at the given checkpoint */
+const void *history_find(xsm_history *history, int index, int block, int checkpoint)
+{
+    history_copy *copy;
+    int i;
+
+    for (i = checkpoint; i > 0; --i)
+    {
+        copy = block ? history->checkpoints[i].blocks : history->checkpoints[i].pages;
+
+        for (; copy; copy = copy->next)
+            if (copy->index == index)
+                return copy->data;
+    }
+
+    if (block)
+        return history->blocks[index];
+
+    return history->memory + index * XSM_PAGE_SIZE;
+}
+
+/* Run forward to the given instruction without stopping, returns FALSE if the machine stopped on the way */
+int history_forward(xsm_machine *machine, long long target)
+{
+    xsm_history *history = &machine->history;
+    jmp_buf outer;
+
+    /* Kept in memory, an exception unwinds back here part way */
+    volatile int ok;
+
+    /* Exceptions on the way unwind to here, not to where the machine was stopped */
+    memcpy(outer, machine->cpu.h_exp_point, sizeof(jmp_buf));
+    history->replaying = TRUE;
+    ok = TRUE;
+
+    if (setjmp(machine->cpu.h_exp_point) == XSM_EXCEPTION_OCCURED)
+        if (XSM_SUCCESS != machine_handle_exception(machine))
+            ok = FALSE;
+
+    while (ok && history->count < target)
+        if (machine_step(machine) == XSM_HALT)
+            ok = FALSE;
+
+    history->replaying = FALSE;
+    memcpy(machine->cpu.h_exp_point, outer, sizeof(jmp_buf));
+
+    return ok;
+}
+
+/* Deallocate the history */
+void history_destroy(xsm_machine *machine)
+{
+    xsm_history *history = &machine->history;
+    int i;
+
+    for (i = 0; i < history->num_checkpoints; ++i)
+    {
+        history_copy_free(history->checkpoints[i].pages);
+        history_copy_free(history->checkpoints[i].blocks);
+    }
+
+    for (i = 0; i < XSM_DISK_BLOCK_NUM; ++i)
+        free(history->blocks[i]);
+
+    free(history->checkpoints);
+    free(history->memory);
+    free(history->inputs);
+}
@@ -0,0 +1,103 @@
+#ifndef XSM_HISTORY_H
+
+#define XSM_HISTORY_H
+
+#include <stddef.h>
+
+#include "disk.h"
+#include "event.h"
+#include "exception.h"
+#include "types.h"
+
+/* Instructions run between two checkpoints */
+#define HISTORY_INTERVAL 10000
+
+/* Checkpoints kept, the oldest ones are merged into the first when full */
+#define HISTORY_MAX_CHECKPOINTS 4096
+
+/* Initial number of console words kept */
+#define HISTORY_INPUTS 64
+
+/* A memory page or disk block as it was at a checkpoint */
+typedef struct _history_copy
+{
+    int index;
+    void *data;
+    struct _history_copy *next;
+} history_copy;
+
+typedef struct _history_checkpoint
+{
+    /* Instructions begun, and console words read, before it */
+    long long count;
+    int input;
+
+    /* The CPU */
+    int mode;
+    long long cycles;
+    xsm_word regs[XSM_NUM_REG];
+
+    xsm_exception exception;
+    xsm_event_queue queue;
+
+    /* Where the debugger was */
+    int debug_ip, debug_mode;
+
+    /* Pages and blocks written since the checkpoint before */
+    history_copy *pages, *blocks;
+} history_checkpoint;
+
+/* A word read from the console */
+typedef struct _history_input
+{
+    char text[XSM_WORD_SIZE];
+    int ok;
+} history_input;
+
+typedef struct _xsm_history
+{
+    /* Instructions begun so far */
+    long long count;
+
+    /*
+    The first checkpoint holds the whole memory, and every disk block as it
+    was before it was first written. The others only hold what changed.
+    */
+    history_checkpoint *checkpoints;
+    int num_checkpoints;
+    xsm_word *memory;
+    char *blocks[XSM_DISK_BLOCK_NUM];
+
+    /* Written since the last checkpoint */
+    unsigned char dirty_pages[XSM_MEMORY_NUMPAGES / 8];
+    unsigned char dirty_blocks[XSM_DISK_BLOCK_NUM / 8];
+
+    /* Console input, read again when the same instructions run again */
+    history_input *inputs;
+    int num_inputs, max_inputs, next_input;
+
+    /* Set while running forward to the instruction stepped back to */
+    int replaying;
+
+    /* Set when the machine was moved back at a prompt of the debugger */
+    int rewound;
+} xsm_history;
+
+int history_init(xsm_machine *machine);
+void history_step(xsm_machine *machine);
+int history_save(xsm_machine *machine);
+void history_merge(xsm_machine *machine);
+history_copy *history_copy_new(int index, const void *data, size_t size, history_copy *next);
+void history_copy_free(history_copy *copy);
+void history_write(xsm_machine *machine, int address);
+void history_page_write(xsm_machine *machine, int page);
+void history_block_write(xsm_machine *machine, int block);
+int history_read_input(xsm_machine *machine, char *input, int *ok);
+void history_record_input(xsm_machine *machine, const char *input, int ok);
+long long history_back(xsm_machine *machine, long long num);
+void history_restore(xsm_machine *machine, int index);
+const void *history_find(xsm_history *history, int index, int block, int checkpoint);
+int history_forward(xsm_machine *machine, long long target);
+void history_destroy(xsm_machine *machine);
+
+#endif
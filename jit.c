@@ -0,0 +1,737 @@
+/*
+Basic block translator. Hot straight-line runs of decoded instructions are
+translated to x86-64 code that keeps the simple instructions inline and calls
+back into the interpreter for the rest.
+*/
+
+#include "jit.h"
+
+#include "event.h"
+#include "machine.h"
+#include "registers.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+/* Initialise the translator */
+int jit_init(xsm_machine *machine)
+{
+#if defined(__x86_64__)
+    void *code;
+
+    code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (code == MAP_FAILED)
+        return XSM_FAILURE;
+
+    machine->jit.code = (unsigned char *)code;
+    machine->jit.blocks = (jit_block *)calloc(JIT_MAX_BLOCKS, sizeof(jit_block));
+
+    if (!machine->jit.blocks)
+    {
+        munmap(machine->jit.code, JIT_CODE_SIZE);
+        machine->jit.code = NULL;
+        return XSM_FAILURE;
+    }
+
+    memset(machine->jit.table, 0, sizeof(machine->jit.table));
+    jit_flush(machine);
+
+    return XSM_SUCCESS;
+#else
+    /* There is no code generator for this architecture */
+    return XSM_FAILURE;
+#endif
+}
+
+/* Returns the table slot of the given physical address */
+jit_entry *jit_entry_of(xsm_machine *machine, int address, int mode)
+{
+    int page = address / XSM_PAGE_SIZE;
+
+    if (!machine->jit.table[mode][page])
+    {
+        machine->jit.table[mode][page] = (jit_entry *)calloc(XSM_PAGE_SIZE, sizeof(jit_entry));
+
+        if (!machine->jit.table[mode][page])
+            return NULL;
+    }
+
+    return &machine->jit.table[mode][page][address % XSM_PAGE_SIZE];
+}
+
+/* Returns the block at the given address, translating it once it is hot */
+jit_block *jit_lookup(xsm_machine *machine, int logical, int address, int mode)
+{
+    jit_entry *entry;
+
+    if (address < 0 || address >= XSM_PAGE_SIZE * XSM_MEMORY_NUMPAGES)
+        return NULL;
+
+    entry = jit_entry_of(machine, address, mode);
+
+    if (!entry)
+        return NULL;
+
+    if (entry->block && entry->block->valid && entry->block->logical == logical)
+        return entry->block;
+
+    if (++entry->count < JIT_THRESHOLD)
+        return NULL;
+
+    /* The page is mapped at another logical address, the old block is of no use */
+    if (entry->block)
+        entry->block->valid = FALSE;
+
+    entry->count = 0;
+    entry->block = jit_translate(machine, logical, address, mode);
+
+    return entry->block;
+}
+
+/* Returns the block already translated for the given address */
+jit_block *jit_find(xsm_machine *machine, int logical, int address, int mode)
+{
+    jit_entry *entry;
+
+    if (address < 0 || address >= XSM_PAGE_SIZE * XSM_MEMORY_NUMPAGES)
+        return NULL;
+
+    if (!machine->jit.table[mode][address / XSM_PAGE_SIZE])
+        return NULL;
+
+    entry = &machine->jit.table[mode][address / XSM_PAGE_SIZE][address % XSM_PAGE_SIZE];
+
+    if (entry->block && entry->block->valid && entry->block->logical == logical)
+        return entry->block;
+
+    return NULL;
+}
+
+#if defined(__x86_64__)
+
+/* Execute an instruction the translated code does not handle inline */
+int jit_run_instruction(xsm_machine *machine, xsm_instruction *instr)
+{
+    if (machine_execute_instruction(machine, instr) == XSM_HALT)
+        return JIT_HALT;
+
+    return machine->jit.exit;
+}
+
+/* Find the block to continue with at the end of the given block */
+unsigned char *jit_chain(xsm_machine *machine, jit_block *block)
+{
+    int ip, i;
+    jit_block *target;
+    jit_link *link;
+
+    if (machine_get_mode(machine) != block->mode)
+        return NULL;
+
+    ip = word_get_integer(machine_get_ipreg(machine));
+    target = NULL;
+
+    for (i = 0; i < JIT_MAX_LINKS; ++i)
+    {
+        link = &block->links[i];
+
+        if (link->ip == ip && link->target && link->target->valid && link->target->logical == ip)
+        {
+            target = link->target;
+            break;
+        }
+    }
+
+    if (!target)
+    {
+        /* Kernel addresses are physical, user blocks only chain within their page */
+        if (block->mode == PRIVILEGE_KERNEL)
+            target = jit_find(machine, ip, ip, block->mode);
+        else if (ip >= 0 && ip / XSM_PAGE_SIZE == block->logical / XSM_PAGE_SIZE)
+            target = jit_find(machine, ip, block->address - block->logical % XSM_PAGE_SIZE + ip % XSM_PAGE_SIZE, block->mode);
+
+        if (!target)
+            return NULL;
+
+        link = &block->links[block->next_link];
+        block->next_link = (block->next_link + 1) % JIT_MAX_LINKS;
+        link->ip = ip;
+        link->target = target;
+    }
+
+    /* Device events must not become due inside the next block */
+    if (block->mode == PRIVILEGE_USER)
+    {
+        if (machine->cpu.cycles + target->length >= event_next_time(machine))
+            return NULL;
+
+        machine->cpu.cycles++;
+    }
+
+    return target->body;
+}
+
+/* Emit a byte of code */
+void jit_emit_byte(xsm_machine *machine, int byte)
+{
+    *machine->jit.code_ptr++ = (unsigned char)byte;
+}
+
+/* Emit a 32 bit immediate */
+void jit_emit_int32(xsm_machine *machine, int value)
+{
+    memcpy(machine->jit.code_ptr, &value, sizeof(value));
+    machine->jit.code_ptr += sizeof(value);
+}
+
+/* Emit a 64 bit immediate */
+void jit_emit_ptr(xsm_machine *machine, const void *ptr)
+{
+    memcpy(machine->jit.code_ptr, &ptr, sizeof(ptr));
+    machine->jit.code_ptr += sizeof(ptr);
+}
+
+/* Emit an opcode addressing [rbx + disp32] */
+void jit_emit_rbx(xsm_machine *machine, int opcode, int reg, int disp)
+{
+    jit_emit_byte(machine, opcode);
+    jit_emit_byte(machine, 0x80 | (reg << 3) | 3);
+    jit_emit_int32(machine, disp);
+}
+
+/* Offset of the integer of a register from the register file */
+int jit_reg_integer(int code)
+{
+    return code * sizeof(xsm_word) + offsetof(xsm_word, integer);
+}
+
+/* Offset of the tag of a register from the register file */
+int jit_reg_tag(int code)
+{
+    return code * sizeof(xsm_word) + offsetof(xsm_word, tag);
+}
+
+/* Emit a conditional jump with a 32 bit displacement, returns its location */
+unsigned char *jit_emit_jcc(xsm_machine *machine, int cc)
+{
+    jit_emit_byte(machine, 0x0F);
+    jit_emit_byte(machine, 0x80 | cc);
+    jit_emit_int32(machine, 0);
+    return machine->jit.code_ptr;
+}
+
+/* Emit a jump with a 32 bit displacement, returns its location */
+unsigned char *jit_emit_jmp(xsm_machine *machine)
+{
+    jit_emit_byte(machine, 0xE9);
+    jit_emit_int32(machine, 0);
+    return machine->jit.code_ptr;
+}
+
+/* Point the jump ending at the given location to the target */
+void jit_patch(unsigned char *jump, unsigned char *target)
+{
+    int disp = (int)(target - jump);
+    memcpy(jump - sizeof(disp), &disp, sizeof(disp));
+}
+
+/* Emit register = integer value */
+void jit_emit_store_integer(xsm_machine *machine, int code, int value)
+{
+    jit_emit_rbx(machine, 0xC7, 0, jit_reg_integer(code));
+    jit_emit_int32(machine, value);
+    jit_emit_rbx(machine, 0xC7, 0, jit_reg_tag(code));
+    jit_emit_int32(machine, XSM_WORD_INTEGER);
+}
+
+/* Emit a jump to the slow path unless the register holds an integer */
+unsigned char *jit_emit_check_integer(xsm_machine *machine, int code)
+{
+    jit_emit_rbx(machine, 0x83, 7, jit_reg_tag(code));
+    jit_emit_byte(machine, XSM_WORD_NUMERIC);
+    return jit_emit_jcc(machine, 0x2); /* jb */
+}
+
+/* Emit a call to the interpreter for the instruction at ip */
+void jit_emit_call(xsm_machine *machine, xsm_instruction *instr, int ip)
+{
+    jit_emit_store_integer(machine, IP, ip + XSM_INSTRUCTION_SIZE);
+
+    jit_emit_byte(machine, 0x48); /* mov rdi, machine */
+    jit_emit_byte(machine, 0xBF);
+    jit_emit_ptr(machine, machine);
+    jit_emit_byte(machine, 0x48); /* mov rsi, instr */
+    jit_emit_byte(machine, 0xBE);
+    jit_emit_ptr(machine, instr);
+    jit_emit_byte(machine, 0x48); /* mov rax, jit_run_instruction */
+    jit_emit_byte(machine, 0xB8);
+    jit_emit_ptr(machine, (void *)jit_run_instruction);
+    jit_emit_byte(machine, 0xFF); /* call rax */
+    jit_emit_byte(machine, 0xD0);
+    jit_emit_byte(machine, 0x85); /* test eax, eax */
+    jit_emit_byte(machine, 0xC0);
+
+    machine->jit.exits[machine->jit.num_exits++] = jit_emit_jcc(machine, 0x5); /* jnz */
+}
+
+/* Checks whether the operand is a register the instruction may use directly */
+int jit_register_ok(xsm_machine *machine, xsm_operand *operand, int mode)
+{
+    if (operand->type != XSM_OPERAND_REGISTER)
+        return FALSE;
+
+    if (!registers_get_register_by_code(machine, operand->val) || operand->val == IP)
+        return FALSE;
+
+    if (mode == PRIVILEGE_USER && !registers_umode_by_code(machine, operand->val))
+        return FALSE;
+
+    return TRUE;
+}
+
+/* Emit the instruction inline, returns FALSE if the interpreter has to run it */
+int jit_emit_inline(xsm_machine *machine, xsm_instruction *instr, int ip, int mode)
+{
+    int left, right, cc;
+    unsigned char *slow[2], *done, *skip;
+    xsm_operand *l_op, *r_op;
+
+    l_op = &instr->operands[0];
+    r_op = &instr->operands[1];
+    left = l_op->val;
+    right = r_op->val;
+    slow[0] = slow[1] = NULL;
+
+    switch (instr->opcode)
+    {
+    case MOV:
+    case PORT:
+        if (!jit_register_ok(machine, l_op, mode))
+            return FALSE;
+
+        if (r_op->type == XSM_OPERAND_NUMBER)
+        {
+            jit_emit_store_integer(machine, left, right);
+            return TRUE;
+        }
+
+        if (!jit_register_ok(machine, r_op, mode))
+            return FALSE;
+
+        /* Copy the whole word */
+        jit_emit_byte(machine, 0x0F); /* movups xmm0, [right] */
+        jit_emit_rbx(machine, 0x10, 0, right * sizeof(xsm_word));
+        jit_emit_byte(machine, 0x0F); /* movups [left], xmm0 */
+        jit_emit_rbx(machine, 0x11, 0, left * sizeof(xsm_word));
+        jit_emit_byte(machine, 0x48); /* mov rax, [right + 16] */
+        jit_emit_rbx(machine, 0x8B, 0, right * sizeof(xsm_word) + 16);
+        jit_emit_byte(machine, 0x48); /* mov [left + 16], rax */
+        jit_emit_rbx(machine, 0x89, 0, left * sizeof(xsm_word) + 16);
+        return TRUE;
+
+    case ADD:
+    case SUB:
+    case MUL:
+        if (!jit_register_ok(machine, l_op, mode))
+            return FALSE;
+
+        if (r_op->type != XSM_OPERAND_NUMBER && !jit_register_ok(machine, r_op, mode))
+            return FALSE;
+
+        slow[0] = jit_emit_check_integer(machine, left);
+        jit_emit_rbx(machine, 0x8B, 0, jit_reg_integer(left)); /* mov eax, [left] */
+
+        if (r_op->type == XSM_OPERAND_NUMBER)
+        {
+            if (instr->opcode == MUL)
+            {
+                jit_emit_byte(machine, 0x69); /* imul eax, eax, imm32 */
+                jit_emit_byte(machine, 0xC0);
+            }
+            else
+                jit_emit_byte(machine, instr->opcode == ADD ? 0x05 : 0x2D); /* add/sub eax, imm32 */
+
+            jit_emit_int32(machine, right);
+        }
+        else
+        {
+            slow[1] = jit_emit_check_integer(machine, right);
+            jit_emit_rbx(machine, 0x8B, 1, jit_reg_integer(right)); /* mov ecx, [right] */
+
+            if (instr->opcode == MUL)
+            {
+                jit_emit_byte(machine, 0x0F); /* imul eax, ecx */
+                jit_emit_byte(machine, 0xAF);
+                jit_emit_byte(machine, 0xC1);
+            }
+            else
+            {
+                jit_emit_byte(machine, instr->opcode == ADD ? 0x01 : 0x29); /* add/sub eax, ecx */
+                jit_emit_byte(machine, 0xC8);
+            }
+        }
+
+        jit_emit_rbx(machine, 0x89, 0, jit_reg_integer(left)); /* mov [left], eax */
+        jit_emit_rbx(machine, 0xC7, 0, jit_reg_tag(left));
+        jit_emit_int32(machine, XSM_WORD_INTEGER);
+        break;
+
+    case INR:
+    case DCR:
+        if (!jit_register_ok(machine, l_op, mode))
+            return FALSE;
+
+        slow[0] = jit_emit_check_integer(machine, left);
+        jit_emit_rbx(machine, 0x83, instr->opcode == INR ? 0 : 5, jit_reg_integer(left)); /* add/sub [left], 1 */
+        jit_emit_byte(machine, 1);
+        jit_emit_rbx(machine, 0xC7, 0, jit_reg_tag(left));
+        jit_emit_int32(machine, XSM_WORD_INTEGER);
+        break;
+
+    case LT:
+    case GT:
+    case EQ:
+    case NE:
+    case GE:
+    case LE:
+        if (!jit_register_ok(machine, l_op, mode) || !jit_register_ok(machine, r_op, mode))
+            return FALSE;
+
+        switch (instr->opcode)
+        {
+        case LT:
+            cc = 0xC;
+            break;
+        case GT:
+            cc = 0xF;
+            break;
+        case EQ:
+            cc = 0x4;
+            break;
+        case NE:
+            cc = 0x5;
+            break;
+        case GE:
+            cc = 0xD;
+            break;
+        default:
+            cc = 0xE;
+            break;
+        }
+
+        slow[0] = jit_emit_check_integer(machine, left);
+        slow[1] = jit_emit_check_integer(machine, right);
+        jit_emit_rbx(machine, 0x8B, 0, jit_reg_integer(left)); /* mov eax, [left] */
+        jit_emit_rbx(machine, 0x3B, 0, jit_reg_integer(right)); /* cmp eax, [right] */
+        jit_emit_byte(machine, 0x0F); /* setcc al */
+        jit_emit_byte(machine, 0x90 | cc);
+        jit_emit_byte(machine, 0xC0);
+        jit_emit_byte(machine, 0x0F); /* movzx eax, al */
+        jit_emit_byte(machine, 0xB6);
+        jit_emit_byte(machine, 0xC0);
+        jit_emit_rbx(machine, 0x89, 0, jit_reg_integer(left)); /* mov [left], eax */
+        jit_emit_rbx(machine, 0xC7, 0, jit_reg_tag(left));
+        jit_emit_int32(machine, XSM_WORD_INTEGER);
+        break;
+
+    case JMP:
+        if (l_op->type != XSM_OPERAND_NUMBER)
+            return FALSE;
+
+        jit_emit_store_integer(machine, IP, left);
+        return TRUE;
+
+    case JZ:
+    case JNZ:
+        if (!jit_register_ok(machine, l_op, mode) || r_op->type != XSM_OPERAND_NUMBER)
+            return FALSE;
+
+        jit_emit_store_integer(machine, IP, ip + XSM_INSTRUCTION_SIZE);
+        slow[0] = jit_emit_check_integer(machine, left);
+        jit_emit_rbx(machine, 0x83, 7, jit_reg_integer(left)); /* cmp [left], 0 */
+        jit_emit_byte(machine, 0);
+        skip = jit_emit_jcc(machine, instr->opcode == JZ ? 0x5 : 0x4);
+        jit_emit_store_integer(machine, IP, right);
+        jit_patch(skip, machine->jit.code_ptr);
+        break;
+
+    default:
+        return FALSE;
+    }
+
+    /* The slow path, for registers not holding an integer */
+    done = jit_emit_jmp(machine);
+    jit_patch(slow[0], machine->jit.code_ptr);
+
+    if (slow[1])
+        jit_patch(slow[1], machine->jit.code_ptr);
+
+    jit_emit_call(machine, instr, ip);
+    jit_patch(done, machine->jit.code_ptr);
+
+    return TRUE;
+}
+
+/* Checks whether the instruction ends a block */
+int jit_ends_block(xsm_instruction *instr, int mode)
+{
+    switch (instr->opcode)
+    {
+    case JMP:
+    case JZ:
+    case JNZ:
+    case CALL:
+    case RET:
+    case INT:
+    case IRET:
+    case HALT:
+        return TRUE;
+    }
+
+    /* Changing PTLR may take the page of the block out of the address space */
+    if (mode == PRIVILEGE_USER && instr->operands[0].type == XSM_OPERAND_REGISTER && instr->operands[0].val == PTLR)
+        return TRUE;
+
+    return FALSE;
+}
+
+#endif
+
+/* Translate the block starting at the given physical address */
+jit_block *jit_translate(xsm_machine *machine, int logical, int address, int mode)
+{
+#if defined(__x86_64__)
+    int i, n, ip, offset, last;
+    xsm_instruction *instrs[JIT_MAX_LENGTH];
+    xsm_instruction *instr;
+    unsigned char *chain_fail;
+    jit_block *block;
+
+    /* Collect the instructions the interpreter has already decoded */
+    n = 0;
+    offset = address % XSM_PAGE_SIZE;
+
+    while (n < JIT_MAX_LENGTH && offset + n * XSM_INSTRUCTION_SIZE <= XSM_PAGE_SIZE - XSM_INSTRUCTION_SIZE)
+    {
+        instr = decode_fetch(machine, address + n * XSM_INSTRUCTION_SIZE);
+
+        if (!instr || instr->opcode == XSM_ILLINSTR || instr->error)
+            break;
+
+        if (machine_instr_req_privilege(instr->opcode) == PRIVILEGE_KERNEL && mode == PRIVILEGE_USER)
+            break;
+
+        instrs[n++] = instr;
+
+        if (jit_ends_block(instr, mode))
+            break;
+    }
+
+    if (n == 0)
+        return NULL;
+
+    if (machine->jit.num_blocks == JIT_MAX_BLOCKS || machine->jit.code_ptr + JIT_BLOCK_CODE_SIZE > machine->jit.code + JIT_CODE_SIZE)
+        jit_flush(machine);
+
+    block = &machine->jit.blocks[machine->jit.num_blocks++];
+    memset(block, 0, sizeof(jit_block));
+
+    block->valid = TRUE;
+    block->mode = mode;
+    block->logical = logical;
+    block->address = address;
+    block->length = n;
+    block->chain = !(mode == PRIVILEGE_USER && instrs[n - 1]->operands[0].type == XSM_OPERAND_REGISTER && instrs[n - 1]->operands[0].val == PTLR);
+
+    for (i = 0; i < JIT_MAX_LINKS; ++i)
+        block->links[i].ip = -1;
+
+    machine->jit.num_exits = 0;
+    block->entry = machine->jit.code_ptr;
+
+    /* Prologue */
+    jit_emit_byte(machine, 0x53); /* push rbx */
+    jit_emit_byte(machine, 0x41); /* push r12 */
+    jit_emit_byte(machine, 0x54);
+    jit_emit_byte(machine, 0x48); /* sub rsp, 8 */
+    jit_emit_byte(machine, 0x83);
+    jit_emit_byte(machine, 0xEC);
+    jit_emit_byte(machine, 0x08);
+    jit_emit_byte(machine, 0x48); /* mov rbx, registers */
+    jit_emit_byte(machine, 0xBB);
+    jit_emit_ptr(machine, machine->cpu.regs);
+    jit_emit_byte(machine, 0x49); /* mov r12, cycles */
+    jit_emit_byte(machine, 0xBC);
+    jit_emit_ptr(machine, &machine->cpu.cycles);
+
+    block->body = machine->jit.code_ptr;
+
+    for (i = 0; i < n; ++i)
+    {
+        ip = logical + i * XSM_INSTRUCTION_SIZE;
+        last = (i == n - 1);
+
+        /* A block that does not end in a jump leaves IP past its last instruction */
+        if (last && instrs[i]->opcode != JMP && instrs[i]->opcode != JZ && instrs[i]->opcode != JNZ)
+            jit_emit_store_integer(machine, IP, ip + XSM_INSTRUCTION_SIZE);
+
+        if (!jit_emit_inline(machine, instrs[i], ip, mode))
+            jit_emit_call(machine, instrs[i], ip);
+
+        /* The device clock; the machine accounts for the last instruction */
+        if (mode == PRIVILEGE_USER && !last)
+        {
+            jit_emit_byte(machine, 0x49); /* inc qword [r12] */
+            jit_emit_byte(machine, 0xFF);
+            jit_emit_byte(machine, 0x04);
+            jit_emit_byte(machine, 0x24);
+        }
+    }
+
+    /* Continue with the next block if it is translated */
+    if (block->chain)
+    {
+        jit_emit_byte(machine, 0x48); /* mov rdi, machine */
+        jit_emit_byte(machine, 0xBF);
+        jit_emit_ptr(machine, machine);
+        jit_emit_byte(machine, 0x48); /* mov rsi, block */
+        jit_emit_byte(machine, 0xBE);
+        jit_emit_ptr(machine, block);
+        jit_emit_byte(machine, 0x48); /* mov rax, jit_chain */
+        jit_emit_byte(machine, 0xB8);
+        jit_emit_ptr(machine, (void *)jit_chain);
+        jit_emit_byte(machine, 0xFF); /* call rax */
+        jit_emit_byte(machine, 0xD0);
+        jit_emit_byte(machine, 0x48); /* test rax, rax */
+        jit_emit_byte(machine, 0x85);
+        jit_emit_byte(machine, 0xC0);
+        chain_fail = jit_emit_jcc(machine, 0x4); /* jz */
+        jit_emit_byte(machine, 0xFF); /* jmp rax */
+        jit_emit_byte(machine, 0xE0);
+        jit_patch(chain_fail, machine->jit.code_ptr);
+    }
+
+    /* Epilogue, returning JIT_CONTINUE or the status in eax */
+    jit_emit_byte(machine, 0x31); /* xor eax, eax */
+    jit_emit_byte(machine, 0xC0);
+
+    for (i = 0; i < machine->jit.num_exits; ++i)
+        jit_patch(machine->jit.exits[i], machine->jit.code_ptr);
+
+    jit_emit_byte(machine, 0x48); /* add rsp, 8 */
+    jit_emit_byte(machine, 0x83);
+    jit_emit_byte(machine, 0xC4);
+    jit_emit_byte(machine, 0x08);
+    jit_emit_byte(machine, 0x41); /* pop r12 */
+    jit_emit_byte(machine, 0x5C);
+    jit_emit_byte(machine, 0x5B); /* pop rbx */
+    jit_emit_byte(machine, 0xC3); /* ret */
+
+    machine->jit.code_pages[address / XSM_PAGE_SIZE] = TRUE;
+
+    return block;
+#else
+    return NULL;
+#endif
+}
+
+/* Run the given block and the blocks chained to it */
+int jit_execute(xsm_machine *machine, jit_block *block)
+{
+    int (*code)();
+
+    machine->jit.exit = JIT_CONTINUE;
+
+    code = (int (*)())block->entry;
+    return code();
+}
+
+/* Make the running block return after the current instruction */
+void jit_request_exit(xsm_machine *machine)
+{
+    machine->jit.exit = JIT_EXIT;
+}
+
+/* Drop the blocks that may contain the word at the given address */
+void jit_invalidate(xsm_machine *machine, int address)
+{
+    if (address < 0 || address >= XSM_PAGE_SIZE * XSM_MEMORY_NUMPAGES)
+        return;
+
+    /* Blocks never cross a page boundary */
+    jit_invalidate_page(machine, address / XSM_PAGE_SIZE);
+}
+
+/* Drop the blocks in the given page */
+void jit_invalidate_page(xsm_machine *machine, int page)
+{
+    int mode, i;
+    jit_entry *entries;
+
+    if (page < 0 || page >= XSM_MEMORY_NUMPAGES || !machine->jit.code_pages[page])
+        return;
+
+    for (mode = 0; mode < 2; ++mode)
+    {
+        entries = machine->jit.table[mode][page];
+
+        if (!entries)
+            continue;
+
+        for (i = 0; i < XSM_PAGE_SIZE; ++i)
+        {
+            if (entries[i].block)
+                entries[i].block->valid = FALSE;
+
+            entries[i].block = NULL;
+        }
+    }
+
+    machine->jit.code_pages[page] = FALSE;
+    machine->jit.exit = JIT_EXIT;
+}
+
+/* Drop every translated block */
+void jit_flush(xsm_machine *machine)
+{
+    int mode, page;
+
+    for (mode = 0; mode < 2; ++mode)
+        for (page = 0; page < XSM_MEMORY_NUMPAGES; ++page)
+            if (machine->jit.table[mode][page])
+                memset(machine->jit.table[mode][page], 0, XSM_PAGE_SIZE * sizeof(jit_entry));
+
+    memset(machine->jit.code_pages, 0, sizeof(machine->jit.code_pages));
+
+    machine->jit.num_blocks = 0;
+    machine->jit.code_ptr = machine->jit.code;
+}
+
+/* Deallocate the translator */
+void jit_destroy(xsm_machine *machine)
+{
+    int mode, page;
+
+    for (mode = 0; mode < 2; ++mode)
+        for (page = 0; page < XSM_MEMORY_NUMPAGES; ++page)
+        {
+            free(machine->jit.table[mode][page]);
+            machine->jit.table[mode][page] = NULL;
+        }
+
+    free(machine->jit.blocks);
+    machine->jit.blocks = NULL;
+
+#if defined(__x86_64__)
+    if (machine->jit.code)
+        munmap(machine->jit.code, JIT_CODE_SIZE);
+#endif
+
+    machine->jit.code = NULL;
+}
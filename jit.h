@@ -0,0 +1,106 @@
+#ifndef XSM_JIT_H
+
+#define XSM_JIT_H
+
+#include "decode.h"
+#include "types.h"
+
+/* Number of times an address is interpreted before it is translated */
+#define JIT_THRESHOLD 16
+
+#define JIT_MAX_LENGTH 64
+#define JIT_MAX_BLOCKS 8192
+#define JIT_MAX_LINKS 2
+
+/* Size of the code cache and the largest code a block may need */
+#define JIT_CODE_SIZE (8 * 1024 * 1024)
+#define JIT_BLOCK_CODE_SIZE (JIT_MAX_LENGTH * 160 + 128)
+
+/* Status returned by a translated block */
+#define JIT_CONTINUE 0
+#define JIT_EXIT 1
+#define JIT_HALT 2
+
+struct _jit_block;
+
+typedef struct _jit_link
+{
+    int ip;
+    struct _jit_block *target;
+} jit_link;
+
+typedef struct _jit_block
+{
+    int valid;
+    int mode;
+
+    /* Logical and physical address of the first instruction */
+    int logical, address;
+    int length;
+
+    /* Set if the block may continue directly into another block */
+    int chain;
+    jit_link links[JIT_MAX_LINKS];
+    int next_link;
+
+    /* Native code, and the code past the prologue where chained blocks enter */
+    unsigned char *entry, *body;
+} jit_block;
+
+typedef struct _jit_entry
+{
+    int count;
+    jit_block *block;
+} jit_entry;
+
+typedef struct _jit_state
+{
+    unsigned char *code, *code_ptr;
+
+    jit_block *blocks;
+    int num_blocks;
+
+    /* Translation state of every instruction address, by mode */
+    jit_entry *table[2][XSM_MEMORY_NUMPAGES];
+
+    /* Pages holding the code of a translated block */
+    char code_pages[XSM_MEMORY_NUMPAGES];
+
+    /* Set when the running block has to give control back to the machine */
+    int exit;
+
+    /* Locations of the jumps to the epilogue of the block being translated */
+    unsigned char *exits[JIT_MAX_LENGTH * 2 + 2];
+    int num_exits;
+} jit_state;
+
+int jit_init(xsm_machine *machine);
+jit_entry *jit_entry_of(xsm_machine *machine, int address, int mode);
+jit_block *jit_lookup(xsm_machine *machine, int logical, int address, int mode);
+jit_block *jit_find(xsm_machine *machine, int logical, int address, int mode);
+int jit_run_instruction(xsm_machine *machine, xsm_instruction *instr);
+unsigned char *jit_chain(xsm_machine *machine, jit_block *block);
+void jit_emit_byte(xsm_machine *machine, int byte);
+void jit_emit_int32(xsm_machine *machine, int value);
+void jit_emit_ptr(xsm_machine *machine, const void *ptr);
+void jit_emit_rbx(xsm_machine *machine, int opcode, int reg, int disp);
+int jit_reg_integer(int code);
+int jit_reg_tag(int code);
+unsigned char *jit_emit_jcc(xsm_machine *machine, int cc);
+unsigned char *jit_emit_jmp(xsm_machine *machine);
+void jit_patch(unsigned char *jump, unsigned char *target);
+void jit_emit_store_integer(xsm_machine *machine, int code, int value);
+unsigned char *jit_emit_check_integer(xsm_machine *machine, int code);
+void jit_emit_call(xsm_machine *machine, xsm_instruction *instr, int ip);
+int jit_register_ok(xsm_machine *machine, xsm_operand *operand, int mode);
+int jit_emit_inline(xsm_machine *machine, xsm_instruction *instr, int ip, int mode);
+int jit_ends_block(xsm_instruction *instr, int mode);
+jit_block *jit_translate(xsm_machine *machine, int logical, int address, int mode);
+int jit_execute(xsm_machine *machine, jit_block *block);
+void jit_request_exit(xsm_machine *machine);
+void jit_invalidate(xsm_machine *machine, int address);
+void jit_invalidate_page(xsm_machine *machine, int page);
+void jit_flush(xsm_machine *machine);
+void jit_destroy(xsm_machine *machine);
+
+#endif
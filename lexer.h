@@ -2,6 +2,8 @@
 
 #define XSM_LEXER_H
 
+#include "types.h"
+
 #define TOKEN_REGISTER 1
 #define TOKEN_NUMBER 2
 #define TOKEN_STRING 3
@@ -15,8 +17,8 @@ typedef union YYSTYPE {
     char *str;
 } YYSTYPE;
 
-extern YYSTYPE yylval;
-
-void lexer_buffer_reset();
+int lexer_init(xsm_machine *machine, void **scanner);
+void lexer_buffer_reset(void *scanner);
+void lexer_destroy(void *scanner);
 
 #endif
@@ -0,0 +1,224 @@
+/*
+The embeddable simulator. A program linked with libxsm creates machines,
+loads them through memory and the disk, runs them and looks at their
+registers and memory afterwards, all in its own process. Console output
+and input go to the standard streams unless callbacks are set.
+
+Memory addresses are physical. A machine starts with a blank disk that
+is never written back, until a disk image is attached.
+*/
+
+#include "libxsm.h"
+
+#include "machine.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Fill in the settings of the xsm binary */
+void xsm_default_config(xsm_config *config)
+{
+    memset(config, 0, sizeof(xsm_config));
+
+    config->timer = XSM_CONFIG_DEFTIMER;
+    config->disk = XSM_CONFIG_DEFDISK;
+    config->console = XSM_CONFIG_DEFCONSOLE;
+}
+
+/* Create a machine with the given settings, NULL if it can not be set up */
+xsm_machine *xsm_create(const xsm_config *config)
+{
+    xsm_options options;
+    xsm_machine *machine;
+
+    memset(&options, 0, sizeof(xsm_options));
+
+    options.timer = config->timer;
+    options.disk = config->disk;
+    options.console = config->console;
+    options.jit = config->jit;
+    options.threaded = config->threaded;
+
+    machine = machine_create();
+
+    if (!machine)
+        return NULL;
+
+    if (!disk_init(machine, NULL, XSM_DISK_OVERLAY_DISCARD) || !machine_init(machine, &options))
+    {
+        xsm_destroy(machine);
+        return NULL;
+    }
+
+    return machine;
+}
+
+/*
+Replace the disk with the given image, with an overlay mode of
+XSM_DISK_OVERLAY_*. The disk replaced is closed as its own mode says.
+*/
+int xsm_attach_disk(xsm_machine *machine, const char *filename, int overlay)
+{
+    disk_close(machine);
+    return disk_init(machine, filename, overlay);
+}
+
+/* Send console output to write and read console input from read, NULL for the standard stream */
+void xsm_set_console(xsm_machine *machine, void (*write)(void *data, const char *text), int (*read)(void *data, char *buffer, int size), void *data)
+{
+    machine->console.write = write;
+    machine->console.read = read;
+    machine->console.data = data;
+}
+
+/* Report the exception that stops the machine to error instead of stderr, with the console data */
+void xsm_set_console_error(xsm_machine *machine, void (*error)(void *data, const char *message))
+{
+    machine->console.error = error;
+}
+
+/* Run the machine until it halts or fails */
+int xsm_run(xsm_machine *machine)
+{
+    if (machine->cpu.state == XSM_STATE_RUNNING)
+        machine_run(machine);
+
+    return xsm_state(machine);
+}
+
+/* Run at most count instructions of the machine, in either mode */
+int xsm_run_for(xsm_machine *machine, long long count)
+{
+    if (machine->cpu.state == XSM_STATE_RUNNING)
+        machine_run_for(machine, count);
+
+    return xsm_state(machine);
+}
+
+/* Returns whether the machine can run on */
+int xsm_state(xsm_machine *machine)
+{
+    switch (machine->cpu.state)
+    {
+        case XSM_STATE_HALTED:
+            return XSM_HALTED;
+
+        case XSM_STATE_ERROR:
+            return XSM_STOPPED;
+    }
+
+    return XSM_RUNNING;
+}
+
+/* Returns the message of the exception that stopped the machine, NULL if there was none */
+const char *xsm_error(xsm_machine *machine)
+{
+    if (machine->cpu.state != XSM_STATE_ERROR)
+        return NULL;
+
+    return exception_message(machine);
+}
+
+/* Returns the text of the named register, NULL if there is no such register */
+const char *xsm_get_register(xsm_machine *machine, const char *name)
+{
+    xsm_reg *reg = registers_get_register(machine, name);
+
+    if (!reg)
+        return NULL;
+
+    return word_get_string(reg);
+}
+
+/* Returns the value of the named register as an integer */
+int xsm_get_register_int(xsm_machine *machine, const char *name)
+{
+    xsm_reg *reg = registers_get_register(machine, name);
+
+    if (!reg)
+        return 0;
+
+    return word_get_integer(reg);
+}
+
+/* Store text in the named register */
+int xsm_set_register(xsm_machine *machine, const char *name, const char *value)
+{
+    xsm_reg *reg = registers_get_register(machine, name);
+
+    if (!reg)
+        return XSM_FAILURE;
+
+    word_store_string(reg, value);
+    return XSM_SUCCESS;
+}
+
+/* Store an integer in the named register */
+int xsm_set_register_int(xsm_machine *machine, const char *name, int value)
+{
+    xsm_reg *reg = registers_get_register(machine, name);
+
+    if (!reg)
+        return XSM_FAILURE;
+
+    word_store_integer(reg, value);
+    return XSM_SUCCESS;
+}
+
+/* Returns the text of the word at the address, NULL if the address is invalid */
+const char *xsm_read_memory(xsm_machine *machine, int address)
+{
+    xsm_word *word = memory_get_word(machine, address);
+
+    if (!word)
+        return NULL;
+
+    return word_get_string(word);
+}
+
+/* Returns the word at the address as an integer */
+int xsm_read_memory_int(xsm_machine *machine, int address)
+{
+    xsm_word *word = memory_get_word(machine, address);
+
+    if (!word)
+        return 0;
+
+    return word_get_integer(word);
+}
+
+/* Store text at the address */
+int xsm_write_memory(xsm_machine *machine, int address, const char *value)
+{
+    xsm_word *word = memory_get_word(machine, address);
+
+    if (!word)
+        return XSM_FAILURE;
+
+    word_store_string(word, value);
+    machine_notify_write(machine, address);
+
+    return XSM_SUCCESS;
+}
+
+/* Store an integer at the address */
+int xsm_write_memory_int(xsm_machine *machine, int address, int value)
+{
+    xsm_word *word = memory_get_word(machine, address);
+
+    if (!word)
+        return XSM_FAILURE;
+
+    word_store_integer(word, value);
+    machine_notify_write(machine, address);
+
+    return XSM_SUCCESS;
+}
+
+/* Deallocate the machine, closing its disk */
+void xsm_destroy(xsm_machine *machine)
+{
+    machine_destroy(machine);
+    disk_close(machine);
+    machine_free(machine);
+}
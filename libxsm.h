@@ -0,0 +1,51 @@
+#ifndef XSM_LIBXSM_H
+
+#define XSM_LIBXSM_H
+
+#include "disk.h"
+#include "types.h"
+
+/* Settings the xsm binary uses when no option is given */
+#define XSM_CONFIG_DEFTIMER 20
+#define XSM_CONFIG_DEFDISK 20
+#define XSM_CONFIG_DEFCONSOLE 20
+
+/* What xsm_run() and xsm_run_for() stopped on */
+#define XSM_RUNNING 0   /* Ran the given number of instructions */
+#define XSM_HALTED 1    /* Executed HALT */
+#define XSM_STOPPED 2   /* Raised an exception in KERNEL mode */
+
+/*
+Settings of an embedded machine. The device latencies are counted in
+USER mode instructions, as they are by the xsm binary when no option is
+given. --timer N on the command line is a timer of N + 1.
+*/
+typedef struct _xsm_config
+{
+    int timer;      /* 0 disables the timer */
+    int disk;
+    int console;
+    int jit;
+    int threaded;
+} xsm_config;
+
+void xsm_default_config(xsm_config *config);
+xsm_machine *xsm_create(const xsm_config *config);
+int xsm_attach_disk(xsm_machine *machine, const char *filename, int overlay);
+void xsm_set_console(xsm_machine *machine, void (*write)(void *data, const char *text), int (*read)(void *data, char *buffer, int size), void *data);
+void xsm_set_console_error(xsm_machine *machine, void (*error)(void *data, const char *message));
+int xsm_run(xsm_machine *machine);
+int xsm_run_for(xsm_machine *machine, long long count);
+int xsm_state(xsm_machine *machine);
+const char *xsm_error(xsm_machine *machine);
+const char *xsm_get_register(xsm_machine *machine, const char *name);
+int xsm_get_register_int(xsm_machine *machine, const char *name);
+int xsm_set_register(xsm_machine *machine, const char *name, const char *value);
+int xsm_set_register_int(xsm_machine *machine, const char *name, int value);
+const char *xsm_read_memory(xsm_machine *machine, int address);
+int xsm_read_memory_int(xsm_machine *machine, int address);
+int xsm_write_memory(xsm_machine *machine, int address, const char *value);
+int xsm_write_memory_int(xsm_machine *machine, int address, int value);
+void xsm_destroy(xsm_machine *machine);
+
+#endif
@@ -8,10 +8,6 @@ The XSM machine simulator.
 #include <string.h>
 #include <stdio.h>
 
-static xsm_cpu _thecpu;
-
-static xsm_options _theoptions;
-
 const char *instructions[] = {
     "MOV",
     "ADD",
@@ -51,39 +47,133 @@ const char *instructions[] = {
     "HALT",
     "NOP"};
 
+/* Allocate a machine, its parts are set up by machine_init() and disk_init() */
+xsm_machine *machine_create()
+{
+    xsm_machine *machine;
+
+    machine = (xsm_machine *)calloc(1, sizeof(xsm_machine));
+
+    if (machine)
+        machine->disk.fd = -1;
+
+    return machine;
+}
+
 /* Initialise the XSM machine */
-int machine_init(xsm_options *options)
+int machine_init(xsm_machine *machine, xsm_options *options)
 {
     xsm_word *ipreg;
 
-    _theoptions = *options;
+    machine->options = *options;
 
-    if (!registers_init())
+    if (!registers_init(machine))
         return XSM_FAILURE;
 
-    if (!memory_init())
+    machine->cpu.regs = registers_get_register_by_code(machine, R0);
+
+    if (!memory_init(machine))
         return XSM_FAILURE;
 
-    if (!debug_init())
+    if (!debug_init(machine))
         return FALSE;
 
+    if (!decode_init(machine))
+        return XSM_FAILURE;
+
+    if (!event_init(machine))
+        return XSM_FAILURE;
+
+    if (!tokenize_init(machine))
+        return XSM_FAILURE;
+
+    /* Every instruction is counted one at a time */
+    if (machine->options.profile)
+    {
+        if (!profile_init(machine))
+            return XSM_FAILURE;
+
+        machine->options.jit = FALSE;
+        machine->options.threaded = FALSE;
+    }
+
+    /* So is every instruction traced */
+    if (machine->options.trace)
+    {
+        if (!trace_open(machine, machine->options.trace))
+        {
+            fprintf(stderr, "Could not open the trace %s\n", machine->options.trace);
+            return XSM_FAILURE;
+        }
+
+        machine->options.jit = FALSE;
+        machine->options.threaded = FALSE;
+    }
+
+    if (machine->options.record_input && !replay_open(machine, machine->options.record_input, REPLAY_RECORD))
+    {
+        fprintf(stderr, "Could not open the input log %s\n", machine->options.record_input);
+        return XSM_FAILURE;
+    }
+
+    if (machine->options.replay_input && !replay_open(machine, machine->options.replay_input, REPLAY_PLAY))
+    {
+        fprintf(stderr, "Could not open the input log %s\n", machine->options.replay_input);
+        return XSM_FAILURE;
+    }
+
+    /* The debugger keeps checkpoints to step back to */
+    if (machine->options.debug && !history_init(machine))
+        return XSM_FAILURE;
+
+    /* Translated blocks do not stop for the debugger, interpret instead */
+    if (machine->options.jit)
+        if (machine->options.debug || !jit_init(machine))
+            machine->options.jit = FALSE;
+
     /* Storing ROM code */
-    word_store_string(memory_get_word(0), "LOADI 1, 0");
-    word_store_string(memory_get_word(2), "LOADI 2, 1");
-    word_store_string(memory_get_word(4), "JMP 512");
+    word_store_string(memory_get_word(machine, 0), "LOADI 1, 0");
+    word_store_string(memory_get_word(machine, 2), "LOADI 2, 1");
+    word_store_string(memory_get_word(machine, 4), "JMP 512");
 
     /* Set up IP */
-    ipreg = machine_get_ipreg();
+    ipreg = machine_get_ipreg(machine);
     word_store_integer(ipreg, 0);
 
-    machine_set_mode(PRIVILEGE_KERNEL);
-
-    /* The disk and console is idle.*/
-    _thecpu.console_state = XSM_CONSOLE_IDLE;
-    _thecpu.disk_state = XSM_DISK_IDLE;
+    machine_set_mode(machine, PRIVILEGE_KERNEL);
 
     /* Initialise timer clock*/
-    _thecpu.timer = _theoptions.timer;
+    machine->cpu.cycles = 0;
+    machine_schedule_timer(machine);
+
+    machine->idle.backoff = 1;
+    machine->idle.writes = 0;
+    machine_idle_reset(machine);
+
+    return XSM_SUCCESS;
+}
+
+/* Resume the machine from the snapshot in the given file */
+int machine_load_snapshot(xsm_machine *machine, const char *filename)
+{
+    int page;
+
+    if (!snapshot_load(machine, filename))
+        return XSM_FAILURE;
+
+    /* Nothing cached from the fresh machine is valid any more */
+    memory_tlb_flush(machine);
+
+    for (page = 0; page < XSM_MEMORY_NUMPAGES; ++page)
+        decode_invalidate_page(machine, page);
+
+    if (machine->options.jit)
+        jit_flush(machine);
+
+    machine_idle_reset(machine);
+
+    /* The snapshot was saved inside a BRKP */
+    machine->cpu.resume = TRUE;
 
     return XSM_SUCCESS;
 }
@@ -100,36 +190,42 @@ int machine_get_opcode(const char *instr)
     return XSM_ILLINSTR;
 }
 
+/* Retrieve the name of an opcode */
+const char *machine_get_opcode_name(int opcode)
+{
+    return instructions[opcode];
+}
+
 /* Retieve the IP register */
-xsm_word *machine_get_ipreg()
+xsm_word *machine_get_ipreg(xsm_machine *machine)
 {
-    return registers_get_register("IP");
+    return &machine->cpu.regs[IP];
 }
 
 /* Retrieve the SP register */
-xsm_word *machine_get_spreg()
+xsm_word *machine_get_spreg(xsm_machine *machine)
 {
-    return registers_get_register("SP");
+    return &machine->cpu.regs[SP];
 }
 
-/* Retrieve the given register */
-xsm_word *machine_get_register(const char *name)
+/* Retrieve the register with the given code */
+xsm_word *machine_get_register(xsm_machine *machine, int code)
 {
     int mode;
     xsm_word *reg;
 
-    mode = machine_get_mode();
-    reg = registers_get_register(name);
+    mode = machine_get_mode(machine);
+    reg = registers_get_register_by_code(machine, code);
 
     if (!reg)
-        machine_register_exception("No such register", EXP_ILLINSTR);
+        machine_register_exception(machine, "No such register", EXP_ILLINSTR);
 
     if (mode == PRIVILEGE_USER)
-        if (!registers_umode(name))
-            machine_register_exception("Register not available in USER mode", EXP_ILLINSTR);
+        if (!registers_umode_by_code(machine, code))
+            machine_register_exception(machine, "Register not available in USER mode", EXP_ILLINSTR);
 
-    if (!strcasecmp(name, "IP"))
-        machine_register_exception("IP register can not be directly manipulated", EXP_ILLINSTR);
+    if (code == IP)
+        machine_register_exception(machine, "IP register can not be directly manipulated", EXP_ILLINSTR);
 
     return reg;
 }
@@ -144,7 +240,7 @@ int machine_instr_req_privilege(int opcode)
 }
 
 /* An interface between lexer and machine */
-int machine_serve_instruction(char *buffer, unsigned long *read_bytes, int max)
+int machine_serve_instruction(xsm_machine *machine, char *buffer, unsigned long *read_bytes, int max)
 {
 
     int ip_val, i, j, bytes_to_read;
@@ -152,17 +248,18 @@ int machine_serve_instruction(char *buffer, unsigned long *read_bytes, int max)
 
     bytes_to_read = XSM_INSTRUCTION_SIZE * XSM_WORD_SIZE;
 
-    ip_reg = machine_get_ipreg();
+    ip_reg = machine_get_ipreg(machine);
     ip_val = word_get_integer(ip_reg);
-    ip_val = machine_translate_address(ip_val, FALSE, INSTR_FETCH, machine_get_mode());
-    instr_mem = machine_memory_get_word(ip_val);
+    ip_val = machine_translate_address(machine, ip_val, FALSE, INSTR_FETCH, machine_get_mode(machine));
+    instr_mem = machine_memory_get_word(machine, ip_val);
 
-    memcpy(buffer, instr_mem->val, bytes_to_read);
+    for (i = 0; i < XSM_INSTRUCTION_SIZE; ++i)
+        word_retrieve_raw(buffer + i * XSM_WORD_SIZE, &instr_mem[i]);
 
     if (strlen(buffer) == 0)
     {
-        word_store_integer(machine_get_ipreg(), ip_val + 2);
-        machine_register_exception("The simulator has encountered a NULL instruction", EXP_ILLINSTR);
+        word_store_integer(machine_get_ipreg(machine), ip_val + 2);
+        machine_register_exception(machine, "The simulator has encountered a NULL instruction", EXP_ILLINSTR);
     }
 
     /* Trim */
@@ -177,93 +274,580 @@ int machine_serve_instruction(char *buffer, unsigned long *read_bytes, int max)
     return TRUE;
 }
 
+/* Fetch the decoded instruction at the given logical address */
+xsm_instruction *machine_fetch_instruction(xsm_machine *machine, int ip_val)
+{
+    int address;
+    xsm_instruction *instr;
+
+    address = machine_translate_address(machine, ip_val, FALSE, INSTR_FETCH, machine_get_mode(machine));
+    machine_memory_get_word(machine, address);
+
+    instr = decode_fetch(machine, address);
+
+    if (instr)
+        return instr;
+
+    /* Not in the cache, run it through the lexer */
+    tokenize_clear_stream(machine);
+    tokenize_reset(machine);
+
+    instr = decode_store(machine, address);
+    decode_instruction(machine, instr);
+    instr->valid = TRUE;
+
+    decode_fuse(machine, address);
+
+    return instr;
+}
+
 /* Start the XSM machine */
-int machine_run()
+int machine_run(xsm_machine *machine)
 {
-    int token, opcode, ipval, exp_occured;
-    YYSTYPE token_info;
-    xsm_word *ipreg;
+    int status;
+
+    if (machine->options.sample_hz && !machine->sampler.running)
+        if (!sample_start(machine))
+            fprintf(stderr, "Could not start the sampling profiler\n");
+
+    /*
+    Set the exception point once. Every exception unwinds back here and
+    execution resumes from the loop after it has been handled.
+    */
+    if (setjmp(machine->cpu.h_exp_point) == XSM_EXCEPTION_OCCURED)
+        if (XSM_SUCCESS != machine_handle_exception(machine))
+        {
+            machine->cpu.state = XSM_STATE_ERROR;
+            machine_run_finish(machine);
+            return TRUE;
+        }
 
-    ipreg = machine_get_ipreg();
+    machine_resume(machine);
 
     while (TRUE)
     {
-        /* Set the exception point */
-        exp_occured = setjmp(_thecpu.h_exp_point);
+        if (machine->options.jit)
+            status = machine_run_block(machine);
+        else if (machine->options.threaded)
+            status = machine_run_threaded(machine);
+        else
+            status = machine_step(machine);
 
-        if (exp_occured == XSM_EXCEPTION_OCCURED)
-            if (XSM_SUCCESS != machine_handle_exception())
-                break;
+        /* Stop the machine */
+        if (status == XSM_HALT)
+            break;
+    }
 
-        /* Flush the instruction stream */
-        tokenize_clear_stream();
-        tokenize_reset();
+    machine->cpu.state = XSM_STATE_HALTED;
+    machine_run_finish(machine);
+    return TRUE;
+}
 
-        /* Pre-execute */
-        ipval = word_get_integer(ipreg);
-        machine_pre_execute(ipval);
+/* Write the profiles once the machine has stopped */
+void machine_run_finish(xsm_machine *machine)
+{
+    if (machine->options.profile)
+        profile_finish(machine);
 
-        token = tokenize_next_token(&token_info);
+    if (machine->options.sample_hz)
+    {
+        sample_stop(machine);
+        sample_report(machine, stderr);
+    }
+}
 
-        /* IP = IP + instruction length */
-        ipval = ipval + XSM_INSTRUCTION_SIZE;
-        word_store_integer(ipreg, ipval);
+/*
+Run at most count instructions, in either mode, one at a time. Returns
+TRUE if the machine stopped before that.
+*/
+int machine_run_for(xsm_machine *machine, long long count)
+{
+    /* Kept in memory, an exception unwinds back here part way */
+    volatile long long left;
 
-        if (token != TOKEN_INSTRUCTION)
-            machine_register_exception("The simulator has encountered an illegal instruction", EXP_ILLINSTR);
+    left = count;
 
-        opcode = machine_get_opcode(token_info.str);
+    if (setjmp(machine->cpu.h_exp_point) == XSM_EXCEPTION_OCCURED)
+        if (XSM_SUCCESS != machine_handle_exception(machine))
+        {
+            machine->cpu.state = XSM_STATE_ERROR;
+            return TRUE;
+        }
 
-        if (opcode == XSM_ILLINSTR)
-            machine_register_exception("The instruction is not available in this architecture", EXP_ILLINSTR);
+    machine_resume(machine);
 
-        if (machine_instr_req_privilege(opcode) == PRIVILEGE_KERNEL && machine_get_mode() == PRIVILEGE_USER)
-            machine_register_exception("This instruction requires more privilege", EXP_ILLINSTR);
+    while (left > 0)
+    {
+        left = left - 1;
 
-        /* Stop the machine */
-        if (machine_execute_instruction(opcode) == XSM_HALT)
+        if (machine_step(machine) == XSM_HALT)
+        {
+            machine->cpu.state = XSM_STATE_HALTED;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Finish the BRKP a loaded snapshot was saved in */
+void machine_resume(xsm_machine *machine)
+{
+    if (!machine->cpu.resume)
+        return;
+
+    machine->cpu.resume = FALSE;
+
+    if (machine_get_mode(machine) == PRIVILEGE_USER)
+        machine_post_execute(machine);
+}
+
+/* Execute the instruction at IP */
+int machine_step(xsm_machine *machine)
+{
+    int ipval;
+    xsm_word *ipreg;
+    xsm_instruction *instr;
+
+    /* Pre-execute */
+    ipreg = machine_get_ipreg(machine);
+    ipval = word_get_integer(ipreg);
+    machine_pre_execute(machine, ipval);
+
+    /* The debugger may have moved the machine back */
+    ipval = word_get_integer(ipreg);
+
+    if (machine->options.trace)
+        trace_begin(machine, ipval);
+
+    instr = machine_fetch_instruction(machine, ipval);
+
+    if (machine->options.profile)
+        profile_count(machine, ipval, instr->opcode);
+
+    if (machine->options.trace)
+        trace_opcode(machine, instr->opcode);
+
+    /* IP = IP + instruction length */
+    ipval = ipval + XSM_INSTRUCTION_SIZE;
+    word_store_integer(ipreg, ipval);
+
+    if (instr->opcode == XSM_ILLINSTR)
+        machine_register_exception(machine, instr->error, EXP_ILLINSTR);
+
+    if (machine_instr_req_privilege(instr->opcode) == PRIVILEGE_KERNEL && machine_get_mode(machine) == PRIVILEGE_USER)
+        machine_register_exception(machine, "This instruction requires more privilege", EXP_ILLINSTR);
+
+    if (machine_execute_instruction(machine, instr) == XSM_HALT)
+    {
+        if (machine->options.trace)
+            trace_end(machine, FALSE);
+
+        return XSM_HALT;
+    }
+
+    /* Post-execute */
+    if (machine_get_mode(machine) == PRIVILEGE_USER)
+        machine_post_execute(machine);
+
+    if (machine->options.trace)
+        trace_end(machine, FALSE);
+
+    return TRUE;
+}
+
+/* Fetch the instruction at IP and move IP past it */
+#define THREADED_FETCH()                                    \
+    ipval = word_get_integer(ipreg);                        \
+    machine_pre_execute(machine, ipval);                    \
+    ipval = word_get_integer(ipreg);                        \
+    instr = machine_fetch_instruction(machine, ipval);      \
+    word_store_integer(ipreg, ipval + XSM_INSTRUCTION_SIZE)
+
+#if defined(__GNUC__)
+#define THREADED_HANDLER(kind) handler_##kind:
+#define THREADED_DISPATCH() goto *handlers[instr->kind]
+#else
+#define THREADED_HANDLER(kind) case kind:
+#define THREADED_DISPATCH() goto dispatch
+#endif
+
+/* Finish the instruction and dispatch the next one */
+#define THREADED_NEXT()                          \
+    do                                           \
+    {                                            \
+        if (machine->cpu.mode == PRIVILEGE_USER) \
+            machine_post_execute(machine);       \
+        THREADED_FETCH();                        \
+        THREADED_DISPATCH();                     \
+    } while (0)
+
+/* Continue with the next instruction of a fused pair without fetching it */
+#define THREADED_FUSE()                                              \
+    if (machine_fuse_next(machine, instr))                           \
+    {                                                                \
+        instr = instr + XSM_INSTRUCTION_SIZE;                        \
+        ipval = ipval + XSM_INSTRUCTION_SIZE;                        \
+        word_store_integer(ipreg, ipval + XSM_INSTRUCTION_SIZE);     \
+        THREADED_DISPATCH();                                         \
+    }
+
+/* Run the threaded interpreter until the machine halts */
+int machine_run_threaded(xsm_machine *machine)
+{
+    int ipval, l_value, r_value, test, generation, address;
+    xsm_word *ipreg, *regs, *l_reg, *r_reg, *word;
+    xsm_instruction *instr;
+
+#if defined(__GNUC__)
+    static void *handlers[XSM_KIND_COUNT] = {
+        [XSM_KIND_GENERIC] = &&handler_XSM_KIND_GENERIC,
+        [XSM_KIND_MOV_RR] = &&handler_XSM_KIND_MOV_RR,
+        [XSM_KIND_MOV_RI] = &&handler_XSM_KIND_MOV_RI,
+        [XSM_KIND_MOV_RS] = &&handler_XSM_KIND_MOV_RS,
+        [XSM_KIND_MOV_RD] = &&handler_XSM_KIND_MOV_RD,
+        [XSM_KIND_MOV_DR] = &&handler_XSM_KIND_MOV_DR,
+        [XSM_KIND_MOV_DI] = &&handler_XSM_KIND_MOV_DI,
+        [XSM_KIND_ADD_RR] = &&handler_XSM_KIND_ADD_RR,
+        [XSM_KIND_ADD_RI] = &&handler_XSM_KIND_ADD_RI,
+        [XSM_KIND_SUB_RR] = &&handler_XSM_KIND_SUB_RR,
+        [XSM_KIND_SUB_RI] = &&handler_XSM_KIND_SUB_RI,
+        [XSM_KIND_MUL_RR] = &&handler_XSM_KIND_MUL_RR,
+        [XSM_KIND_MUL_RI] = &&handler_XSM_KIND_MUL_RI,
+        [XSM_KIND_INR_R] = &&handler_XSM_KIND_INR_R,
+        [XSM_KIND_DCR_R] = &&handler_XSM_KIND_DCR_R,
+        [XSM_KIND_LT_RR] = &&handler_XSM_KIND_LT_RR,
+        [XSM_KIND_GT_RR] = &&handler_XSM_KIND_GT_RR,
+        [XSM_KIND_EQ_RR] = &&handler_XSM_KIND_EQ_RR,
+        [XSM_KIND_NE_RR] = &&handler_XSM_KIND_NE_RR,
+        [XSM_KIND_GE_RR] = &&handler_XSM_KIND_GE_RR,
+        [XSM_KIND_LE_RR] = &&handler_XSM_KIND_LE_RR,
+        [XSM_KIND_JMP_I] = &&handler_XSM_KIND_JMP_I,
+        [XSM_KIND_JZ_RI] = &&handler_XSM_KIND_JZ_RI,
+        [XSM_KIND_JNZ_RI] = &&handler_XSM_KIND_JNZ_RI,
+        [XSM_KIND_PUSH_R] = &&handler_XSM_KIND_PUSH_R,
+        [XSM_KIND_POP_R] = &&handler_XSM_KIND_POP_R,
+        [XSM_KIND_CALL_I] = &&handler_XSM_KIND_CALL_I,
+        [XSM_KIND_RET] = &&handler_XSM_KIND_RET,
+        [XSM_KIND_NOP] = &&handler_XSM_KIND_NOP,
+        [XSM_KIND_CMP_JCC] = &&handler_XSM_KIND_CMP_JCC,
+        [XSM_KIND_INR_JMP] = &&handler_XSM_KIND_INR_JMP,
+        [XSM_KIND_DCR_JMP] = &&handler_XSM_KIND_DCR_JMP,
+        [XSM_KIND_PUSH_RUN] = &&handler_XSM_KIND_PUSH_RUN,
+        [XSM_KIND_POP_RUN] = &&handler_XSM_KIND_POP_RUN};
+#endif
+
+    ipreg = machine_get_ipreg(machine);
+    regs = machine->cpu.regs;
+
+    THREADED_FETCH();
+    THREADED_DISPATCH();
+
+#if !defined(__GNUC__)
+dispatch:
+    switch (instr->kind)
+    {
+#endif
+
+    /* Anything without a specialised handler */
+    THREADED_HANDLER(XSM_KIND_GENERIC)
+    if (instr->opcode == XSM_ILLINSTR)
+        machine_register_exception(machine, instr->error, EXP_ILLINSTR);
+
+    if (machine_instr_req_privilege(instr->opcode) == PRIVILEGE_KERNEL && machine->cpu.mode == PRIVILEGE_USER)
+        machine_register_exception(machine, "This instruction requires more privilege", EXP_ILLINSTR);
+
+    if (machine_execute_instruction(machine, instr) == XSM_HALT)
+        return XSM_HALT;
+
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_MOV_RR)
+    word_copy(&regs[instr->operands[0].val], &regs[instr->operands[1].val]);
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_MOV_RI)
+    word_store_integer(&regs[instr->operands[0].val], instr->operands[1].val);
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_MOV_RS)
+    word_store_string(&regs[instr->operands[0].val], instr->operands[1].str);
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_MOV_RD)
+    word = machine_get_address(machine, &instr->operands[1], FALSE);
+    word_copy(&regs[instr->operands[0].val], word);
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_MOV_DR)
+    address = machine_get_address_int(machine, &instr->operands[0], TRUE);
+    word = machine_memory_get_word(machine, address);
+    word_copy(word, &regs[instr->operands[1].val]);
+    machine_notify_write(machine, address);
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_MOV_DI)
+    address = machine_get_address_int(machine, &instr->operands[0], TRUE);
+    word = machine_memory_get_word(machine, address);
+    word_store_integer(word, instr->operands[1].val);
+    machine_notify_write(machine, address);
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_ADD_RR)
+    l_reg = &regs[instr->operands[0].val];
+    r_value = word_get_integer(&regs[instr->operands[1].val]);
+    word_store_integer(l_reg, r_value + word_get_integer(l_reg));
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_ADD_RI)
+    l_reg = &regs[instr->operands[0].val];
+    word_store_integer(l_reg, instr->operands[1].val + word_get_integer(l_reg));
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_SUB_RR)
+    l_reg = &regs[instr->operands[0].val];
+    r_value = word_get_integer(&regs[instr->operands[1].val]);
+    word_store_integer(l_reg, word_get_integer(l_reg) - r_value);
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_SUB_RI)
+    l_reg = &regs[instr->operands[0].val];
+    word_store_integer(l_reg, word_get_integer(l_reg) - instr->operands[1].val);
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_MUL_RR)
+    l_reg = &regs[instr->operands[0].val];
+    r_value = word_get_integer(&regs[instr->operands[1].val]);
+    word_store_integer(l_reg, word_get_integer(l_reg) * r_value);
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_MUL_RI)
+    l_reg = &regs[instr->operands[0].val];
+    word_store_integer(l_reg, word_get_integer(l_reg) * instr->operands[1].val);
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_INR_R)
+    THREADED_HANDLER(XSM_KIND_INR_JMP)
+    l_reg = &regs[instr->operands[0].val];
+    word_store_integer(l_reg, word_get_integer(l_reg) + 1);
+
+    if (instr->kind == XSM_KIND_INR_JMP)
+        THREADED_FUSE();
+
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_DCR_R)
+    THREADED_HANDLER(XSM_KIND_DCR_JMP)
+    l_reg = &regs[instr->operands[0].val];
+    word_store_integer(l_reg, word_get_integer(l_reg) - 1);
+
+    if (instr->kind == XSM_KIND_DCR_JMP)
+        THREADED_FUSE();
+
+    THREADED_NEXT();
+
+    /* Comparisons of two integers, strings take the generic path */
+    THREADED_HANDLER(XSM_KIND_LT_RR)
+    THREADED_HANDLER(XSM_KIND_GT_RR)
+    THREADED_HANDLER(XSM_KIND_EQ_RR)
+    THREADED_HANDLER(XSM_KIND_NE_RR)
+    THREADED_HANDLER(XSM_KIND_GE_RR)
+    THREADED_HANDLER(XSM_KIND_LE_RR)
+    THREADED_HANDLER(XSM_KIND_CMP_JCC)
+    l_reg = &regs[instr->operands[0].val];
+    r_reg = &regs[instr->operands[1].val];
+
+    if (word_get_unix_type(l_reg) == XSM_TYPE_STRING || word_get_unix_type(r_reg) == XSM_TYPE_STRING)
+        machine_execute_logical(machine, instr);
+    else
+    {
+        l_value = word_get_integer(l_reg);
+        r_value = word_get_integer(r_reg);
+
+        switch (instr->opcode)
+        {
+        case LT:
+            test = l_value < r_value;
+            break;
+
+        case GT:
+            test = l_value > r_value;
+            break;
+
+        case EQ:
+            test = l_value == r_value;
+            break;
+
+        case NE:
+            test = l_value != r_value;
+            break;
+
+        case GE:
+            test = l_value >= r_value;
             break;
 
-        /* Post-execute */
-        if (machine_get_mode() == PRIVILEGE_USER)
-            machine_post_execute();
+        default:
+            test = l_value <= r_value;
+            break;
+        }
+
+        word_store_integer(l_reg, test);
+    }
+
+    /* Followed by JZ/JNZ */
+    if (instr->kind == XSM_KIND_CMP_JCC)
+        THREADED_FUSE();
+
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_JMP_I)
+    word_store_integer(ipreg, instr->operands[0].val);
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_JZ_RI)
+    l_reg = &regs[instr->operands[0].val];
+
+    // String content is true
+    if (word_get_unix_type(l_reg) != XSM_TYPE_STRING && !word_get_integer(l_reg))
+        word_store_integer(ipreg, instr->operands[1].val);
+
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_JNZ_RI)
+    l_reg = &regs[instr->operands[0].val];
+
+    if (word_get_unix_type(l_reg) == XSM_TYPE_STRING || word_get_integer(l_reg))
+        word_store_integer(ipreg, instr->operands[1].val);
+
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_PUSH_R)
+    THREADED_HANDLER(XSM_KIND_PUSH_RUN)
+    generation = memory_tlb_generation(machine);
+    machine_push_do(machine, &regs[instr->operands[0].val]);
+
+    /* A push into a page table may have moved the code, fetch it again */
+    if (instr->kind == XSM_KIND_PUSH_RUN && generation == memory_tlb_generation(machine))
+        THREADED_FUSE();
+
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_POP_R)
+    THREADED_HANDLER(XSM_KIND_POP_RUN)
+    machine_pop_do(machine, &regs[instr->operands[0].val]);
+
+    if (instr->kind == XSM_KIND_POP_RUN)
+        THREADED_FUSE();
+
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_CALL_I)
+    machine_execute_call_do(machine, instr->operands[0].val);
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_RET)
+    machine_execute_ret(machine);
+    THREADED_NEXT();
+
+    THREADED_HANDLER(XSM_KIND_NOP)
+    THREADED_NEXT();
+
+#if !defined(__GNUC__)
+    }
+#endif
+
+    return XSM_HALT;
+}
+
+/* Checks whether the instruction after a fused one may run without a fetch */
+int machine_fuse_next(xsm_machine *machine, xsm_instruction *instr)
+{
+    xsm_instruction *next = instr + XSM_INSTRUCTION_SIZE;
+
+    /* The debugger stops at every instruction */
+    if (machine->options.debug)
+        return FALSE;
+
+    /* The next instruction may have been overwritten */
+    if (!next->valid || decode_fuse_kind(instr->kind, next->kind) == XSM_KIND_GENERIC)
+        return FALSE;
+
+    if (machine->cpu.mode == PRIVILEGE_USER)
+    {
+        /* A device event is due, let post-execute raise its interrupt first */
+        if (machine->cpu.cycles + 1 >= event_next_time(machine))
+            return FALSE;
+
+        machine->cpu.cycles++;
     }
 
     return TRUE;
 }
 
+/* Execute the translated block at IP, or a single instruction if there is none */
+int machine_run_block(xsm_machine *machine)
+{
+    int ipval, address, mode;
+    jit_block *block;
+
+    ipval = word_get_integer(machine_get_ipreg(machine));
+    mode = machine_get_mode(machine);
+    address = machine_translate_address(machine, ipval, FALSE, INSTR_FETCH, mode);
+
+    block = jit_lookup(machine, ipval, address, mode);
+
+    if (!block)
+        return machine_step(machine);
+
+    /* Leave the device events due within the block to the interpreter */
+    if (mode == PRIVILEGE_USER && machine->cpu.cycles + block->length - 1 >= event_next_time(machine))
+        return machine_step(machine);
+
+    if (jit_execute(machine, block) == JIT_HALT)
+        return XSM_HALT;
+
+    /* The block leaves the last instruction it ran for post-execute */
+    if (machine_get_mode(machine) == PRIVILEGE_USER)
+        machine_post_execute(machine);
+
+    return TRUE;
+}
+
 /* Set the exception values */
-void machine_register_exception(char *message, int code)
+void machine_register_exception(xsm_machine *machine, char *message, int code)
 {
-    int mode = machine_get_mode();
-    exception_set(message, code, mode);
+    int mode = machine_get_mode(machine);
+    exception_set(machine, message, code, mode);
 
     /* Abandon ship! Abandon ship! */
-    longjmp(_thecpu.h_exp_point, XSM_EXCEPTION_OCCURED);
+    longjmp(machine->cpu.h_exp_point, XSM_EXCEPTION_OCCURED);
 }
 
 /* Handle the exception */
-int machine_handle_exception()
+int machine_handle_exception(xsm_machine *machine)
 {
     int code, mode, curr_ip, num_regs, i;
     char *message, *content;
     const char **reg_names;
     xsm_word *reg_eip, *reg_epn, *reg_ec, *reg_ema;
 
-    curr_ip = word_get_integer(machine_get_ipreg());
+    curr_ip = word_get_integer(machine_get_ipreg(machine));
     curr_ip = curr_ip - XSM_INSTRUCTION_SIZE;
-    word_store_integer(machine_get_ipreg(), curr_ip);
+    word_store_integer(machine_get_ipreg(machine), curr_ip);
 
     /* Get the details about the exception. */
-    mode = machine_get_mode();
-    code = exception_code();
-    message = exception_message();
+    mode = machine_get_mode(machine);
+    code = exception_code(machine);
+    message = exception_message(machine);
+
+    if (machine->options.profile)
+        profile_exception(machine, mode, code);
 
     /* Get the exception registers. */
-    reg_eip = registers_get_register("EIP");
-    reg_epn = registers_get_register("EPN");
-    reg_ec = registers_get_register("EC");
-    reg_ema = registers_get_register("EMA");
+    reg_eip = &machine->cpu.regs[EIP];
+    reg_epn = &machine->cpu.regs[EPN];
+    reg_ec = &machine->cpu.regs[EC];
+    reg_ema = &machine->cpu.regs[EMA];
 
     // Fetch IP stored in EIP
     word_store_integer(reg_eip, curr_ip);
@@ -272,13 +856,13 @@ int machine_handle_exception()
     switch (code)
     {
     case EXP_ILLMEM:
-        word_store_integer(reg_ema, exception_get_ma());
+        word_store_integer(reg_ema, exception_get_ma(machine));
         word_store_string(reg_epn, "");
         break;
 
     case EXP_PAGEFAULT:
         word_store_string(reg_ema, "");
-        word_store_integer(reg_epn, exception_get_epn());
+        word_store_integer(reg_epn, exception_get_epn(machine));
         break;
 
     default:
@@ -289,16 +873,30 @@ int machine_handle_exception()
 
     if (mode == PRIVILEGE_USER)
     {
-        machine_execute_interrupt_do(XSM_INTERRUPT_EXHANDLER);
+        machine_execute_interrupt_do(machine, XSM_INTERRUPT_EXHANDLER);
         return XSM_SUCCESS;
     }
 
+    /* Never reached before when running forward again */
+    if (machine->history.replaying)
+        return XSM_FAILURE;
+
+    if (machine->console.error && !machine->options.debug)
+    {
+        machine->console.error(machine->console.data, message);
+        return XSM_FAILURE;
+    }
+
     fprintf(stderr, "-----------------------------------\n");
 
-    if (_theoptions.debug)
+    if (machine->options.debug)
     {
         fprintf(stderr, "%s: Entering Debug Mode.\n", message);
-        debug_show_interface();
+        debug_show_interface(machine);
+
+        /* Stepped back to before the exception, run on from there */
+        if (machine->history.rewound)
+            return XSM_SUCCESS;
     }
     else
         fprintf(stderr, "%s.\n", message);
@@ -306,91 +904,207 @@ int machine_handle_exception()
     return XSM_FAILURE;
 }
 
-/* To be decided */
-void machine_get_mem_access(int *mem_left, int *mem_right)
+/* Actions before instruction execution */
+void machine_pre_execute(xsm_machine *machine, int ip_val)
 {
-    *mem_left = _thecpu.mem_left;
-    *mem_right = _thecpu.mem_right;
+    /* Debug if activated */
+    if (machine->options.debug)
+        debug_next_step(machine, ip_val);
 }
 
-/* Actions before instruction execution */
-void machine_pre_execute(int ip_val)
+/* Actions after instruction execution */
+void machine_post_execute(xsm_machine *machine)
 {
-    /* Debug if activated */
-    if (_theoptions.debug)
-        debug_next_step(ip_val);
+    int ipval;
+    xsm_event *due, event;
 
-    /* Clear the potential watchpoint trigger */
-    _thecpu.mem_left = -1;
+    machine->cpu.cycles++;
+
+    /* Loops are seen at their backward jumps */
+    ipval = word_get_integer(&machine->cpu.regs[IP]);
+
+    if (ipval <= machine->idle.last_ip && !machine->options.debug && !machine->options.profile && !machine->options.trace)
+        machine_idle_check(machine, ipval);
+
+    machine->idle.last_ip = ipval;
+
+    /* Nothing is due yet */
+    if (machine->cpu.cycles < event_next_time(machine))
+        return;
+
+    due = event_due(machine, machine->cpu.cycles);
+
+    if (!due)
+        return;
+
+    /* The console completes only while the disk is idle */
+    if (due->type == XSM_EVENT_CONSOLE && event_pending(machine, XSM_EVENT_DISK))
+        return;
+
+    event = *due;
+    event_remove(machine, due);
+
+    machine_fire_event(machine, &event);
 }
 
-/* Actions after instruction execution */
-void machine_post_execute()
+/* Stop watching the current loop */
+void machine_idle_reset(xsm_machine *machine)
 {
-    xsm_word *dest_port;
+    machine->idle.ip = -1;
+    machine->idle.armed = FALSE;
+}
 
-    if (_thecpu.timer >= 0)
-        _thecpu.timer--;
+/*
+Look for a loop that only spins until the next device event. If an
+iteration of the loop writes no memory and brings the registers back to
+where they were, every iteration until the next event does the same, and
+the device clock can be moved forward by whole iterations.
+*/
+void machine_idle_check(xsm_machine *machine, int ip_val)
+{
+    long long length, next_time, skip;
 
-    if (_thecpu.disk_wait > 0)
-        _thecpu.disk_wait--;
+    if (ip_val != machine->idle.ip)
+    {
+        machine->idle.ip = ip_val;
+        machine->idle.armed = FALSE;
+        return;
+    }
 
-    if (_thecpu.console_wait > 0)
-        _thecpu.console_wait--;
+    if (machine->idle.countdown > 0)
+    {
+        machine->idle.countdown--;
+        return;
+    }
 
-    if (_thecpu.timer == 0)
+    if (!machine->idle.armed)
     {
-        machine_execute_interrupt_do(XSM_INTERRUPT_TIMER);
-        _thecpu.timer = _theoptions.timer;
+        machine->idle.armed = TRUE;
+        machine->idle.armed_cycles = machine->cpu.cycles;
+        machine->idle.armed_writes = machine->idle.writes;
+        memcpy(machine->idle.armed_regs, machine->cpu.regs, sizeof(machine->idle.armed_regs));
+        return;
     }
-    else if (_thecpu.disk_state == XSM_DISK_BUSY)
+
+    machine->idle.armed = FALSE;
+
+    if (machine->idle.writes != machine->idle.armed_writes || memcmp(machine->idle.armed_regs, machine->cpu.regs, sizeof(machine->idle.armed_regs)))
     {
-        if (_thecpu.disk_wait == 0)
-        {
-            if (_thecpu.disk_op.operation == XSM_DISKOP_LOAD)
-            {
-                machine_execute_load_do(_thecpu.disk_op.dest_page, _thecpu.disk_op.src_block);
-                machine_execute_interrupt_do(XSM_INTERRUPT_DISK);
-            }
-            else if (_thecpu.disk_op.operation == XSM_DISKOP_STORE)
-            {
-                machine_execute_store_do(_thecpu.disk_op.dest_page, _thecpu.disk_op.src_block);
-                machine_execute_interrupt_do(XSM_INTERRUPT_DISK);
-            }
-
-            _thecpu.disk_state = XSM_DISK_IDLE;
-        }
+        /* The loop does some work, look again later */
+        if (machine->idle.backoff < XSM_IDLE_MAX_BACKOFF)
+            machine->idle.backoff *= 2;
+
+        machine->idle.countdown = machine->idle.backoff;
+        return;
     }
-    else if (_thecpu.console_state == XSM_CONSOLE_BUSY)
+
+    machine->idle.backoff = 1;
+    next_time = event_next_time(machine);
+
+    /* Nothing will ever end the loop */
+    if (next_time == XSM_EVENT_NEVER)
+        return;
+
+    /* Stop short of the iteration in which the next event becomes due */
+    length = machine->cpu.cycles - machine->idle.armed_cycles;
+    skip = (next_time - 1 - machine->cpu.cycles) / length;
+
+    if (skip > 0)
+        machine->cpu.cycles += skip * length;
+}
+
+/* Complete the device operation of the given event and raise its interrupt */
+void machine_fire_event(xsm_machine *machine, xsm_event *event)
+{
+    xsm_word *dest_port;
+
+    switch (event->type)
     {
-        if (_thecpu.console_wait == 0)
+    case XSM_EVENT_TIMER:
+        machine_execute_interrupt_do(machine, XSM_INTERRUPT_TIMER);
+        machine_schedule_timer(machine);
+        break;
+
+    case XSM_EVENT_DISK:
+        if (event->disk_op.operation == XSM_DISKOP_LOAD)
         {
-            if (_thecpu.console_op.operation == XSM_CONSOLE_PRINT)
-            {
-                machine_execute_print_do(&_thecpu.console_op.word);
-                machine_execute_interrupt_do(XSM_INTERRUPT_CONSOLE);
-            }
-            else if (_thecpu.console_op.operation == XSM_CONSOLE_READ)
-            {
-                machine_execute_in_do(&_thecpu.console_op.word);
-                dest_port = registers_get_register("P0");
-                word_copy(dest_port, &_thecpu.console_op.word);
-                machine_execute_interrupt_do(XSM_INTERRUPT_CONSOLE);
-            }
-
-            _thecpu.console_state = XSM_CONSOLE_IDLE;
+            machine_execute_load_do(machine, event->disk_op.dest_page, event->disk_op.src_block);
+            machine_execute_interrupt_do(machine, XSM_INTERRUPT_DISK);
         }
+        else if (event->disk_op.operation == XSM_DISKOP_STORE)
+        {
+            machine_execute_store_do(machine, event->disk_op.dest_page, event->disk_op.src_block);
+            machine_execute_interrupt_do(machine, XSM_INTERRUPT_DISK);
+        }
+        break;
+
+    case XSM_EVENT_CONSOLE:
+        if (event->console_op.operation == XSM_CONSOLE_PRINT)
+        {
+            machine_execute_print_do(machine, &event->console_op.word);
+            machine_execute_interrupt_do(machine, XSM_INTERRUPT_CONSOLE);
+        }
+        else if (event->console_op.operation == XSM_CONSOLE_READ)
+        {
+            machine_execute_in_do(machine, &event->console_op.word);
+            dest_port = &machine->cpu.regs[P0];
+            word_copy(dest_port, &event->console_op.word);
+            machine_execute_interrupt_do(machine, XSM_INTERRUPT_CONSOLE);
+        }
+        break;
+
+    case XSM_EVENT_FORK:
+        if (machine->options.fork_server)
+        {
+            machine->options.fork_server = FALSE;
+            forkserver_serve(machine);
+        }
+        break;
     }
 }
 
+/* Schedule the next timer interrupt */
+int machine_schedule_timer(xsm_machine *machine)
+{
+    xsm_event event;
+
+    /* The timer is disabled */
+    if (machine->options.timer <= 0)
+        return XSM_SUCCESS;
+
+    event.type = XSM_EVENT_TIMER;
+    event.time = machine->cpu.cycles + machine->options.timer;
+
+    return event_schedule(machine, &event);
+}
+
+/* Schedule the point at which the fork server starts */
+int machine_schedule_fork(xsm_machine *machine)
+{
+    xsm_event event;
+
+    if (!machine->options.fork_server || !machine->options.fork_at)
+        return XSM_SUCCESS;
+
+    event.type = XSM_EVENT_FORK;
+    event.time = machine->options.fork_at;
+
+    return event_schedule(machine, &event);
+}
+
 /* Call the function based on the given opcode */
-int machine_execute_instruction(int opcode)
+int machine_execute_instruction(xsm_machine *machine, xsm_instruction *instr)
 {
+    int opcode = instr->opcode;
+
+    if (instr->error)
+        machine_register_exception(machine, instr->error, EXP_ILLINSTR);
+
     switch (opcode)
     {
     case MOV:
     case PORT:
-        machine_execute_mov();
+        machine_execute_mov(machine, instr);
         break;
 
     case ADD:
@@ -398,12 +1112,12 @@ int machine_execute_instruction(int opcode)
     case MUL:
     case DIV:
     case MOD:
-        machine_execute_arith(opcode);
+        machine_execute_arith(machine, instr);
         break;
 
     case INR:
     case DCR:
-        machine_execute_unary(opcode);
+        machine_execute_unary(machine, instr);
         break;
 
     case LT:
@@ -412,74 +1126,74 @@ int machine_execute_instruction(int opcode)
     case NE:
     case GE:
     case LE:
-        machine_execute_logical(opcode);
+        machine_execute_logical(machine, instr);
         break;
 
     case JZ:
     case JNZ:
     case JMP:
-        machine_execute_jump(opcode);
+        machine_execute_jump(machine, instr);
         break;
 
     case PUSH:
     case POP:
-        machine_execute_stack(opcode);
+        machine_execute_stack(machine, instr);
         break;
 
     case CALL:
-        machine_execute_call();
+        machine_execute_call(machine, instr);
         break;
 
     case RET:
-        machine_execute_ret();
+        machine_execute_ret(machine);
         break;
 
     case BRKP:
-        machine_execute_brkp();
+        machine_execute_brkp(machine);
         break;
 
     case INT:
-        machine_execute_interrupt();
+        machine_execute_interrupt(machine, instr);
         break;
 
     case LOAD:
-        machine_execute_disk(XSM_DISKOP_LOAD, FALSE);
+        machine_execute_disk(machine, instr, XSM_DISKOP_LOAD, FALSE);
         break;
 
     case LOADI:
-        machine_execute_disk(XSM_DISKOP_LOAD, TRUE);
+        machine_execute_disk(machine, instr, XSM_DISKOP_LOAD, TRUE);
         break;
 
     case STORE:
-        machine_execute_disk(XSM_DISKOP_STORE, FALSE);
+        machine_execute_disk(machine, instr, XSM_DISKOP_STORE, FALSE);
         break;
 
     case ENCRYPT:
-        machine_execute_encrypt();
+        machine_execute_encrypt(machine, instr);
         break;
 
     case BACKUP:
-        machine_execute_backup();
+        machine_execute_backup(machine);
         break;
 
     case RESTORE:
-        machine_execute_restore();
+        machine_execute_restore(machine);
         break;
 
     case IN:
-        machine_schedule_in(_theoptions.console);
+        machine_schedule_in(machine, machine->options.console);
         break;
 
     case INI:
-        machine_execute_ini();
+        machine_execute_ini(machine);
         break;
 
     case OUT:
-        machine_execute_print();
+        machine_execute_print(machine);
         break;
 
     case IRET:
-        machine_execute_iret();
+        machine_execute_iret(machine);
         break;
 
     case HALT:
@@ -493,186 +1207,228 @@ int machine_execute_instruction(int opcode)
     return TRUE;
 }
 
-/* Returns the word stored in the instruction */
-xsm_word *machine_get_address(int write)
+/* Returns the word referred by the operand */
+xsm_word *machine_get_address(xsm_machine *machine, xsm_operand *operand, int write)
 {
-    int address = machine_get_address_int(write);
-    return machine_memory_get_word(address);
+    int address = machine_get_address_int(machine, operand, write);
+    xsm_word *word = machine_memory_get_word(machine, address);
+
+    /* Writes are seen by machine_notify_write(machine, address) */
+    if (!write && machine->options.debug)
+        debug_watch_access(machine, address, address, DEBUG_WATCH_READ);
+
+    return word;
 }
 
-/* Returns the address in the instruction */
-int machine_get_address_int(int write)
+/* Returns the address referred by the operand */
+int machine_get_address_int(xsm_machine *machine, xsm_operand *operand, int write)
 {
-    int token, address, ret_addr;
-    YYSTYPE token_info;
-
-    /* Skip the opening square bracket */
-    tokenize_next_token(&token_info);
-    token = tokenize_next_token(&token_info);
+    int address, ret_addr;
+    xsm_word *reg;
 
-    switch (token)
+    switch (operand->type)
     {
-    case TOKEN_REGISTER:
-        address = registers_get_integer(token_info.str);
+    case XSM_OPERAND_DREF_REGISTER:
+        reg = registers_get_register_by_code(machine, operand->val);
+
+        if (!reg)
+            machine_register_exception(machine, "Invalid memory derefence", EXP_ILLINSTR);
+
+        address = word_get_integer(reg);
         break;
 
-    case TOKEN_NUMBER:
-        address = token_info.val;
+    case XSM_OPERAND_DREF_NUMBER:
+        address = operand->val;
         break;
 
     default:
-        machine_register_exception("Invalid memory derefence", EXP_ILLINSTR);
+        machine_register_exception(machine, "Invalid memory derefence", EXP_ILLINSTR);
     }
 
-    /* Neglect the closing bracket */
-    tokenize_next_token(&token_info);
-
-    ret_addr = machine_translate_address(address, write, OPER_FETCH, machine_get_mode());
+    ret_addr = machine_translate_address(machine, address, write, OPER_FETCH, machine_get_mode(machine));
     return ret_addr;
 }
 
 /* Translate the logical address */
-int machine_translate_address(int address, int write, int type, int mode)
+int machine_translate_address(xsm_machine *machine, int address, int write, int type, int mode)
 {
     int ptbr, ptlr, ret_addr, curr_ip;
 
     if (mode == PRIVILEGE_KERNEL)
         return address;
 
-    ptbr = word_get_integer(registers_get_register("PTBR"));
-    ptlr = word_get_integer(registers_get_register("PTLR"));
-    ret_addr = memory_translate_address(ptbr, ptlr, address, write);
+    ptbr = word_get_integer(&machine->cpu.regs[PTBR]);
+    ptlr = word_get_integer(&machine->cpu.regs[PTLR]);
+    ret_addr = memory_translate_address(machine, ptbr, ptlr, address, write);
 
     if (ret_addr < 0 && type == DEBUG_FETCH)
         return ret_addr;
 
     if (ret_addr < 0 && type == INSTR_FETCH)
     {
-        curr_ip = word_get_integer(machine_get_ipreg());
+        curr_ip = word_get_integer(machine_get_ipreg(machine));
         curr_ip = curr_ip + XSM_INSTRUCTION_SIZE;
-        word_store_integer(machine_get_ipreg(), curr_ip);
+        word_store_integer(machine_get_ipreg(machine), curr_ip);
     }
 
     if (XSM_MEM_NOWRITE == ret_addr)
     {
-        exception_set_ma(address);
-        machine_register_exception("Access violation", EXP_ILLMEM);
+        exception_set_ma(machine, address);
+        machine_register_exception(machine, "Access violation", EXP_ILLMEM);
     }
 
     else if (XSM_MEM_PAGEFAULT == ret_addr)
     {
-        exception_set_epn(memory_addr_page(address));
-        machine_register_exception("Page fault", EXP_PAGEFAULT);
+        exception_set_epn(machine, memory_addr_page(address));
+        machine_register_exception(machine, "Page fault", EXP_PAGEFAULT);
     }
 
     else if (XSM_MEM_ILLPAGE == ret_addr)
     {
-        exception_set_ma(address);
-        machine_register_exception("Address outside logical address space", EXP_ILLMEM);
+        exception_set_ma(machine, address);
+        machine_register_exception(machine, "Address outside logical address space", EXP_ILLMEM);
     }
 
     return ret_addr;
 }
 
 /* Retrieve the word in the given address from memory */
-xsm_word *machine_memory_get_word(int address)
+xsm_word *machine_memory_get_word(xsm_machine *machine, int address)
 {
-    xsm_word *result = memory_get_word(address);
+    xsm_word *result = memory_get_word(machine, address);
 
     if (result == NULL)
     {
-        exception_set_ma(address);
-        machine_register_exception("Illegal memory access", EXP_ILLMEM);
+        exception_set_ma(machine, address);
+        machine_register_exception(machine, "Illegal memory access", EXP_ILLMEM);
     }
 
     return result;
 }
 
+/* Drop the state derived from the word at the given address */
+void machine_notify_write(xsm_machine *machine, int address)
+{
+    if (machine->options.trace)
+        trace_write(machine, address);
+
+    if (machine->options.debug)
+    {
+        history_write(machine, address);
+        debug_watch_access(machine, address, address, DEBUG_WATCH_WRITE);
+    }
+
+    machine->idle.writes++;
+    decode_invalidate(machine, address);
+    jit_invalidate(machine, address);
+
+    /* A user block must not run on past a change to its page table */
+    if (memory_tlb_invalidate(machine, address) && machine_get_mode(machine) == PRIVILEGE_USER)
+        jit_request_exit(machine);
+}
+
+/* Drop the state derived from the words in the given page */
+void machine_notify_page_write(xsm_machine *machine, int page)
+{
+    if (machine->options.trace)
+        trace_page(machine, page);
+
+    if (machine->options.debug)
+    {
+        history_page_write(machine, page);
+        debug_watch_access(machine, page * XSM_PAGE_SIZE, (page + 1) * XSM_PAGE_SIZE - 1, DEBUG_WATCH_WRITE);
+    }
+
+    machine->idle.writes++;
+    decode_invalidate_page(machine, page);
+    jit_invalidate_page(machine, page);
+
+    if (memory_tlb_invalidate_page(machine, page) && machine_get_mode(machine) == PRIVILEGE_USER)
+        jit_request_exit(machine);
+}
+
 /* Execute MOV/PORT instructions */
-int machine_execute_mov()
+int machine_execute_mov(xsm_machine *machine, xsm_instruction *instr)
 {
-    int token, mem_write_addr;
+    int address;
     xsm_word *l_address, *r_address;
-    YYSTYPE token_info;
+    xsm_operand *left, *right;
 
-    token = tokenize_peek(&token_info);
+    left = &instr->operands[0];
+    right = &instr->operands[1];
+    address = -1;
 
-    switch (token)
+    switch (left->type)
     {
-    case TOKEN_DREF_L:
-        _thecpu.mem_left = machine_get_address_int(TRUE);
-        _thecpu.mem_right = _thecpu.mem_right;
-        l_address = machine_memory_get_word(_thecpu.mem_left);
+    case XSM_OPERAND_DREF_REGISTER:
+    case XSM_OPERAND_DREF_NUMBER:
+        address = machine_get_address_int(machine, left, TRUE);
+        l_address = machine_memory_get_word(machine, address);
         break;
 
-    case TOKEN_REGISTER:
-        l_address = machine_get_register(token_info.str);
-        token = tokenize_next_token(&token_info);
+    case XSM_OPERAND_REGISTER:
+        l_address = machine_get_register(machine, left->val);
         break;
-    }
-
-    token = tokenize_next_token(&token_info);
 
-    if (token != TOKEN_COMMA)
-        machine_register_exception("Malformed instruction", EXP_ILLINSTR);
-
-    token = tokenize_peek(&token_info);
+    default:
+        machine_register_exception(machine, "Malformed instruction", EXP_ILLINSTR);
+    }
 
-    switch (token)
+    switch (right->type)
     {
-    case TOKEN_DREF_L:
-        r_address = machine_get_address(FALSE);
+    case XSM_OPERAND_DREF_REGISTER:
+    case XSM_OPERAND_DREF_NUMBER:
+        r_address = machine_get_address(machine, right, FALSE);
         word_copy(l_address, r_address);
         break;
 
-    case TOKEN_REGISTER:
-        r_address = machine_get_register(token_info.str);
+    case XSM_OPERAND_REGISTER:
+        r_address = machine_get_register(machine, right->val);
         word_copy(l_address, r_address);
-        tokenize_next_token(&token_info);
         break;
 
-    case TOKEN_NUMBER:
-        word_store_integer(l_address, token_info.val);
-        tokenize_next_token(&token_info);
+    case XSM_OPERAND_NUMBER:
+        word_store_integer(l_address, right->val);
         break;
 
-    case TOKEN_STRING:
-        word_store_string(l_address, token_info.str);
-        tokenize_next_token(&token_info);
+    case XSM_OPERAND_STRING:
+        word_store_string(l_address, right->str);
         break;
     }
 
+    /* Only once the right operand could be read has the word been written */
+    if (address >= 0)
+        machine_notify_write(machine, address);
+
     return XSM_SUCCESS;
 }
 
 /* Execute arithmetic instructions */
-int machine_execute_arith(int opcode)
+int machine_execute_arith(xsm_machine *machine, xsm_instruction *instr)
 {
-    int result, token, l_value, r_value;
+    int result, l_value, r_value;
     xsm_reg *l_operand, *r_operand;
-    YYSTYPE token_info;
-
-    token = tokenize_next_token(&token_info);
+    xsm_operand *right;
 
-    if (token != TOKEN_REGISTER)
-        machine_register_exception("Wrong operand", EXP_ILLINSTR);
+    if (instr->operands[0].type != XSM_OPERAND_REGISTER)
+        machine_register_exception(machine, "Wrong operand", EXP_ILLINSTR);
 
-    l_operand = machine_get_register(token_info.str);
+    l_operand = machine_get_register(machine, instr->operands[0].val);
     l_value = word_get_integer(l_operand);
 
-    /* Neglect comma */
-    tokenize_next_token(&token_info);
-    token = tokenize_next_token(&token_info);
+    right = &instr->operands[1];
 
-    if (token == TOKEN_NUMBER)
-        r_value = token_info.val;
-    else
+    if (right->type == XSM_OPERAND_NUMBER)
+        r_value = right->val;
+    else if (right->type == XSM_OPERAND_REGISTER)
     {
-        r_operand = machine_get_register(token_info.str);
+        r_operand = machine_get_register(machine, right->val);
         r_value = word_get_integer(r_operand);
     }
+    else
+        machine_register_exception(machine, "Wrong operand", EXP_ILLINSTR);
 
-    switch (opcode)
+    switch (instr->opcode)
     {
     case ADD:
         result = r_value + l_value;
@@ -688,13 +1444,13 @@ int machine_execute_arith(int opcode)
 
     case DIV:
         if (r_value == 0)
-            machine_register_exception("Integer division by zero", EXP_ARITH);
+            machine_register_exception(machine, "Integer division by zero", EXP_ARITH);
         result = l_value / r_value;
         break;
 
     case MOD:
         if (r_value == 0)
-            machine_register_exception("Integer modulo by zero", EXP_ARITH);
+            machine_register_exception(machine, "Integer modulo by zero", EXP_ARITH);
         result = l_value % r_value;
         break;
     }
@@ -704,18 +1460,19 @@ int machine_execute_arith(int opcode)
 }
 
 /* Execute unary instructions */
-int machine_execute_unary(int opcode)
+int machine_execute_unary(xsm_machine *machine, xsm_instruction *instr)
 {
-    int token, val;
-    YYSTYPE token_info;
+    int val;
     xsm_word *arg_reg;
 
-    token = tokenize_next_token(&token_info);
-    arg_reg = machine_get_register(token_info.str);
+    if (instr->operands[0].type != XSM_OPERAND_REGISTER)
+        machine_register_exception(machine, "Wrong operand", EXP_ILLINSTR);
+
+    arg_reg = machine_get_register(machine, instr->operands[0].val);
 
     val = word_get_integer(arg_reg);
 
-    switch (opcode)
+    switch (instr->opcode)
     {
     case INR:
         val = val + 1;
@@ -731,27 +1488,20 @@ int machine_execute_unary(int opcode)
 }
 
 /* Execute logical instructions */
-int machine_execute_logical(int opcode)
+int machine_execute_logical(xsm_machine *machine, xsm_instruction *instr)
 {
     xsm_word *src_left_reg, *src_right_reg;
-    int token;
-    YYSTYPE token_info;
+    int opcode = instr->opcode;
 
     int result, val_left, val_right;
 
-    token = tokenize_next_token(&token_info);
-    src_left_reg = machine_get_register(token_info.str);
-
-    /* Comma */
-    token = tokenize_next_token(&token_info);
-
-    if (TOKEN_COMMA != token)
+    if (instr->operands[0].type != XSM_OPERAND_REGISTER || instr->operands[1].type != XSM_OPERAND_REGISTER)
     {
-        machine_register_exception("Incorrect logical instruction.", EXP_ILLINSTR);
+        machine_register_exception(machine, "Incorrect logical instruction.", EXP_ILLINSTR);
     }
 
-    token = tokenize_next_token(&token_info);
-    src_right_reg = machine_get_register(token_info.str);
+    src_left_reg = machine_get_register(machine, instr->operands[0].val);
+    src_right_reg = machine_get_register(machine, instr->operands[1].val);
 
     /* String operation */
     if (word_get_unix_type(src_left_reg) == XSM_TYPE_STRING || word_get_unix_type(src_right_reg) == XSM_TYPE_STRING)
@@ -824,81 +1574,81 @@ int machine_execute_logical(int opcode)
 }
 
 /* Execute jump instructions */
-int machine_execute_jump(int opcode)
+int machine_execute_jump(xsm_machine *machine, xsm_instruction *instr)
 {
-    int test, target, token;
-    YYSTYPE token_info;
+    int test, target, opcode;
+    xsm_word *reg;
+    xsm_operand *target_op;
 
-    token = tokenize_next_token(&token_info);
+    opcode = instr->opcode;
+    target_op = &instr->operands[instr->num_operands - 1];
 
-    if (token == TOKEN_NUMBER)
-    {
+    if (opcode == JMP)
         test = TRUE;
-        target = token_info.val;
-    }
     else
     {
+        if (instr->operands[0].type != XSM_OPERAND_REGISTER)
+            machine_register_exception(machine, "Wrong operand", EXP_ILLINSTR);
+
+        reg = machine_get_register(machine, instr->operands[0].val);
+
         // String content is true
-        if (word_get_unix_type(machine_get_register(token_info.str)) == XSM_TYPE_STRING)
+        if (word_get_unix_type(reg) == XSM_TYPE_STRING)
             test = 1;
         else
-            test = word_get_integer(machine_get_register(token_info.str));
-
-        /* Skip the comma */
-        tokenize_next_token(&token_info);
-        token = tokenize_next_token(&token_info);
-        target = token_info.val;
+            test = word_get_integer(reg);
     }
 
+    if (target_op->type != XSM_OPERAND_NUMBER)
+        machine_register_exception(machine, "Wrong operand", EXP_ILLINSTR);
+
+    target = target_op->val;
+
     if (JZ == opcode)
         test = !test;
 
     // Unconditional jump
     if (test)
-        word_store_integer(registers_get_register("IP"), target);
+        word_store_integer(machine_get_ipreg(machine), target);
 
     return XSM_SUCCESS;
 }
 
 /* Execute PUSH/POP instructions */
-int machine_execute_stack(int opcode)
+int machine_execute_stack(xsm_machine *machine, xsm_instruction *instr)
 {
-    int token;
     xsm_word *reg;
-    YYSTYPE token_info;
 
-    token = tokenize_next_token(&token_info);
-
-    if (token == TOKEN_REGISTER)
-        reg = machine_get_register(token_info.str);
+    if (instr->operands[0].type == XSM_OPERAND_REGISTER)
+        reg = machine_get_register(machine, instr->operands[0].val);
     else
-        machine_register_exception("Stack instructions require a register as argument", EXP_ILLINSTR);
+        machine_register_exception(machine, "Stack instructions require a register as argument", EXP_ILLINSTR);
 
-    switch (opcode)
+    switch (instr->opcode)
     {
     case PUSH:
-        return machine_push_do(reg);
+        return machine_push_do(machine, reg);
 
     case POP:
-        return machine_pop_do(reg);
+        return machine_pop_do(machine, reg);
     }
 
     return XSM_SUCCESS;
 }
 
 /* Execute PUSH instruction */
-int machine_push_do(xsm_word *reg)
+int machine_push_do(xsm_machine *machine, xsm_word *reg)
 {
     int stack_top;
     xsm_word *xw_stack_top, *sp_reg;
 
     /* Update SP */
-    sp_reg = machine_get_spreg();
+    sp_reg = machine_get_spreg(machine);
     stack_top = word_get_integer(sp_reg);
     word_store_integer(sp_reg, stack_top + 1);
 
     /* Get the new stack pointer */
-    xw_stack_top = machine_stack_pointer(TRUE);
+    xw_stack_top = machine_stack_pointer(machine, TRUE);
 
     /* Put the word on the top of stack */
     word_copy(xw_stack_top, reg);
@@ -906,14 +1656,14 @@ int machine_push_do(xsm_word *reg)
 }
 
 /* Execute POP instruction */
-int machine_pop_do(xsm_word *dest)
+int machine_pop_do(xsm_machine *machine, xsm_word *dest)
 {
     int stack_top;
     xsm_word *xw_stack_top, *sp_reg;
 
     /* Get the stack pointer */
-    xw_stack_top = machine_stack_pointer(FALSE);
-    sp_reg = machine_get_spreg();
+    xw_stack_top = machine_stack_pointer(machine, FALSE);
+    sp_reg = machine_get_spreg(machine);
     stack_top = word_get_integer(sp_reg);
 
     /* Copy the word from the top of stack */
@@ -925,36 +1675,39 @@ int machine_pop_do(xsm_word *dest)
 }
 
 /* Retrieve the word pointed by SP */
-xsm_word *machine_stack_pointer(int write)
+xsm_word *machine_stack_pointer(xsm_machine *machine, int write)
 {
     int stack_top;
-    xsm_word *sp_reg = machine_get_spreg();
+    xsm_word *stack_word, *sp_reg = machine_get_spreg(machine);
 
     stack_top = word_get_integer(sp_reg);
-    stack_top = machine_translate_address(stack_top, write, OPER_FETCH, machine_get_mode());
+    stack_top = machine_translate_address(machine, stack_top, write, OPER_FETCH, machine_get_mode(machine));
+    stack_word = machine_memory_get_word(machine, stack_top);
 
     if (write)
-        _thecpu.mem_left = stack_top;
+        machine_notify_write(machine, stack_top);
+    else if (machine->options.debug)
+        debug_watch_access(machine, stack_top, stack_top, DEBUG_WATCH_READ);
 
-    return machine_memory_get_word(stack_top);
+    return stack_word;
 }
 
 /* Execute CALL target instruction */
-int machine_execute_call_do(int target)
+int machine_execute_call_do(xsm_machine *machine, int target)
 {
     int curr_ip, curr_sp;
     xsm_word *ipreg, *spreg, *stack_pointer;
 
     /* Increment SP. */
-    spreg = machine_get_spreg();
+    spreg = machine_get_spreg(machine);
     curr_sp = word_get_integer(spreg);
     curr_sp = curr_sp + 1;
     word_store_integer(spreg, curr_sp);
 
     /* Save IP onto the stack. */
-    ipreg = machine_get_ipreg();
+    ipreg = machine_get_ipreg(machine);
     curr_ip = word_get_integer(ipreg);
-    stack_pointer = machine_stack_pointer(TRUE);
+    stack_pointer = machine_stack_pointer(machine, TRUE);
     word_store_integer(stack_pointer, curr_ip);
 
     /* Update IP to the new code location. */
@@ -963,87 +1716,119 @@ int machine_execute_call_do(int target)
 }
 
 /* Execute CALL instruction */
-int machine_execute_call()
+int machine_execute_call(xsm_machine *machine, xsm_instruction *instr)
 {
-    int token, target;
-    YYSTYPE token_info;
-
-    token = tokenize_next_token(&token_info);
+    int target;
+    xsm_operand *operand = &instr->operands[0];
 
-    if (token == TOKEN_NUMBER)
-        target = token_info.val;
+    if (operand->type == XSM_OPERAND_NUMBER)
+        target = operand->val;
+    else if (operand->type == XSM_OPERAND_REGISTER)
+        target = word_get_integer(machine_get_register(machine, operand->val));
     else
-        target = word_get_integer(machine_get_register(token_info.str));
+        machine_register_exception(machine, "Wrong operand", EXP_ILLINSTR);
+
+    machine_execute_call_do(machine, target);
+
+    if (machine->options.profile)
+        profile_call(machine, target);
 
-    return machine_execute_call_do(target);
+    return XSM_SUCCESS;
 }
 
 /* Execute RET instruction */
-int machine_execute_ret()
+int machine_execute_ret(xsm_machine *machine)
 {
     int target, curr_sp;
     xsm_word *spreg, *ipreg;
     xsm_word *stack_pointer;
 
-    spreg = machine_get_spreg();
-    stack_pointer = machine_stack_pointer(FALSE);
+    spreg = machine_get_spreg(machine);
+    stack_pointer = machine_stack_pointer(machine, FALSE);
     target = word_get_integer(stack_pointer);
 
     curr_sp = word_get_integer(spreg);
     curr_sp = curr_sp - 1;
     word_store_integer(spreg, curr_sp);
 
-    ipreg = machine_get_ipreg();
+    ipreg = machine_get_ipreg(machine);
     word_store_integer(ipreg, target);
 
+    if (machine->options.profile)
+        profile_ret(machine);
+
     return XSM_SUCCESS;
 }
 
 /* Execute BRKP instruction */
-int machine_execute_brkp()
+int machine_execute_brkp(xsm_machine *machine)
 {
+    /* Save the machine at the first breakpoint */
+    if (machine->options.save_snapshot)
+    {
+        if (!snapshot_save(machine, machine->options.save_snapshot))
+            fprintf(stderr, "Could not save the snapshot to %s\n", machine->options.save_snapshot);
+
+        machine->options.save_snapshot = NULL;
+    }
+
+    /* Boot is done, every run continues from here */
+    if (machine->options.fork_server && !machine->options.fork_at)
+    {
+        machine->options.fork_server = FALSE;
+        forkserver_serve(machine);
+    }
+
     /* If debug mode is not enabled, neglect this instruction. */
-    if (!_theoptions.debug)
+    if (!machine->options.debug)
         return XSM_SUCCESS;
 
     // Activate debugger
-    debug_activate();
+    debug_activate(machine);
 
     return XSM_SUCCESS;
 }
 
 /* Execute INT instruction */
-int machine_execute_interrupt()
+int machine_execute_interrupt(xsm_machine *machine, xsm_instruction *instr)
 {
-    int token, interrupt_num;
-    YYSTYPE token_info;
+    int interrupt_num;
 
-    token = tokenize_next_token(&token_info);
-    interrupt_num = token_info.val;
+    if (instr->operands[0].type != XSM_OPERAND_NUMBER)
+        machine_register_exception(machine, "Invalid interrupt number", EXP_ILLINSTR);
+
+    interrupt_num = instr->operands[0].val;
 
     if (interrupt_num < INTERRUPT_LOW || interrupt_num > INTERRUPT_HIGH)
-        machine_register_exception("Invalid interrupt number", EXP_ILLINSTR);
+        machine_register_exception(machine, "Invalid interrupt number", EXP_ILLINSTR);
 
-    return machine_execute_interrupt_do(interrupt_num);
+    return machine_execute_interrupt_do(machine, interrupt_num);
 }
 
 /* Execute INT interrupt instruction */
-int machine_execute_interrupt_do(int interrupt)
+int machine_execute_interrupt_do(xsm_machine *machine, int interrupt)
 {
     int target;
 
-    if (machine_get_mode() == PRIVILEGE_KERNEL)
-        machine_register_exception("Invoking interrupts in kernel mode not allowed", EXP_ILLINSTR);
+    if (machine_get_mode(machine) == PRIVILEGE_KERNEL)
+        machine_register_exception(machine, "Invoking interrupts in kernel mode not allowed", EXP_ILLINSTR);
 
     target = machine_interrupt_address(interrupt);
 
+    /* The loop being watched, if any, has been left */
+    machine_idle_reset(machine);
+
     if (interrupt != XSM_INTERRUPT_EXHANDLER)
-        machine_execute_call_do(target);
+        machine_execute_call_do(machine, target);
     else
-        word_store_integer(machine_get_ipreg(), target);
+        word_store_integer(machine_get_ipreg(machine), target);
 
     /* Change the mode now, that will do. */
-    machine_set_mode(PRIVILEGE_KERNEL);
+    machine_set_mode(machine, PRIVILEGE_KERNEL);
+
+    if (machine->options.profile)
+        profile_interrupt(machine, interrupt);
+
     return XSM_SUCCESS;
 }
 
@@ -1057,96 +1842,100 @@ int machine_interrupt_address(int int_num)
 }
 
 /* Execute LOAD/STORE instructions */
-int machine_execute_disk(int operation, int immediate)
+int machine_execute_disk(xsm_machine *machine, xsm_instruction *instr, int operation, int immediate)
 {
     int page_num, block_num;
-    xsm_word *page_base;
 
-    page_num = machine_read_disk_arg();
+    page_num = machine_read_disk_arg(machine, &instr->operands[0]);
     if (page_num <= 0 || page_num >= XSM_MEMORY_NUMPAGES)
-        machine_register_exception("Invalid page number for disk instruction", EXP_ILLINSTR);
-
-    /* Neglect comma */
-    tokenize_skip_token();
+        machine_register_exception(machine, "Invalid page number for disk instruction", EXP_ILLINSTR);
 
-    block_num = machine_read_disk_arg();
+    block_num = machine_read_disk_arg(machine, &instr->operands[1]);
     if (block_num < 0 || block_num >= XSM_DISK_BLOCK_NUM)
-        machine_register_exception("Invalid block number for disk instruction", EXP_ILLINSTR);
+        machine_register_exception(machine, "Invalid block number for disk instruction", EXP_ILLINSTR);
 
     if (immediate)
     {
         if (operation == XSM_DISKOP_LOAD)
-            return machine_execute_load_do(page_num, block_num);
+            return machine_execute_load_do(machine, page_num, block_num);
         else if (operation == XSM_DISKOP_STORE)
-            return machine_execute_store_do(page_num, block_num);
+            return machine_execute_store_do(machine, page_num, block_num);
     }
     else
-        return machine_schedule_disk(page_num, block_num, _theoptions.disk, operation);
+        return machine_schedule_disk(machine, page_num, block_num, machine->options.disk, operation);
 
     return XSM_SUCCESS;
 }
 
 /* Return the disk instruction arguments */
-int machine_read_disk_arg()
+int machine_read_disk_arg(xsm_machine *machine, xsm_operand *operand)
 {
-    int token;
     xsm_word *reg;
-    YYSTYPE token_info;
-
-    token = tokenize_next_token(&token_info);
 
-    if (token == TOKEN_NUMBER)
-        return token_info.val;
-    else if (token == TOKEN_REGISTER)
+    if (operand->type == XSM_OPERAND_NUMBER)
+        return operand->val;
+    else if (operand->type == XSM_OPERAND_REGISTER)
     {
-        reg = machine_get_register(token_info.str);
+        reg = machine_get_register(machine, operand->val);
         return word_get_integer(reg);
     }
     else
-        machine_register_exception("Wrong arguments for disk instruction", EXP_ILLINSTR);
+        machine_register_exception(machine, "Wrong arguments for disk instruction", EXP_ILLINSTR);
 
     return 0;
 }
 
 /* Schedule DISK_BUSY */
-int machine_schedule_disk(int page_num, int block_num, int firetime, int operation)
+int machine_schedule_disk(xsm_machine *machine, int page_num, int block_num, int firetime, int operation)
 {
+    xsm_event event;
+
     /* If the disk is busy, ignore the request */
-    if (_thecpu.disk_state == XSM_DISK_BUSY)
+    if (event_pending(machine, XSM_EVENT_DISK))
         return XSM_SUCCESS;
 
-    _thecpu.disk_state = XSM_DISK_BUSY;
-    _thecpu.disk_wait = firetime;
-    _thecpu.disk_op.src_block = block_num;
-    _thecpu.disk_op.dest_page = page_num;
-    _thecpu.disk_op.operation = operation;
+    event.type = XSM_EVENT_DISK;
+    event.time = machine->cpu.cycles + firetime;
+    event.disk_op.src_block = block_num;
+    event.disk_op.dest_page = page_num;
+    event.disk_op.operation = operation;
 
-    return XSM_SUCCESS;
+    return event_schedule(machine, &event);
 }
 
 /* Execute LOAD instruction */
-int machine_execute_load_do(int page_num, int block_num)
+int machine_execute_load_do(xsm_machine *machine, int page_num, int block_num)
 {
-    xsm_word *page_base = memory_get_page(page_num);
-    return disk_read_block(page_base, block_num);
+    xsm_word *page_base = memory_get_page(machine, page_num);
+
+    machine_notify_page_write(machine, page_num);
+    return disk_read_block(machine, page_base, block_num);
 }
 
 /* Execute STORE instruction */
-int machine_execute_store_do(int page_num, int block_num)
+int machine_execute_store_do(xsm_machine *machine, int page_num, int block_num)
 {
-    xsm_word *page_base = memory_get_page(page_num);
-    return disk_write_page(page_base, block_num);
+    xsm_word *page_base = memory_get_page(machine, page_num);
+
+    /* The whole page is read */
+    if (machine->options.debug)
+    {
+        history_block_write(machine, block_num);
+        debug_watch_access(machine, page_num * XSM_PAGE_SIZE, (page_num + 1) * XSM_PAGE_SIZE - 1, DEBUG_WATCH_READ);
+    }
+
+    return disk_write_page(machine, page_base, block_num);
 }
 
 /* Execute ENCRYPT instruction */
-int machine_execute_encrypt()
+int machine_execute_encrypt(xsm_machine *machine, xsm_instruction *instr)
 {
-    int token;
     xsm_word *reg;
-    YYSTYPE token_info;
 
-    token = tokenize_next_token(&token_info);
-    reg = machine_get_register(token_info.str);
+    if (instr->operands[0].type != XSM_OPERAND_REGISTER)
+        machine_register_exception(machine, "Wrong operand", EXP_ILLINSTR);
+
+    reg = machine_get_register(machine, instr->operands[0].val);
 
     /* Some very easy encryption */
     word_encrypt(reg);
@@ -1155,144 +1944,197 @@ int machine_execute_encrypt()
 }
 
 /* Execute BACKUP instruction */
-int machine_execute_backup()
+int machine_execute_backup(xsm_machine *machine)
 {
     int ireg;
-    char str_reg[5];
-    xsm_word *reg;
 
-    reg = registers_get_register("BP");
-    machine_push_do(reg);
+    machine_push_do(machine, &machine->cpu.regs[BP]);
 
-    for (ireg = 0; ireg < REG_COUNT; ++ireg)
-    {
-        sprintf(str_reg, "R%d", ireg);
-        reg = registers_get_register(str_reg);
-        machine_push_do(reg);
-    }
+    for (ireg = R0; ireg < R0 + REG_COUNT; ++ireg)
+        machine_push_do(machine, &machine->cpu.regs[ireg]);
 
     return XSM_SUCCESS;
 }
 
 /* Execute RESTORE instruction */
-int machine_execute_restore()
+int machine_execute_restore(xsm_machine *machine)
 {
     int ireg;
-    char str_reg[5];
-    xsm_word *reg;
 
-    for (ireg = REG_COUNT - 1; ireg >= 0; ireg--)
-    {
-        sprintf(str_reg, "R%d", ireg);
-        reg = registers_get_register(str_reg);
-        machine_pop_do(reg);
-    }
+    for (ireg = R0 + REG_COUNT - 1; ireg >= R0; ireg--)
+        machine_pop_do(machine, &machine->cpu.regs[ireg]);
 
-    reg = registers_get_register("BP");
-    machine_pop_do(reg);
+    machine_pop_do(machine, &machine->cpu.regs[BP]);
 
     return XSM_SUCCESS;
 }
 
 /* Execute OUT word instruction */
-int machine_execute_print_do(xsm_word *word)
+int machine_execute_print_do(xsm_machine *machine, xsm_word *word)
 {
     int type, val;
     char *str;
+    char number[XSM_WORD_SIZE];
 
     type = word_get_unix_type(word);
 
     if (type == XSM_TYPE_STRING)
-    {
         str = word_get_string(word);
-        fprintf(stdout, "%s\n", str);
-    }
     else
     {
         val = word_get_integer(word);
-        fprintf(stdout, "%d\n", val);
+        sprintf(number, "%d", val);
+        str = number;
     }
 
+    /* Printed already, before the debugger stepped back */
+    if (machine->history.replaying)
+        return XSM_SUCCESS;
+
+    if (machine->console.write)
+        machine->console.write(machine->console.data, str);
+    else
+        fprintf(stdout, "%s\n", str);
+
     return XSM_SUCCESS;
 }
 
 /* Execute OUT instruction */
-int machine_execute_print()
+int machine_execute_print(xsm_machine *machine)
 {
-    int val;
-    xsm_word *reg = registers_get_register("P1");
-    return machine_execute_print_do(reg);
+    return machine_execute_print_do(machine, &machine->cpu.regs[P1]);
 }
 
 /* Execute IN instruction */
-int machine_schedule_in(int firetime)
+int machine_schedule_in(xsm_machine *machine, int firetime)
 {
-    if (_thecpu.console_state == XSM_CONSOLE_BUSY)
+    xsm_event event;
+
+    if (event_pending(machine, XSM_EVENT_CONSOLE))
         return XSM_FAILURE;
 
-    _thecpu.console_op.operation = XSM_CONSOLE_READ;
-    _thecpu.console_state = XSM_CONSOLE_BUSY;
-    _thecpu.console_wait = firetime;
+    event.type = XSM_EVENT_CONSOLE;
+    event.time = machine->cpu.cycles + firetime;
+    event.console_op.operation = XSM_CONSOLE_READ;
 
-    return XSM_SUCCESS;
+    return event_schedule(machine, &event);
 }
 
 /* Execute INI instruction */
-int machine_execute_ini()
+int machine_execute_ini(xsm_machine *machine)
 {
     xsm_word *reg;
 
-    if (!_theoptions.debug)
+    if (!machine->options.debug)
         return XSM_SUCCESS;
 
-    reg = registers_get_register("P0");
-    return machine_execute_in_do(reg);
+    reg = &machine->cpu.regs[P0];
+    return machine_execute_in_do(machine, reg);
 }
 
 /* Execute IN word instruction */
-int machine_execute_in_do(xsm_word *word)
+int machine_execute_in_do(xsm_machine *machine, xsm_word *word)
 {
-    int i;
+    int i, ok;
     char input[XSM_WORD_SIZE];
 
-    fgets(input, XSM_WORD_SIZE, stdin);
+    /* Read already, before the debugger stepped back */
+    if (machine->options.debug && history_read_input(machine, input, &ok))
+        return word_store_string(word, input);
+
+    if (machine->replay.mode == REPLAY_PLAY)
+        ok = replay_read(machine, input, XSM_WORD_SIZE);
+    else if (machine->console.read)
+        ok = machine->console.read(machine->console.data, input, XSM_WORD_SIZE);
+    else
+        ok = fgets(input, XSM_WORD_SIZE, stdin) != NULL;
+
+    /* Nothing is left to read */
+    if (!ok)
+        input[0] = '\0';
 
     /* Kill the extra newline. */
     for (i = 0; i < XSM_WORD_SIZE; ++i)
         if (input[i] == '\n')
             input[i] = '\0';
 
+    if (machine->options.debug)
+        history_record_input(machine, input, ok);
+
+    replay_record(machine, input, ok);
     return word_store_string(word, input);
 }
 
 /* Execute IRET instruction */
-int machine_execute_iret()
+int machine_execute_iret(xsm_machine *machine)
 {
     xsm_word target, *ipreg;
 
-    machine_set_mode(PRIVILEGE_USER);
-    machine_pop_do(&target);
+    machine_set_mode(machine, PRIVILEGE_USER);
+    machine_pop_do(machine, &target);
 
-    ipreg = machine_get_ipreg();
+    ipreg = machine_get_ipreg(machine);
     word_copy(ipreg, &target);
+
+    if (machine->options.profile)
+        profile_iret(machine);
+
     return XSM_SUCCESS;
 }
 
 /* Returns the mode */
-int machine_get_mode()
+int machine_get_mode(xsm_machine *machine)
 {
-    return _thecpu.mode;
+    return machine->cpu.mode;
 }
 
 /* Set the mode */
-void machine_set_mode(int mode)
+void machine_set_mode(xsm_machine *machine, int mode)
+{
+    machine->cpu.mode = mode;
+}
+
+/* Returns the device clock */
+long long machine_get_cycles(xsm_machine *machine)
 {
-    _thecpu.mode = mode;
+    return machine->cpu.cycles;
+}
+
+/* Set the device clock */
+void machine_set_cycles(xsm_machine *machine, long long cycles)
+{
+    machine->cpu.cycles = cycles;
 }
 
 /* Deallocate the machine */
-void machine_destroy()
+void machine_destroy(xsm_machine *machine)
+{
+    if (machine->options.jit)
+        jit_destroy(machine);
+
+    if (machine->options.profile)
+        profile_destroy(machine);
+
+    if (machine->options.sample_hz)
+        sample_destroy(machine);
+
+    if (machine->options.trace)
+        trace_close(machine);
+
+    replay_close(machine);
+
+    if (machine->options.debug)
+        history_destroy(machine);
+
+    debug_destroy(machine);
+    tokenize_close(machine);
+    decode_destroy(machine);
+    memory_destroy(machine);
+    registers_destroy(machine);
+}
+
+/* Release a machine allocated by machine_create() */
+void machine_free(xsm_machine *machine)
 {
-    memory_destroy();
-    registers_destroy();
+    free(machine);
 }
\ No newline at end of file
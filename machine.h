@@ -4,12 +4,23 @@
 
 #include <setjmp.h>
 
+#include "breakpoint.h"
 #include "debug.h"
+#include "decode.h"
 #include "disk.h"
+#include "event.h"
 #include "exception.h"
+#include "forkserver.h"
+#include "history.h"
+#include "jit.h"
 #include "memory.h"
+#include "profile.h"
 #include "registers.h"
+#include "replay.h"
+#include "sample.h"
+#include "snapshot.h"
 #include "tokenize.h"
+#include "trace.h"
 #include "types.h"
 
 #define XSM_ADDR_DREF 0
@@ -77,94 +88,198 @@
 #define XSM_INTERRUPT_EXHANDLER 0
 #define XSM_HALT -1
 
-typedef struct _disk_operation
-{
-    int src_block;
-    int dest_page;
-    int operation;
-} disk_operation;
-
-typedef struct _console_operation
-{
-    xsm_word word;
-    int operation;
-} console_operation;
+/* Why the machine is no longer running */
+#define XSM_STATE_RUNNING 0
+#define XSM_STATE_HALTED 1
+#define XSM_STATE_ERROR 2
 
 typedef struct _xsm_cpu
 {
     xsm_reg *regs;
-    int timer;
     int mode;
-    int disk_state, disk_wait;
-    int console_state, console_wait;
 
-    int mem_left, mem_right;
+    /* Number of instructions executed in USER mode, the device clock */
+    long long cycles;
 
-    disk_operation disk_op;
-    console_operation console_op;
+    /* Set if the BRKP a loaded snapshot was saved in is yet to finish */
+    int resume;
+
+    /* One of XSM_STATE_* */
+    int state;
 
     /* Exception point */
     jmp_buf h_exp_point;
 } xsm_cpu;
 
+/* Longest wait between two looks at a loop that changes state */
+#define XSM_IDLE_MAX_BACKOFF 1024
+
+typedef struct _xsm_idle
+{
+    /* Target of the last backward jump, and IP after the last instruction */
+    int ip, last_ip;
+
+    /* Visits to the loop head left before it is looked at again */
+    int countdown, backoff;
+
+    /* Number of memory writes so far */
+    long long writes;
+
+    /* State at the loop head when it was armed */
+    int armed;
+    long long armed_cycles, armed_writes;
+    xsm_word armed_regs[XSM_NUM_REG];
+} xsm_idle;
+
 typedef struct _xsm_options
 {
     int timer;
     int debug;
     int disk;
     int console;
+    int disk_overlay;
+    int jit;
+    int threaded;
+
+    /* Snapshot saved at the first BRKP, and snapshot to start from */
+    char *save_snapshot;
+    char *load_snapshot;
+
+    /* Serve runs of the machine booted to the first BRKP, or to a device clock value */
+    int fork_server;
+    long long fork_at;
+
+    /* Count what runs and write PROFILE_* when the machine stops, folded call stacks to a file */
+    int profile;
+    char *folded;
+
+    /* Rate to sample the IP at, 0 for none */
+    int sample_hz;
+
+    /* File every instruction run is recorded in */
+    char *trace;
+
+    /* Log console input to a file, or read it back from one */
+    char *record_input;
+    char *replay_input;
+
+    /* Manifest of jobs to run in parallel instead, and the number of threads to run them on */
+    char *batch;
+    int workers;
 } xsm_options;
 
-int machine_init(xsm_options *options);
+/* Console devices of an embedded machine, the standard streams are used when unset */
+typedef struct _xsm_console
+{
+    /* Prints one word of output, without a newline */
+    void (*write)(void *data, const char *text);
+
+    /* Stores a line of at most size - 1 characters, returns FALSE at the end of input */
+    int (*read)(void *data, char *buffer, int size);
+
+    /* Reports the exception that stopped the machine */
+    void (*error)(void *data, const char *message);
+
+    void *data;
+} xsm_console;
+
+struct _xsm_machine
+{
+    xsm_cpu cpu;
+    xsm_options options;
+    xsm_idle idle;
+    xsm_console console;
+
+    xsm_memory memory;
+    xsm_registers registers;
+    xsm_disk disk;
+    xsm_exception exception;
+    xsm_event_queue queue;
+    xsm_decode_cache decode;
+    xsm_tokenizer tokens;
+    debug_status debug;
+    xsm_breakpoints breakpoints;
+    xsm_history history;
+    jit_state jit;
+    xsm_profile profile;
+    xsm_sampler sampler;
+    xsm_trace trace;
+    xsm_replay replay;
+
+    /* Message of the exception state read from a snapshot */
+    char snapshot_message[SNAPSHOT_MESSAGE_LEN];
+};
+
+xsm_machine *machine_create();
+int machine_init(xsm_machine *machine, xsm_options *options);
+int machine_load_snapshot(xsm_machine *machine, const char *filename);
 int machine_get_opcode(const char *instr);
-xsm_word *machine_get_ipreg();
-xsm_word *machine_get_spreg();
-xsm_word *machine_get_register(const char *name);
+const char *machine_get_opcode_name(int opcode);
+xsm_word *machine_get_ipreg(xsm_machine *machine);
+xsm_word *machine_get_spreg(xsm_machine *machine);
+xsm_word *machine_get_register(xsm_machine *machine, int code);
 int machine_instr_req_privilege(int opcode);
-int machine_serve_instruction(char *buffer, unsigned long *read_bytes, int max);
-int machine_run();
-void machine_register_exception(char *message, int code);
-int machine_handle_exception();
-void machine_get_mem_access(int *mem_left, int *mem_right);
-void machine_pre_execute(int ip_val);
-void machine_post_execute();
-int machine_execute_instruction(int opcode);
-xsm_word *machine_get_address(int write);
-int machine_get_address_int(int write);
-int machine_translate_address(int address, int write, int type, int mode);
-xsm_word *machine_memory_get_word(int address);
-int machine_execute_mov();
-int machine_execute_arith(int opcode);
-int machine_execute_unary(int opcode);
-int machine_execute_logical(int opcode);
-int machine_execute_jump(int opcode);
-int machine_execute_stack(int opcode);
-int machine_push_do(xsm_word *reg);
-int machine_pop_do(xsm_word *dest);
-xsm_word *machine_stack_pointer(int write);
-int machine_execute_call_do(int target);
-int machine_execute_call();
-int machine_execute_ret();
-int machine_execute_brkp();
-int machine_execute_interrupt();
-int machine_execute_interrupt_do(int interrupt);
+int machine_serve_instruction(xsm_machine *machine, char *buffer, unsigned long *read_bytes, int max);
+xsm_instruction *machine_fetch_instruction(xsm_machine *machine, int ip_val);
+int machine_run(xsm_machine *machine);
+void machine_run_finish(xsm_machine *machine);
+int machine_run_for(xsm_machine *machine, long long count);
+void machine_resume(xsm_machine *machine);
+int machine_step(xsm_machine *machine);
+int machine_run_threaded(xsm_machine *machine);
+int machine_fuse_next(xsm_machine *machine, xsm_instruction *instr);
+int machine_run_block(xsm_machine *machine);
+void machine_register_exception(xsm_machine *machine, char *message, int code);
+int machine_handle_exception(xsm_machine *machine);
+void machine_pre_execute(xsm_machine *machine, int ip_val);
+void machine_post_execute(xsm_machine *machine);
+void machine_idle_reset(xsm_machine *machine);
+void machine_idle_check(xsm_machine *machine, int ip_val);
+void machine_fire_event(xsm_machine *machine, xsm_event *event);
+int machine_schedule_timer(xsm_machine *machine);
+int machine_schedule_fork(xsm_machine *machine);
+int machine_execute_instruction(xsm_machine *machine, xsm_instruction *instr);
+xsm_word *machine_get_address(xsm_machine *machine, xsm_operand *operand, int write);
+int machine_get_address_int(xsm_machine *machine, xsm_operand *operand, int write);
+int machine_translate_address(xsm_machine *machine, int address, int write, int type, int mode);
+xsm_word *machine_memory_get_word(xsm_machine *machine, int address);
+void machine_notify_write(xsm_machine *machine, int address);
+void machine_notify_page_write(xsm_machine *machine, int page);
+int machine_execute_mov(xsm_machine *machine, xsm_instruction *instr);
+int machine_execute_arith(xsm_machine *machine, xsm_instruction *instr);
+int machine_execute_unary(xsm_machine *machine, xsm_instruction *instr);
+int machine_execute_logical(xsm_machine *machine, xsm_instruction *instr);
+int machine_execute_jump(xsm_machine *machine, xsm_instruction *instr);
+int machine_execute_stack(xsm_machine *machine, xsm_instruction *instr);
+int machine_push_do(xsm_machine *machine, xsm_word *reg);
+int machine_pop_do(xsm_machine *machine, xsm_word *dest);
+xsm_word *machine_stack_pointer(xsm_machine *machine, int write);
+int machine_execute_call_do(xsm_machine *machine, int target);
+int machine_execute_call(xsm_machine *machine, xsm_instruction *instr);
+int machine_execute_ret(xsm_machine *machine);
+int machine_execute_brkp(xsm_machine *machine);
+int machine_execute_interrupt(xsm_machine *machine, xsm_instruction *instr);
+int machine_execute_interrupt_do(xsm_machine *machine, int interrupt);
 int machine_interrupt_address(int int_num);
-int machine_execute_disk(int operation, int immediate);
-int machine_read_disk_arg();
-int machine_schedule_disk(int page_num, int block_num, int firetime, int operation);
-int machine_execute_load_do(int page_num, int block_num);
-int machine_execute_store_do(int page_num, int block_num);
-int machine_execute_encrypt();
-int machine_execute_backup();
-int machine_execute_restore();
-int machine_execute_print_do(xsm_word *word);
-int machine_execute_print();
-int machine_schedule_in(int firetime);
-int machine_execute_ini();
-int machine_execute_in_do(xsm_word *word);
-int machine_execute_iret();
-int machine_get_mode();
-void machine_set_mode(int mode);
-void machine_destroy();
+int machine_execute_disk(xsm_machine *machine, xsm_instruction *instr, int operation, int immediate);
+int machine_read_disk_arg(xsm_machine *machine, xsm_operand *operand);
+int machine_schedule_disk(xsm_machine *machine, int page_num, int block_num, int firetime, int operation);
+int machine_execute_load_do(xsm_machine *machine, int page_num, int block_num);
+int machine_execute_store_do(xsm_machine *machine, int page_num, int block_num);
+int machine_execute_encrypt(xsm_machine *machine, xsm_instruction *instr);
+int machine_execute_backup(xsm_machine *machine);
+int machine_execute_restore(xsm_machine *machine);
+int machine_execute_print_do(xsm_machine *machine, xsm_word *word);
+int machine_execute_print(xsm_machine *machine);
+int machine_schedule_in(xsm_machine *machine, int firetime);
+int machine_execute_ini(xsm_machine *machine);
+int machine_execute_in_do(xsm_machine *machine, xsm_word *word);
+int machine_execute_iret(xsm_machine *machine);
+int machine_get_mode(xsm_machine *machine);
+void machine_set_mode(xsm_machine *machine, int mode);
+long long machine_get_cycles(xsm_machine *machine);
+void machine_set_cycles(xsm_machine *machine, long long cycles);
+void machine_destroy(xsm_machine *machine);
+void machine_free(xsm_machine *machine);
 
 #endif
\ No newline at end of file
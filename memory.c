@@ -4,29 +4,30 @@ An interface that handles XSM memory.
 
 #include "memory.h"
 
+#include "machine.h"
+
 #include <stdlib.h>
 #include <string.h>
 
-static xsm_word *_xsm_mem;
-
 /* Initialse the RAM */
-int memory_init()
+int memory_init(xsm_machine *machine)
 {
-    _xsm_mem = (xsm_word *)malloc(sizeof(xsm_word) * XSM_MEMORY_SIZE);
+    machine->memory.mem = (xsm_word *)calloc(XSM_MEMORY_SIZE, sizeof(xsm_word));
 
-    if (!_xsm_mem)
+    if (!machine->memory.mem)
         return XSM_FAILURE;
 
+    memory_tlb_flush(machine);
     return XSM_SUCCESS;
 }
 
 /* Returns the word stored in the given address */
-xsm_word *memory_get_word(int address)
+xsm_word *memory_get_word(xsm_machine *machine, int address)
 {
     if (!memory_is_address_valid(address))
         return NULL;
 
-    return &_xsm_mem[address];
+    return &machine->memory.mem[address];
 }
 
 /* Checks whether the given address is valid */
@@ -51,7 +52,7 @@ int memory_addr_page(int address)
 }
 
 /* Converts the virtual address to physical address */
-int memory_translate_address(int ptbr, int ptlr, int address, int write)
+int memory_translate_address(xsm_machine *machine, int ptbr, int ptlr, int address, int write)
 {
     int page, offset;
     int target_page;
@@ -59,7 +60,7 @@ int memory_translate_address(int ptbr, int ptlr, int address, int write)
     page = memory_addr_page(address);
     offset = address % XSM_PAGE_SIZE;
 
-    target_page = memory_translate_page(ptbr, ptlr, page, write);
+    target_page = memory_translate_page(machine, ptbr, ptlr, page, write);
 
     if (target_page < 0)
         return target_page;
@@ -68,56 +69,128 @@ int memory_translate_address(int ptbr, int ptlr, int address, int write)
 }
 
 /* Returns the physical page for the given virtual address */
-int memory_translate_page(int ptbr, int ptlr, int page, int write)
+int memory_translate_page(xsm_machine *machine, int ptbr, int ptlr, int page, int write)
 {
-    int page_entry, page_info, entry;
-    xsm_word *page_entry_w, *page_info_w;
-    char *info;
+    xsm_tlb_entry *tlb_entry;
 
     if (page < 0 || page >= ptlr)
         return XSM_MEM_ILLPAGE;
 
+    tlb_entry = memory_tlb_lookup(machine, ptbr, page);
+
+    if (!tlb_entry)
+        return XSM_MEM_ILLPAGE;
+
+    if (!tlb_entry->valid)
+        return XSM_MEM_PAGEFAULT;
+
+    if (write && !tlb_entry->write)
+        return XSM_MEM_NOWRITE;
+
+    return tlb_entry->entry;
+}
+
+/* Returns the TLB entry for the given page, walking the page table on a miss */
+xsm_tlb_entry *memory_tlb_lookup(xsm_machine *machine, int ptbr, int page)
+{
+    int page_entry, page_info;
+    xsm_word *page_entry_w, *page_info_w;
+    xsm_tlb_entry *tlb_entry;
+    char *info;
+
     page_entry = page * 2 + ptbr;
     page_info = page_entry + 1;
 
-    page_entry_w = memory_get_word(page_entry);
-    page_info_w = memory_get_word(page_info);
+    /* Entries are indexed by the address of the page table entry */
+    tlb_entry = &machine->memory.tlb[(page_entry >> 1) & (XSM_TLB_SIZE - 1)];
+
+    if (tlb_entry->used && tlb_entry->ptbr == ptbr && tlb_entry->page == page)
+        return tlb_entry;
+
+    page_entry_w = memory_get_word(machine, page_entry);
+    page_info_w = memory_get_word(machine, page_info);
+
+    if (!page_entry_w || !page_info_w)
+        return NULL;
 
-    entry = word_get_integer(page_entry_w);
     info = word_get_string(page_info_w);
 
-    if (info[1] == '0')
-        return XSM_MEM_PAGEFAULT;
+    tlb_entry->used = TRUE;
+    tlb_entry->ptbr = ptbr;
+    tlb_entry->page = page;
+    tlb_entry->entry = word_get_integer(page_entry_w);
+    tlb_entry->valid = (info[1] != '0');
+    tlb_entry->write = (info[2] != '0');
 
-    if (write && info[2] == '0')
-        return XSM_MEM_NOWRITE;
+    machine->memory.tlb_pages[memory_addr_page(page_entry)] = TRUE;
+    machine->memory.tlb_pages[memory_addr_page(page_info)] = TRUE;
 
-    return entry;
+    return tlb_entry;
+}
+
+/* Drop all the cached translations */
+void memory_tlb_flush(xsm_machine *machine)
+{
+    memset(machine->memory.tlb, 0, sizeof(machine->memory.tlb));
+    memset(machine->memory.tlb_pages, 0, sizeof(machine->memory.tlb_pages));
+    machine->memory.tlb_generation++;
+}
+
+/* Returns the number of times the TLB has been flushed */
+int memory_tlb_generation(xsm_machine *machine)
+{
+    return machine->memory.tlb_generation;
+}
+
+/* Flush the TLB if the given address may hold a cached page table entry */
+int memory_tlb_invalidate(xsm_machine *machine, int address)
+{
+    if (!memory_is_address_valid(address))
+        return FALSE;
+
+    if (!machine->memory.tlb_pages[memory_addr_page(address)])
+        return FALSE;
+
+    memory_tlb_flush(machine);
+    return TRUE;
+}
+
+/* Flush the TLB if the given page may hold cached page table entries */
+int memory_tlb_invalidate_page(xsm_machine *machine, int page)
+{
+    if (page < 0 || page >= XSM_MEMORY_NUMPAGES)
+        return FALSE;
+
+    if (!machine->memory.tlb_pages[page])
+        return FALSE;
+
+    memory_tlb_flush(machine);
+    return TRUE;
 }
 
 /* Returns the instruction at the gievn address */
-void memory_retrieve_raw_instr(char *dest, int address)
+void memory_retrieve_raw_instr(xsm_machine *machine, char *dest, int address)
 {
     int i;
-    xsm_word *instr = memory_get_word(address++);
+    xsm_word *instr = memory_get_word(machine, address++);
 
     strcpy(dest, word_get_string(instr));
 
     for (i = 1; i < XSM_INSTRUCTION_SIZE; ++i)
     {
-        instr = memory_get_word(address++);
+        instr = memory_get_word(machine, address++);
         strcat(dest, word_get_string(instr));
     }
 }
 
 /* Converts page number to physical address */
-xsm_word *memory_get_page(int page)
+xsm_word *memory_get_page(xsm_machine *machine, int page)
 {
-    return memory_get_word(page * XSM_PAGE_SIZE);
+    return memory_get_word(machine, page * XSM_PAGE_SIZE);
 }
 
 /* Deallocates the RAM */
-void memory_destroy()
+void memory_destroy(xsm_machine *machine)
 {
-    free(_xsm_mem);
+    free(machine->memory.mem);
 }
\ No newline at end of file
@@ -14,14 +14,45 @@
 #define OPER_FETCH -6
 #define DEBUG_FETCH -7
 
-int memory_init();
-xsm_word *memory_get_word(int address);
+/* Number of cached page table entries, a power of two */
+#define XSM_TLB_SIZE 128
+
+typedef struct _xsm_tlb_entry
+{
+    int used;
+    int ptbr, page;
+
+    /* Physical page and the valid/write bits of the page table entry */
+    int entry;
+    int valid, write;
+} xsm_tlb_entry;
+
+typedef struct _xsm_memory
+{
+    xsm_word *mem;
+
+    xsm_tlb_entry tlb[XSM_TLB_SIZE];
+
+    /* Pages holding page table entries cached in the TLB */
+    char tlb_pages[XSM_MEMORY_NUMPAGES];
+
+    /* Number of times the TLB has been flushed */
+    int tlb_generation;
+} xsm_memory;
+
+int memory_init(xsm_machine *machine);
+xsm_word *memory_get_word(xsm_machine *machine, int address);
 int memory_is_address_valid(int address);
 int memory_addr_page(int address);
-int memory_translate_address(int ptbr, int ptlr, int address, int write);
-int memory_translate_page(int ptbr, int ptlr, int page, int write);
-void memory_retrieve_raw_instr(char *dest, int address);
-xsm_word *memory_get_page(int page);
-void memory_destroy();
+int memory_translate_address(xsm_machine *machine, int ptbr, int ptlr, int address, int write);
+int memory_translate_page(xsm_machine *machine, int ptbr, int ptlr, int page, int write);
+xsm_tlb_entry *memory_tlb_lookup(xsm_machine *machine, int ptbr, int page);
+void memory_tlb_flush(xsm_machine *machine);
+int memory_tlb_generation(xsm_machine *machine);
+int memory_tlb_invalidate(xsm_machine *machine, int address);
+int memory_tlb_invalidate_page(xsm_machine *machine, int page);
+void memory_retrieve_raw_instr(xsm_machine *machine, char *dest, int address);
+xsm_word *memory_get_page(xsm_machine *machine, int page);
+void memory_destroy(xsm_machine *machine);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,562 @@
+/*
+The execution profiler. Counts the instructions run at every physical
+address and, in USER mode, at every virtual address under each page table,
+along with opcodes and exceptions, each split by mode. The report is
+written when machine_run() ends.
+
+Every instruction is also counted under a shadow call stack, kept from
+CALL and RET, interrupts and IRET. Each process, told apart by its PTBR,
+has a stack of its own. Interrupts go on the stack of the process they
+were taken in, even if the kernel switches to another one before IRET.
+The stacks are written in the folded format of flame graph tools, one
+line per distinct stack with its count.
+*/
+
+#include "profile.h"
+
+#include "machine.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if PROFILE_OPCODES != XSM_INSTRUCTION_COUNT + 1
+#error "PROFILE_OPCODES must cover every opcode"
+#endif
+
+static const char *_profile_exceptions[PROFILE_EXCEPTIONS] = {
+    "page fault",
+    "illegal instruction",
+    "illegal memory",
+    "arithmetic"};
+
+static const char *_profile_modes[2] = {"USER", "KERNEL"};
+
+/* Initialise the profiler */
+int profile_init(xsm_machine *machine)
+{
+    xsm_profile *profile = &machine->profile;
+    int mode;
+
+    memset(profile, 0, sizeof(xsm_profile));
+
+    for (mode = 0; mode < 2; ++mode)
+    {
+        profile->physical[mode] = (long long *)calloc(XSM_MEMORY_SIZE, sizeof(long long));
+
+        if (!profile->physical[mode])
+            return XSM_FAILURE;
+    }
+
+    profile->virtual_size = PROFILE_VIRTUAL_SIZE;
+    profile->virtual_ips = (profile_virtual_ip *)calloc(profile->virtual_size, sizeof(profile_virtual_ip));
+
+    if (!profile->virtual_ips)
+        return XSM_FAILURE;
+
+    /* Instructions before the first process run under the boot code */
+    profile->current = profile_context_of(machine, -1);
+
+    if (profile->current < 0)
+        return XSM_FAILURE;
+
+    return XSM_SUCCESS;
+}
+
+/* Count an instruction fetched from the given IP */
+void profile_count(xsm_machine *machine, int ip_val, int opcode)
+{
+    xsm_profile *profile = &machine->profile;
+    int mode, address, ptbr, context;
+
+    mode = machine_get_mode(machine);
+    /* The fetch has just translated it, this can not fault */
+    address = machine_translate_address(machine, ip_val, FALSE, DEBUG_FETCH, mode);
+
+    if (memory_is_address_valid(address))
+        profile->physical[mode][address]++;
+
+    if (opcode < 0 || opcode >= XSM_INSTRUCTION_COUNT)
+        opcode = XSM_INSTRUCTION_COUNT;
+
+    profile->opcodes[mode][opcode]++;
+
+    /* USER mode code runs on the stack of its own process */
+    if (mode == PRIVILEGE_USER)
+    {
+        ptbr = word_get_integer(&machine->cpu.regs[PTBR]);
+        profile_count_virtual(machine, ptbr, ip_val);
+
+        if (profile->contexts[profile->current].ptbr != ptbr)
+        {
+            context = profile_context_of(machine, ptbr);
+
+            if (context >= 0)
+                profile->current = context;
+        }
+    }
+
+    profile->nodes[profile->contexts[profile->current].node].count++;
+}
+
+/* Count a USER mode instruction under the given page table */
+void profile_count_virtual(xsm_machine *machine, int ptbr, int ip_val)
+{
+    xsm_profile *profile = &machine->profile;
+    profile_virtual_ip *slot;
+    unsigned int hash;
+
+    /* Kept under three quarters full */
+    if (4 * (profile->virtual_used + 1) > 3 * profile->virtual_size)
+        if (!profile_grow(machine))
+            return;
+
+    hash = profile_hash(ptbr, ip_val);
+
+    while (TRUE)
+    {
+        slot = &profile->virtual_ips[hash & (profile->virtual_size - 1)];
+
+        if (!slot->count)
+        {
+            slot->ptbr = ptbr;
+            slot->ip = ip_val;
+            profile->virtual_used++;
+            break;
+        }
+
+        if (slot->ptbr == ptbr && slot->ip == ip_val)
+            break;
+
+        hash++;
+    }
+
+    slot->count++;
+}
+
+/* Slot to start looking for a USER mode IP at */
+unsigned int profile_hash(int ptbr, int ip_val)
+{
+    return ((unsigned int)ptbr * 2654435761u) ^ (unsigned int)ip_val;
+}
+
+/* Double the table of USER mode IPs */
+int profile_grow(xsm_machine *machine)
+{
+    xsm_profile *profile = &machine->profile;
+    profile_virtual_ip *old, *slot;
+    int old_size, i;
+    unsigned int hash;
+
+    old = profile->virtual_ips;
+    old_size = profile->virtual_size;
+
+    profile->virtual_ips = (profile_virtual_ip *)calloc(2 * old_size, sizeof(profile_virtual_ip));
+
+    if (!profile->virtual_ips)
+    {
+        profile->virtual_ips = old;
+        return XSM_FAILURE;
+    }
+
+    profile->virtual_size = 2 * old_size;
+
+    for (i = 0; i < old_size; ++i)
+    {
+        if (!old[i].count)
+            continue;
+
+        hash = profile_hash(old[i].ptbr, old[i].ip);
+
+        while (TRUE)
+        {
+            slot = &profile->virtual_ips[hash & (profile->virtual_size - 1)];
+
+            if (!slot->count)
+                break;
+
+            hash++;
+        }
+
+        *slot = old[i];
+    }
+
+    free(old);
+    return XSM_SUCCESS;
+}
+
+/* Count an exception raised in the given mode */
+void profile_exception(xsm_machine *machine, int mode, int code)
+{
+    if (code >= 0 && code < PROFILE_EXCEPTIONS)
+        machine->profile.exceptions[mode][code]++;
+}
+
+/* Returns the shadow call stack of the process with the given PTBR, -1 if there is no room for it */
+int profile_context_of(xsm_machine *machine, int ptbr)
+{
+    xsm_profile *profile = &machine->profile;
+    profile_context *contexts;
+    int i, node;
+
+    for (i = 0; i < profile->num_contexts; ++i)
+        if (profile->contexts[i].ptbr == ptbr)
+            return i;
+
+    if (profile->num_contexts == profile->max_contexts)
+    {
+        contexts = (profile_context *)realloc(profile->contexts, 2 * (profile->max_contexts + 8) * sizeof(profile_context));
+
+        if (!contexts)
+            return -1;
+
+        profile->contexts = contexts;
+        profile->max_contexts = 2 * (profile->max_contexts + 8);
+    }
+
+    node = profile_node_child(machine, -1, PROFILE_FRAME_ROOT, ptbr);
+
+    if (node < 0)
+        return -1;
+
+    i = profile->num_contexts++;
+
+    profile->contexts[i].ptbr = ptbr;
+    profile->contexts[i].node = node;
+    profile->contexts[i].depth = 0;
+    profile->contexts[i].overflow = 0;
+
+    return i;
+}
+
+/* Returns the node for a frame pushed on top of the parent node, -1 if there is no room for it */
+int profile_node_child(xsm_machine *machine, int parent, int kind, int value)
+{
+    xsm_profile *profile = &machine->profile;
+    profile_node *nodes, *node;
+    int i;
+
+    /* A process is the root of its own tree */
+    if (parent >= 0)
+        for (i = profile->nodes[parent].child; i >= 0; i = profile->nodes[i].sibling)
+            if (profile->nodes[i].kind == kind && profile->nodes[i].value == value)
+                return i;
+
+    if (profile->num_nodes == profile->max_nodes)
+    {
+        nodes = (profile_node *)realloc(profile->nodes, 2 * (profile->max_nodes + 256) * sizeof(profile_node));
+
+        if (!nodes)
+            return -1;
+
+        profile->nodes = nodes;
+        profile->max_nodes = 2 * (profile->max_nodes + 256);
+    }
+
+    i = profile->num_nodes++;
+    node = &profile->nodes[i];
+
+    node->kind = kind;
+    node->value = value;
+    node->parent = parent;
+    node->child = -1;
+    node->sibling = -1;
+    node->count = 0;
+
+    if (parent >= 0)
+    {
+        node->sibling = profile->nodes[parent].child;
+        profile->nodes[parent].child = i;
+    }
+
+    return i;
+}
+
+/* Push a frame on the current shadow call stack */
+void profile_push(xsm_machine *machine, int kind, int value)
+{
+    xsm_profile *profile = &machine->profile;
+    profile_context *context = &profile->contexts[profile->current];
+    int node = -1;
+
+    if (context->depth < PROFILE_STACK_DEPTH && !context->overflow)
+        node = profile_node_child(machine, context->node, kind, value);
+
+    if (node < 0)
+    {
+        context->overflow++;
+        return;
+    }
+
+    context->node = node;
+    context->depth++;
+}
+
+/* A routine has been entered with CALL */
+void profile_call(xsm_machine *machine, int target)
+{
+    profile_push(machine, PROFILE_FRAME_CALL, target);
+}
+
+/* Leave the routine on top of the current shadow call stack, a RET without a CALL is ignored */
+void profile_ret(xsm_machine *machine)
+{
+    xsm_profile *profile = &machine->profile;
+    profile_context *context = &profile->contexts[profile->current];
+
+    if (context->overflow)
+    {
+        context->overflow--;
+        return;
+    }
+
+    if (profile->nodes[context->node].kind != PROFILE_FRAME_CALL)
+        return;
+
+    context->node = profile->nodes[context->node].parent;
+    context->depth--;
+}
+
+/* An interrupt routine has been entered */
+void profile_interrupt(xsm_machine *machine, int interrupt)
+{
+    profile_push(machine, PROFILE_FRAME_INT, interrupt);
+}
+
+/* Leave the last interrupt routine along with every routine it called */
+void profile_iret(xsm_machine *machine)
+{
+    xsm_profile *profile = &machine->profile;
+    profile_context *context = &profile->contexts[profile->current];
+    int kind;
+
+    context->overflow = 0;
+
+    do
+    {
+        kind = profile->nodes[context->node].kind;
+
+        if (kind == PROFILE_FRAME_ROOT)
+            break;
+
+        context->node = profile->nodes[context->node].parent;
+        context->depth--;
+    } while (kind != PROFILE_FRAME_INT);
+}
+
+/* Write what was asked for once the machine has stopped */
+void profile_finish(xsm_machine *machine)
+{
+    if (machine->options.profile & PROFILE_REPORT)
+        profile_report(machine, stderr);
+
+    if (machine->options.profile & PROFILE_FOLDED)
+        if (!profile_write_folded(machine, machine->options.folded))
+            fprintf(stderr, "Could not write the call stacks to %s\n", machine->options.folded);
+}
+
+/* Write every stack instructions ran under, with their counts */
+int profile_write_folded(xsm_machine *machine, const char *filename)
+{
+    xsm_profile *profile = &machine->profile;
+    FILE *fp;
+    int i;
+
+    fp = fopen(filename, "w");
+
+    if (!fp)
+        return XSM_FAILURE;
+
+    for (i = 0; i < profile->num_nodes; ++i)
+    {
+        if (!profile->nodes[i].count)
+            continue;
+
+        profile_write_frames(machine, fp, i);
+        fprintf(fp, " %lld\n", profile->nodes[i].count);
+    }
+
+    return fclose(fp) == 0;
+}
+
+/* Write the frames from the root of the stack down to the node */
+void profile_write_frames(xsm_machine *machine, FILE *fp, int node)
+{
+    profile_node *frame = &machine->profile.nodes[node];
+
+    if (frame->parent >= 0)
+    {
+        profile_write_frames(machine, fp, frame->parent);
+        fputc(';', fp);
+    }
+
+    switch (frame->kind)
+    {
+        case PROFILE_FRAME_ROOT:
+            if (frame->value < 0)
+                fprintf(fp, "boot");
+            else
+                fprintf(fp, "PTBR %d", frame->value);
+            break;
+
+        case PROFILE_FRAME_INT:
+            fprintf(fp, "INT %d", frame->value);
+            break;
+
+        default:
+            fprintf(fp, "CALL %d", frame->value);
+            break;
+    }
+}
+
+/* Write the report */
+void profile_report(xsm_machine *machine, FILE *fp)
+{
+    xsm_profile *profile = &machine->profile;
+    profile_row *rows;
+    long long total[2], page_count[2];
+    char label[32];
+    int mode, opcode, code, page, address, num_rows, i;
+
+    total[PRIVILEGE_USER] = total[PRIVILEGE_KERNEL] = 0;
+
+    for (mode = 0; mode < 2; ++mode)
+        for (opcode = 0; opcode < PROFILE_OPCODES; ++opcode)
+            total[mode] += profile->opcodes[mode][opcode];
+
+    fprintf(fp, "Profile: %lld instructions, %lld in KERNEL mode, %lld in USER mode\n",
+            total[PRIVILEGE_KERNEL] + total[PRIVILEGE_USER], total[PRIVILEGE_KERNEL], total[PRIVILEGE_USER]);
+
+    fprintf(fp, "\n%-20s %12s %12s\n", "Opcode", "KERNEL", "USER");
+
+    for (opcode = 0; opcode < PROFILE_OPCODES; ++opcode)
+        if (profile->opcodes[PRIVILEGE_KERNEL][opcode] || profile->opcodes[PRIVILEGE_USER][opcode])
+            fprintf(fp, "%-20s %12lld %12lld\n",
+                    opcode < XSM_INSTRUCTION_COUNT ? machine_get_opcode_name(opcode) : "(illegal)",
+                    profile->opcodes[PRIVILEGE_KERNEL][opcode], profile->opcodes[PRIVILEGE_USER][opcode]);
+
+    fprintf(fp, "\n%-20s %12s %12s\n", "Exception", "KERNEL", "USER");
+
+    for (code = 0; code < PROFILE_EXCEPTIONS; ++code)
+        if (profile->exceptions[PRIVILEGE_KERNEL][code] || profile->exceptions[PRIVILEGE_USER][code])
+            fprintf(fp, "%-20s %12lld %12lld\n", _profile_exceptions[code],
+                    profile->exceptions[PRIVILEGE_KERNEL][code], profile->exceptions[PRIVILEGE_USER][code]);
+
+    fprintf(fp, "\n%-20s %12s %12s\n", "Physical page", "KERNEL", "USER");
+
+    for (page = 0; page < XSM_MEMORY_NUMPAGES; ++page)
+    {
+        page_count[PRIVILEGE_USER] = page_count[PRIVILEGE_KERNEL] = 0;
+
+        for (address = page * XSM_PAGE_SIZE; address < (page + 1) * XSM_PAGE_SIZE; ++address)
+            for (mode = 0; mode < 2; ++mode)
+                page_count[mode] += profile->physical[mode][address];
+
+        if (page_count[PRIVILEGE_KERNEL] || page_count[PRIVILEGE_USER])
+            fprintf(fp, "%-20s %12lld %12lld\n", profile_page_label(page, label),
+                    page_count[PRIVILEGE_KERNEL], page_count[PRIVILEGE_USER]);
+    }
+
+    /* The hottest addresses, one table per mode */
+    rows = (profile_row *)malloc((XSM_MEMORY_SIZE + profile->virtual_size) * sizeof(profile_row));
+
+    if (!rows)
+        return;
+
+    for (mode = PRIVILEGE_KERNEL; mode >= PRIVILEGE_USER; --mode)
+    {
+        num_rows = 0;
+
+        for (address = 0; address < XSM_MEMORY_SIZE; ++address)
+            if (profile->physical[mode][address])
+            {
+                rows[num_rows].ptbr = -1;
+                rows[num_rows].address = address;
+                rows[num_rows].count = profile->physical[mode][address];
+                num_rows++;
+            }
+
+        qsort(rows, num_rows, sizeof(profile_row), profile_compare);
+
+        fprintf(fp, "\n%s mode physical IPs    %12s %7s  %s\n", _profile_modes[mode], "Count", "Share", "Page");
+
+        for (i = 0; i < num_rows && i < PROFILE_TOP; ++i)
+            fprintf(fp, "%-20d %12lld %6.2f%%  %s\n", rows[i].address, rows[i].count,
+                    100.0 * rows[i].count / total[mode], profile_page_label(rows[i].address / XSM_PAGE_SIZE, label));
+    }
+
+    num_rows = 0;
+
+    for (i = 0; i < profile->virtual_size; ++i)
+        if (profile->virtual_ips[i].count)
+        {
+            rows[num_rows].ptbr = profile->virtual_ips[i].ptbr;
+            rows[num_rows].address = profile->virtual_ips[i].ip;
+            rows[num_rows].count = profile->virtual_ips[i].count;
+            num_rows++;
+        }
+
+    qsort(rows, num_rows, sizeof(profile_row), profile_compare);
+
+    fprintf(fp, "\n%-10s %-9s %12s %7s\n", "USER PTBR", "IP", "Count", "Share");
+
+    for (i = 0; i < num_rows && i < PROFILE_TOP; ++i)
+        fprintf(fp, "%-10d %-9d %12lld %6.2f%%\n", rows[i].ptbr, rows[i].address, rows[i].count,
+                100.0 * rows[i].count / total[PRIVILEGE_USER]);
+
+    free(rows);
+}
+
+/* Name a physical page after what the ROM and interrupts place in it */
+const char *profile_page_label(int page, char *label)
+{
+    int interrupt, start;
+
+    sprintf(label, "%d", page);
+
+    if (page == 0)
+        strcat(label, " (ROM)");
+
+    /* Every interrupt routine has two pages */
+    for (interrupt = 0; interrupt <= INTERRUPT_HIGH; ++interrupt)
+    {
+        start = machine_interrupt_address(interrupt) / XSM_PAGE_SIZE;
+
+        if (page == start || page == start + 1)
+            sprintf(label, "%d (INT %d)", page, interrupt);
+    }
+
+    return label;
+}
+
+/* Orders rows by decreasing count, then by address */
+int profile_compare(const void *a, const void *b)
+{
+    const profile_row *x = (const profile_row *)a;
+    const profile_row *y = (const profile_row *)b;
+
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+
+    if (x->ptbr != y->ptbr)
+        return x->ptbr < y->ptbr ? -1 : 1;
+
+    return x->address - y->address;
+}
+
+/* Deallocate the profiler */
+void profile_destroy(xsm_machine *machine)
+{
+    xsm_profile *profile = &machine->profile;
+
+    free(profile->physical[PRIVILEGE_USER]);
+    free(profile->physical[PRIVILEGE_KERNEL]);
+    free(profile->virtual_ips);
+    free(profile->nodes);
+    free(profile->contexts);
+
+    profile->nodes = NULL;
+    profile->contexts = NULL;
+    profile->physical[PRIVILEGE_USER] = NULL;
+    profile->physical[PRIVILEGE_KERNEL] = NULL;
+    profile->virtual_ips = NULL;
+}
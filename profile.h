@@ -0,0 +1,116 @@
+#ifndef XSM_PROFILE_H
+
+#define XSM_PROFILE_H
+
+#include <stdio.h>
+
+#include "types.h"
+
+/* Rows in each table of the report */
+#define PROFILE_TOP 20
+
+/* Initial number of slots for USER mode IPs, a power of two */
+#define PROFILE_VIRTUAL_SIZE 1024
+
+/* Opcodes counted, XSM_INSTRUCTION_COUNT and one for illegal instructions */
+#define PROFILE_OPCODES 37
+
+/* Kinds of exception counted, EXP_* */
+#define PROFILE_EXCEPTIONS 4
+
+/* What the profiler writes when the machine stops, options.profile */
+#define PROFILE_REPORT 1
+#define PROFILE_FOLDED 2
+
+/* Frames of the shadow call stacks */
+#define PROFILE_FRAME_ROOT 0    /* A process, or the boot code */
+#define PROFILE_FRAME_INT 1     /* Interrupt routine */
+#define PROFILE_FRAME_CALL 2    /* Routine entered with CALL */
+
+/* Deepest shadow call stack kept, deeper frames are only counted */
+#define PROFILE_STACK_DEPTH 256
+
+/* A USER mode IP under one page table */
+typedef struct _profile_virtual_ip
+{
+    int ptbr;
+    int ip;
+    long long count;
+} profile_virtual_ip;
+
+/* A row of the report */
+typedef struct _profile_row
+{
+    int ptbr;
+    int address;
+    long long count;
+} profile_row;
+
+/*
+A node of the call tree, one for every distinct stack. Instructions are
+counted at the node of the stack they ran under.
+*/
+typedef struct _profile_node
+{
+    int kind;
+    int value;  /* PTBR, interrupt number or CALL target */
+
+    int parent, child, sibling;
+    long long count;
+} profile_node;
+
+/* The shadow call stack of a process, by its page table */
+typedef struct _profile_context
+{
+    int ptbr;
+    int node, depth;
+
+    /* Frames pushed past PROFILE_STACK_DEPTH */
+    int overflow;
+} profile_context;
+
+typedef struct _xsm_profile
+{
+    /* Instructions run at every physical address, by mode */
+    long long *physical[2];
+
+    /* Instructions run by mode and opcode */
+    long long opcodes[2][PROFILE_OPCODES];
+
+    long long exceptions[2][PROFILE_EXCEPTIONS];
+
+    /* Open addressed table of USER mode IPs */
+    profile_virtual_ip *virtual_ips;
+    int virtual_size, virtual_used;
+
+    /* Call tree and the shadow call stacks, the current one takes interrupts */
+    profile_node *nodes;
+    int num_nodes, max_nodes;
+
+    profile_context *contexts;
+    int num_contexts, max_contexts;
+    int current;
+} xsm_profile;
+
+int profile_init(xsm_machine *machine);
+void profile_count(xsm_machine *machine, int ip_val, int opcode);
+void profile_count_virtual(xsm_machine *machine, int ptbr, int ip_val);
+unsigned int profile_hash(int ptbr, int ip_val);
+int profile_grow(xsm_machine *machine);
+void profile_exception(xsm_machine *machine, int mode, int code);
+int profile_context_of(xsm_machine *machine, int ptbr);
+int profile_node_child(xsm_machine *machine, int parent, int kind, int value);
+void profile_push(xsm_machine *machine, int kind, int value);
+void profile_call(xsm_machine *machine, int target);
+void profile_ret(xsm_machine *machine);
+void profile_interrupt(xsm_machine *machine, int interrupt);
+void profile_iret(xsm_machine *machine);
+void profile_finish(xsm_machine *machine);
+int profile_write_folded(xsm_machine *machine, const char *filename);
+void profile_write_frames(xsm_machine *machine, FILE *fp, int node);
+void profile_report(xsm_machine *machine, FILE *fp);
+const char *profile_page_label(int page, char *label);
+int profile_compare(const void *a, const void *b);
+void profile_destroy(xsm_machine *machine);
+
+#endif
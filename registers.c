@@ -4,11 +4,11 @@ An interface for handling registers.
 
 #include "registers.h"
 
+#include "machine.h"
+
 #include <stdlib.h>
 #include <string.h>
 
-static xsm_reg *_registers;
-
 static const char *_register_names[] = {
     "R0",
     "R1",
@@ -48,13 +48,21 @@ static const char *_register_names[] = {
     "EMA"};
 
 /* Initialise the registers */
-int registers_init()
+int registers_init(xsm_machine *machine)
 {
-    _registers = (xsm_reg *)malloc(sizeof(xsm_reg) * XSM_NUM_REG);
+    int i;
+
+    machine->registers.regs = (xsm_reg *)calloc(XSM_NUM_REG, sizeof(xsm_reg));
 
-    if (!_registers)
+    if (!machine->registers.regs)
         return XSM_FAILURE;
 
+    machine->registers.umode_mask = 0;
+
+    for (i = 0; i < XSM_NUM_REG; ++i)
+        if (registers_umode(_register_names[i]))
+            machine->registers.umode_mask |= 1ULL << i;
+
     return XSM_SUCCESS;
 }
 
@@ -71,20 +79,29 @@ int registers_get_register_code(const char *name)
 }
 
 /* Returns the register for the given register name */
-xsm_reg *registers_get_register(const char *name)
+xsm_reg *registers_get_register(xsm_machine *machine, const char *name)
 {
     int code = registers_get_register_code(name);
 
     if (code > -1)
-        return &_registers[code];
+        return &machine->registers.regs[code];
 
     return NULL;
 }
 
+/* Returns the register for the given register code */
+xsm_reg *registers_get_register_by_code(xsm_machine *machine, int code)
+{
+    if (code < 0 || code >= XSM_NUM_REG)
+        return NULL;
+
+    return &machine->registers.regs[code];
+}
+
 /* Deallocates the registers */
-void registers_destroy()
+void registers_destroy(xsm_machine *machine)
 {
-    free(_registers);
+    free(machine->registers.regs);
 }
 
 /* Returns the register names */
@@ -100,16 +117,16 @@ int registers_len()
 }
 
 /* Returns the integer value stored in the given register */
-int registers_get_integer(const char *name)
+int registers_get_integer(xsm_machine *machine, const char *name)
 {
-    xsm_word *reg = registers_get_register(name);
+    xsm_word *reg = registers_get_register(machine, name);
     return word_get_integer(reg);
 }
 
 /* Returns the string value stored in the given register */
-char *registers_get_string(const char *name)
+char *registers_get_string(xsm_machine *machine, const char *name)
 {
-    xsm_word *reg = registers_get_register(name);
+    xsm_word *reg = registers_get_register(machine, name);
 
     if (!reg)
         return NULL;
@@ -118,16 +135,16 @@ char *registers_get_string(const char *name)
 }
 
 /* Stores the integer value in the given register */
-int registers_store_integer(const char *name, int val)
+int registers_store_integer(xsm_machine *machine, const char *name, int val)
 {
-    xsm_word *reg = registers_get_register(name);
+    xsm_word *reg = registers_get_register(machine, name);
     return word_store_integer(reg, val);
 }
 
 /* Stores the string value in the given register */
-int registers_store_string(const char *name, char *str)
+int registers_store_string(xsm_machine *machine, const char *name, char *str)
 {
-    xsm_word *reg = registers_get_register(name);
+    xsm_word *reg = registers_get_register(machine, name);
     return word_store_string(reg, str);
 }
 
@@ -146,4 +163,13 @@ int registers_umode(const char *reg)
         return FALSE;
 
     return TRUE;
+}
+
+/* Checks whether the register with the given code can be used in USER mode */
+int registers_umode_by_code(xsm_machine *machine, int code)
+{
+    if (code < 0 || code >= XSM_NUM_REG)
+        return FALSE;
+
+    return (machine->registers.umode_mask >> code) & 1;
 }
\ No newline at end of file
@@ -52,16 +52,26 @@
 
 typedef xsm_word xsm_reg;
 
-int registers_init();
+typedef struct _xsm_registers
+{
+    xsm_reg *regs;
+
+    /* Bit i is set if register i can be used in USER mode */
+    unsigned long long umode_mask;
+} xsm_registers;
+
+int registers_init(xsm_machine *machine);
 int registers_get_register_code(const char *name);
-xsm_reg *registers_get_register(const char *name);
-void registers_destroy();
+xsm_reg *registers_get_register(xsm_machine *machine, const char *name);
+xsm_reg *registers_get_register_by_code(xsm_machine *machine, int code);
+void registers_destroy(xsm_machine *machine);
 const char **registers_names();
 int registers_len();
-int registers_get_integer(const char *name);
-char *registers_get_string(const char *name);
-int registers_store_integer(const char *name, int val);
-int registers_store_string(const char *name, char *str);
+int registers_get_integer(xsm_machine *machine, const char *name);
+char *registers_get_string(xsm_machine *machine, const char *name);
+int registers_store_integer(xsm_machine *machine, const char *name, int val);
+int registers_store_string(xsm_machine *machine, const char *name, char *str);
 int registers_umode(const char *reg);
+int registers_umode_by_code(xsm_machine *machine, int code);
 
 #endif
\ No newline at end of file
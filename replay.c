@@ -0,0 +1,100 @@
+/*
+Record and replay of console input. Everything else the machine does is
+timed by the device clock and so repeats by itself, the input words are
+all that a run takes from outside. A log has a line for every word read:
+
+    <cycle> =<word>     the word, read at that device clock value
+    <cycle> !           the end of the input
+
+Replaying feeds the words back in order. A word consumed at another cycle
+than it was recorded at means the run has taken another course, that is
+reported once.
+*/
+
+#include "replay.h"
+
+#include "machine.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Open the log to record input to, or to replay it from */
+int replay_open(xsm_machine *machine, const char *filename, int mode)
+{
+    xsm_replay *replay = &machine->replay;
+
+    replay->fp = fopen(filename, mode == REPLAY_RECORD ? "w" : "r");
+    replay->mode = mode;
+    replay->diverged = FALSE;
+
+    if (!replay->fp)
+    {
+        replay->mode = REPLAY_NONE;
+        return XSM_FAILURE;
+    }
+
+    return XSM_SUCCESS;
+}
+
+/* Log a word read from the console, or its end if not ok */
+void replay_record(xsm_machine *machine, const char *input, int ok)
+{
+    xsm_replay *replay = &machine->replay;
+
+    if (replay->mode != REPLAY_RECORD)
+        return;
+
+    if (ok)
+        fprintf(replay->fp, "%lld =%s\n", machine_get_cycles(machine), input);
+    else
+        fprintf(replay->fp, "%lld !\n", machine_get_cycles(machine));
+
+    /* The log must hold up to a crash */
+    fflush(replay->fp);
+}
+
+/* Read the next logged word, returns FALSE at the end of the input */
+int replay_read(xsm_machine *machine, char *input, int size)
+{
+    xsm_replay *replay = &machine->replay;
+    char line[REPLAY_LINE_LEN], *text, *end;
+    long long cycle;
+
+    input[0] = '\0';
+
+    if (!fgets(line, sizeof(line), replay->fp))
+        return FALSE;
+
+    cycle = strtoll(line, &text, 10);
+
+    if (cycle != machine_get_cycles(machine) && !replay->diverged)
+    {
+        fprintf(stderr, "Replay diverged: input recorded at cycle %lld is read at cycle %lld\n",
+                cycle, machine_get_cycles(machine));
+        replay->diverged = TRUE;
+    }
+
+    if (text[0] != ' ' || text[1] != '=')
+        return FALSE;
+
+    text += 2;
+    end = strchr(text, '\n');
+
+    if (end)
+        *end = '\0';
+
+    strncpy(input, text, size - 1);
+    input[size - 1] = '\0';
+
+    return TRUE;
+}
+
+/* Close the log */
+void replay_close(xsm_machine *machine)
+{
+    if (machine->replay.fp)
+        fclose(machine->replay.fp);
+
+    machine->replay.fp = NULL;
+    machine->replay.mode = REPLAY_NONE;
+}
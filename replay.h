@@ -0,0 +1,30 @@
+#ifndef XSM_REPLAY_H
+
+#define XSM_REPLAY_H
+
+#include <stdio.h>
+
+#include "types.h"
+
+/* Longest line of an input log */
+#define REPLAY_LINE_LEN 64
+
+#define REPLAY_NONE 0
+#define REPLAY_RECORD 1
+#define REPLAY_PLAY 2
+
+typedef struct _xsm_replay
+{
+    FILE *fp;
+    int mode;
+
+    /* Set once a word has been consumed at another cycle than recorded */
+    int diverged;
+} xsm_replay;
+
+int replay_open(xsm_machine *machine, const char *filename, int mode);
+void replay_record(xsm_machine *machine, const char *input, int ok);
+int replay_read(xsm_machine *machine, char *input, int size);
+void replay_close(xsm_machine *machine);
+
+#endif
@@ -0,0 +1,217 @@
+/*
+The sampling profiler. A profiling interval timer interrupts the simulator
+at the given rate and the signal handler records the IP, mode and PTBR of
+the machine in a buffer set aside beforehand. Nothing is added to the
+instruction loops, the samples are tallied when machine_run() ends.
+
+Signals go to the whole process, so one machine is sampled at a time.
+*/
+
+#include "sample.h"
+
+#include "machine.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* The machine being sampled */
+static xsm_machine *volatile _sample_machine;
+
+/* Start sampling the machine at options.sample_hz */
+int sample_start(xsm_machine *machine)
+{
+    xsm_sampler *sampler = &machine->sampler;
+    struct sigaction action;
+    struct itimerval timer;
+    long interval;
+
+    if (sampler->running || _sample_machine)
+        return XSM_FAILURE;
+
+    if (!sampler->samples)
+    {
+        sampler->samples = (sample *)malloc(SAMPLE_BUFFER_SIZE * sizeof(sample));
+
+        if (!sampler->samples)
+            return XSM_FAILURE;
+    }
+
+    _sample_machine = machine;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = sample_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(SIGPROF, &action, NULL) < 0)
+    {
+        _sample_machine = NULL;
+        return XSM_FAILURE;
+    }
+
+    interval = 1000000 / machine->options.sample_hz;
+
+    timer.it_interval.tv_sec = interval / 1000000;
+    timer.it_interval.tv_usec = interval % 1000000;
+    timer.it_value = timer.it_interval;
+
+    if (setitimer(ITIMER_PROF, &timer, NULL) < 0)
+    {
+        _sample_machine = NULL;
+        return XSM_FAILURE;
+    }
+
+    sampler->running = TRUE;
+    return XSM_SUCCESS;
+}
+
+/* Record where the machine is, called on SIGPROF */
+void sample_handler(int signum)
+{
+    xsm_machine *machine = _sample_machine;
+    xsm_sampler *sampler;
+    sample *entry;
+
+    (void)signum;
+
+    if (!machine)
+        return;
+
+    sampler = &machine->sampler;
+
+    if (sampler->count >= SAMPLE_BUFFER_SIZE)
+    {
+        sampler->dropped++;
+        return;
+    }
+
+    entry = &sampler->samples[sampler->count];
+    entry->mode = machine->cpu.mode;
+    entry->ip = sample_word_value(&machine->cpu.regs[IP]);
+    entry->ptbr = sample_word_value(&machine->cpu.regs[PTBR]);
+
+    sampler->count++;
+}
+
+/* Returns the integer in the word if it is known without parsing it, else -1 */
+int sample_word_value(xsm_word *word)
+{
+    if (word->tag == XSM_WORD_INTEGER || word->tag == XSM_WORD_NUMERIC)
+        return word->integer;
+
+    return -1;
+}
+
+/* Stop the timer, the samples stay for the report */
+void sample_stop(xsm_machine *machine)
+{
+    struct itimerval timer;
+
+    if (!machine->sampler.running)
+        return;
+
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    signal(SIGPROF, SIG_IGN);
+
+    _sample_machine = NULL;
+    machine->sampler.running = FALSE;
+}
+
+/* Write the places sampled most often */
+void sample_report(xsm_machine *machine, FILE *fp)
+{
+    xsm_sampler *sampler = &machine->sampler;
+    sample *samples = sampler->samples;
+    sample_row *rows;
+    long long by_mode[2];
+    int count, num_rows, i, j;
+
+    count = sampler->count;
+    by_mode[PRIVILEGE_USER] = by_mode[PRIVILEGE_KERNEL] = 0;
+
+    for (i = 0; i < count; ++i)
+        by_mode[samples[i].mode == PRIVILEGE_KERNEL]++;
+
+    fprintf(fp, "Samples: %d at %d Hz, %lld in KERNEL mode, %lld in USER mode, %d dropped\n",
+            count, machine->options.sample_hz, by_mode[PRIVILEGE_KERNEL], by_mode[PRIVILEGE_USER], (int)sampler->dropped);
+
+    if (count == 0)
+        return;
+
+    rows = (sample_row *)malloc(count * sizeof(sample_row));
+
+    if (!rows)
+        return;
+
+    /* Once sorted, equal samples are next to each other */
+    qsort(samples, count, sizeof(sample), sample_compare);
+
+    num_rows = 0;
+
+    for (i = 0; i < count; i = j)
+    {
+        for (j = i; j < count && !sample_compare(&samples[i], &samples[j]); ++j)
+            ;
+
+        rows[num_rows].place = samples[i];
+        rows[num_rows].count = j - i;
+        num_rows++;
+    }
+
+    qsort(rows, num_rows, sizeof(sample_row), sample_compare_rows);
+
+    fprintf(fp, "\n%-8s %-8s %-8s %10s %7s\n", "Mode", "PTBR", "IP", "Samples", "Share");
+
+    for (i = 0; i < num_rows && i < SAMPLE_TOP; ++i)
+    {
+        if (rows[i].place.mode == PRIVILEGE_KERNEL)
+            fprintf(fp, "%-8s %-8s ", "KERNEL", "-");
+        else
+            fprintf(fp, "%-8s %-8d ", "USER", rows[i].place.ptbr);
+
+        fprintf(fp, "%-8d %10d %6.2f%%\n", rows[i].place.ip, rows[i].count, 100.0 * rows[i].count / count);
+    }
+
+    free(rows);
+}
+
+/* Orders samples by mode, PTBR and IP */
+int sample_compare(const void *a, const void *b)
+{
+    const sample *x = (const sample *)a;
+    const sample *y = (const sample *)b;
+
+    if (x->mode != y->mode)
+        return x->mode - y->mode;
+
+    if (x->mode == PRIVILEGE_USER && x->ptbr != y->ptbr)
+        return x->ptbr < y->ptbr ? -1 : 1;
+
+    if (x->ip != y->ip)
+        return x->ip < y->ip ? -1 : 1;
+
+    return 0;
+}
+
+/* Orders rows by decreasing count, then by place */
+int sample_compare_rows(const void *a, const void *b)
+{
+    const sample_row *x = (const sample_row *)a;
+    const sample_row *y = (const sample_row *)b;
+
+    if (x->count != y->count)
+        return x->count < y->count ? 1 : -1;
+
+    return sample_compare(&x->place, &y->place);
+}
+
+/* Deallocate the sample buffer */
+void sample_destroy(xsm_machine *machine)
+{
+    sample_stop(machine);
+
+    free(machine->sampler.samples);
+    machine->sampler.samples = NULL;
+}
@@ -0,0 +1,52 @@
+#ifndef XSM_SAMPLE_H
+
+#define XSM_SAMPLE_H
+
+#include <signal.h>
+#include <stdio.h>
+
+#include "types.h"
+
+/* Samples kept, later ones are dropped */
+#define SAMPLE_BUFFER_SIZE 262144
+
+/* Highest sampling rate */
+#define SAMPLE_MAX_HZ 10000
+
+/* Rows in the report */
+#define SAMPLE_TOP 20
+
+typedef struct _sample
+{
+    int mode;
+    int ptbr;
+    int ip;
+} sample;
+
+/* A row of the report */
+typedef struct _sample_row
+{
+    sample place;
+    int count;
+} sample_row;
+
+typedef struct _xsm_sampler
+{
+    sample *samples;
+
+    /* Written only by the signal handler */
+    volatile sig_atomic_t count, dropped;
+
+    int running;
+} xsm_sampler;
+
+int sample_start(xsm_machine *machine);
+void sample_handler(int signum);
+int sample_word_value(xsm_word *word);
+void sample_stop(xsm_machine *machine);
+void sample_report(xsm_machine *machine, FILE *fp);
+int sample_compare(const void *a, const void *b);
+int sample_compare_rows(const void *a, const void *b);
+void sample_destroy(xsm_machine *machine);
+
+#endif
@@ -5,9 +5,12 @@ The XSM simulator starts here.
 
 #include "simulator.h"
 
+#include "batch.h"
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 static const int XSM_TIMER_DURATION = XSM_SIMULATOR_DEFTIMER;
 static const int XSM_DISK_DURATION = XSM_SIMULATOR_DEFDISK;
@@ -16,25 +19,77 @@ static const int XSM_CONSOLE_DURATION = XSM_SIMULATOR_DEFCONSOLE;
 /* Start the XSM machine */
 int simulator_run()
 {
+    xsm_machine *machine;
+
+    if (_options.batch)
+        return simulator_run_batch();
+
+    machine = machine_create();
+
+    if (!machine)
+        return XSM_FAILURE;
+
     // Ready
-    disk_init(XSM_DEFAULT_DISK);
+    if (!disk_init(machine, XSM_DEFAULT_DISK, _options.disk_overlay))
+    {
+        fprintf(stderr, "Could not set up the disk %s\n", XSM_DEFAULT_DISK);
+        machine_free(machine);
+        return XSM_FAILURE;
+    }
 
     // Set
-    if (!machine_init(&_options))
+    if (!machine_init(machine, &_options))
         return XSM_FAILURE;
 
+    if (_options.load_snapshot && !machine_load_snapshot(machine, _options.load_snapshot))
+    {
+        fprintf(stderr, "Could not load the snapshot from %s\n", _options.load_snapshot);
+        return XSM_FAILURE;
+    }
+
+    machine_schedule_fork(machine);
+
     // Go
-    if (!machine_run())
+    if (!machine_run(machine))
         return XSM_FAILURE;
 
     printf("Machine is halting.\n");
 
     // Finish
-    machine_destroy();
-    disk_close();
+    machine_destroy(machine);
+    disk_close(machine);
+    machine_free(machine);
     return XSM_SUCCESS;
 }
 
+/* Run the jobs of the manifest with the options as their defaults */
+int simulator_run_batch()
+{
+    xsm_config config;
+    int overlay, workers;
+
+    xsm_default_config(&config);
+
+    config.timer = _options.timer;
+    config.disk = _options.disk;
+    config.console = _options.console;
+    config.jit = _options.jit;
+    config.threaded = _options.threaded;
+
+    /* Jobs must not write to a shared image unless asked to */
+    overlay = _options.disk_overlay;
+
+    if (overlay == XSM_DISK_OVERLAY_NONE)
+        overlay = XSM_DISK_OVERLAY_DISCARD;
+
+    workers = _options.workers;
+
+    if (workers <= 0)
+        workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    return batch_run(_options.batch, &config, overlay, workers);
+}
+
 /* Parse the parameters */
 int simulator_parse_args(int argc, char **argv)
 {
@@ -56,6 +111,173 @@ int simulator_parse_args(int argc, char **argv)
             argv++;
             argc--;
         }
+        else if (!strcmp(*argv, "--disk-overlay"))
+        {
+            argv++;
+            argc--;
+
+            if (argc > 0 && !strcmp(*argv, "discard"))
+                _options.disk_overlay = XSM_DISK_OVERLAY_DISCARD;
+            else if (argc > 0 && !strcmp(*argv, "commit"))
+                _options.disk_overlay = XSM_DISK_OVERLAY_COMMIT;
+            else
+            {
+                printf("--disk-overlay takes discard or commit\n");
+                exit(0);
+            }
+
+            argv++;
+            argc--;
+        }
+        else if (!strcmp(*argv, "--save-snapshot") || !strcmp(*argv, "--load-snapshot"))
+        {
+            if (argc < 2)
+            {
+                printf("%s takes a file name\n", *argv);
+                exit(0);
+            }
+
+            if (!strcmp(*argv, "--save-snapshot"))
+                _options.save_snapshot = argv[1];
+            else
+                _options.load_snapshot = argv[1];
+
+            argv += 2;
+            argc -= 2;
+        }
+        else if (!strcmp(*argv, "--fork-server"))
+        {
+            _options.fork_server = TRUE;
+
+            argv++;
+            argc--;
+        }
+        else if (!strcmp(*argv, "--fork-at"))
+        {
+            argv++;
+            argc--;
+
+            if (argc <= 0 || atoll(*argv) <= 0)
+            {
+                printf("--fork-at takes a positive instruction count\n");
+                exit(0);
+            }
+
+            _options.fork_server = TRUE;
+            _options.fork_at = atoll(*argv);
+
+            argv++;
+            argc--;
+        }
+        else if (!strcmp(*argv, "--batch"))
+        {
+            if (argc < 2)
+            {
+                printf("--batch takes a manifest file\n");
+                exit(0);
+            }
+
+            _options.batch = argv[1];
+
+            argv += 2;
+            argc -= 2;
+        }
+        else if (!strcmp(*argv, "--workers"))
+        {
+            argv++;
+            argc--;
+
+            if (argc <= 0 || atoi(*argv) <= 0)
+            {
+                printf("--workers takes a positive number of threads\n");
+                exit(0);
+            }
+
+            _options.workers = atoi(*argv);
+
+            argv++;
+            argc--;
+        }
+        else if (!strcmp(*argv, "--profile"))
+        {
+            _options.profile |= PROFILE_REPORT;
+
+            argv++;
+            argc--;
+        }
+        else if (!strcmp(*argv, "--sample-profile"))
+        {
+            argv++;
+            argc--;
+
+            if (argc <= 0 || atoi(*argv) <= 0 || atoi(*argv) > SAMPLE_MAX_HZ)
+            {
+                printf("--sample-profile takes a rate in the range 1-%d\n", SAMPLE_MAX_HZ);
+                exit(0);
+            }
+
+            _options.sample_hz = atoi(*argv);
+
+            argv++;
+            argc--;
+        }
+        else if (!strcmp(*argv, "--record") || !strcmp(*argv, "--replay"))
+        {
+            if (argc < 2)
+            {
+                printf("%s takes a file name\n", *argv);
+                exit(0);
+            }
+
+            if (!strcmp(*argv, "--record"))
+                _options.record_input = argv[1];
+            else
+                _options.replay_input = argv[1];
+
+            argv += 2;
+            argc -= 2;
+        }
+        else if (!strcmp(*argv, "--trace"))
+        {
+            if (argc < 2)
+            {
+                printf("--trace takes a file name\n");
+                exit(0);
+            }
+
+            _options.trace = argv[1];
+
+            argv += 2;
+            argc -= 2;
+        }
+        else if (!strcmp(*argv, "--folded"))
+        {
+            if (argc < 2)
+            {
+                printf("--folded takes a file name\n");
+                exit(0);
+            }
+
+            _options.profile |= PROFILE_FOLDED;
+            _options.folded = argv[1];
+
+            argv += 2;
+            argc -= 2;
+        }
+        else if (!strcmp(*argv, "--jit"))
+        {
+            _options.jit = TRUE;
+
+            argv++;
+            argc--;
+        }
+        else if (!strcmp(*argv, "--threaded"))
+        {
+            _options.threaded = TRUE;
+
+            argv++;
+            argc--;
+        }
         else if (!strcmp(*argv, "--timer"))
         {
             argv++;
@@ -113,5 +335,12 @@ int simulator_parse_args(int argc, char **argv)
         }
     }
 
+    /* There is one console input log */
+    if (_options.record_input && _options.replay_input)
+    {
+        printf("--record and --replay can not be used together\n");
+        exit(0);
+    }
+
     return XSM_SUCCESS;
 }
\ No newline at end of file
@@ -15,6 +15,7 @@
 static xsm_options _options;
 
 int simulator_run();
+int simulator_run_batch();
 int simulator_parse_args(int argc, char **argv);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,453 @@
+/*
+Machine snapshots. A snapshot holds everything needed to resume the machine:
+memory, registers, the CPU, pending device events, the exception state and
+the disk blocks written so far. Empty pages and pages seen before are stored
+in a few bytes.
+*/
+
+#include "snapshot.h"
+
+#include "disk.h"
+#include "event.h"
+#include "exception.h"
+#include "machine.h"
+#include "memory.h"
+#include "registers.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Save the machine to the given file */
+int snapshot_save(xsm_machine *machine, const char *filename)
+{
+    FILE *fp;
+    int result;
+
+    fp = fopen(filename, "wb");
+
+    if (!fp)
+        return XSM_FAILURE;
+
+    result = snapshot_save_to(machine, fp);
+
+    if (fclose(fp) != 0)
+        result = XSM_FAILURE;
+
+    return result;
+}
+
+/* Write the machine to the given stream */
+int snapshot_save_to(xsm_machine *machine, FILE *fp)
+{
+    int i, j, page, block, length;
+    unsigned long long hashes[XSM_DISK_BLOCK_NUM];
+    size_t block_size;
+    xsm_word *words;
+    xsm_event *event;
+    char *message, *data;
+
+    fwrite(SNAPSHOT_MAGIC, 1, sizeof(SNAPSHOT_MAGIC), fp);
+    snapshot_write_int(fp, SNAPSHOT_VERSION, 4);
+
+    /* The CPU */
+    snapshot_write_int(fp, machine_get_mode(machine), 4);
+    snapshot_write_int(fp, machine_get_cycles(machine), 8);
+
+    for (i = 0; i < XSM_NUM_REG; ++i)
+        snapshot_write_word(fp, registers_get_register_by_code(machine, i));
+
+    /* The last exception */
+    message = exception_message(machine);
+
+    if (!message)
+        message = "";
+
+    length = strlen(message);
+
+    if (length >= SNAPSHOT_MESSAGE_LEN)
+        length = SNAPSHOT_MESSAGE_LEN - 1;
+
+    snapshot_write_int(fp, exception_code(machine), 4);
+    snapshot_write_int(fp, exception_mode(machine), 4);
+    snapshot_write_int(fp, exception_get_ma(machine), 4);
+    snapshot_write_int(fp, exception_get_epn(machine), 4);
+    snapshot_write_int(fp, length, 4);
+    fwrite(message, 1, length, fp);
+
+    /* Pending device operations */
+    snapshot_write_int(fp, event_count(machine), 4);
+
+    for (i = 0; i < event_count(machine); ++i)
+    {
+        event = event_get(machine, i);
+
+        snapshot_write_int(fp, event->time, 8);
+        snapshot_write_int(fp, event->type, 4);
+        snapshot_write_int(fp, event->disk_op.src_block, 4);
+        snapshot_write_int(fp, event->disk_op.dest_page, 4);
+        snapshot_write_int(fp, event->disk_op.operation, 4);
+        snapshot_write_word(fp, &event->console_op.word);
+        snapshot_write_int(fp, event->console_op.operation, 4);
+    }
+
+    /* Memory */
+    for (page = 0; page < XSM_MEMORY_NUMPAGES; ++page)
+    {
+        words = memory_get_page(machine, page);
+        hashes[page] = snapshot_hash_page(words);
+
+        if (snapshot_page_zero(words))
+        {
+            snapshot_write_int(fp, SNAPSHOT_PAGE_ZERO, 1);
+            continue;
+        }
+
+        for (j = 0; j < page; ++j)
+            if (hashes[j] == hashes[page] && snapshot_page_equal(memory_get_page(machine, j), words))
+                break;
+
+        if (j < page)
+        {
+            snapshot_write_int(fp, SNAPSHOT_PAGE_SAME, 1);
+            snapshot_write_int(fp, j, 4);
+            continue;
+        }
+
+        snapshot_write_int(fp, SNAPSHOT_PAGE_DATA, 1);
+
+        for (i = 0; i < XSM_PAGE_SIZE; ++i)
+            snapshot_write_word(fp, &words[i]);
+    }
+
+    /* The disk blocks that differ from the image */
+    block_size = XSM_DISK_BLOCK_SIZE * XSM_WORD_SIZE;
+
+    for (block = 0; block < XSM_DISK_BLOCK_NUM; ++block)
+    {
+        if (!disk_is_dirty(machine, block))
+        {
+            snapshot_write_int(fp, SNAPSHOT_PAGE_CLEAN, 1);
+            continue;
+        }
+
+        data = disk_get_block(machine, block);
+        hashes[block] = snapshot_hash(SNAPSHOT_HASH_INIT, data, block_size);
+
+        if (snapshot_bytes_zero(data, block_size))
+        {
+            snapshot_write_int(fp, SNAPSHOT_PAGE_ZERO, 1);
+            continue;
+        }
+
+        for (j = 0; j < block; ++j)
+            if (disk_is_dirty(machine, j) && hashes[j] == hashes[block] && !memcmp(disk_get_block(machine, j), data, block_size))
+                break;
+
+        if (j < block)
+        {
+            snapshot_write_int(fp, SNAPSHOT_PAGE_SAME, 1);
+            snapshot_write_int(fp, j, 4);
+            continue;
+        }
+
+        snapshot_write_int(fp, SNAPSHOT_PAGE_DATA, 1);
+        fwrite(data, 1, block_size, fp);
+    }
+
+    if (ferror(fp))
+        return XSM_FAILURE;
+
+    return XSM_SUCCESS;
+}
+
+/* Restore the machine from the given file */
+int snapshot_load(xsm_machine *machine, const char *filename)
+{
+    FILE *fp;
+    int result;
+
+    fp = fopen(filename, "rb");
+
+    if (!fp)
+        return XSM_FAILURE;
+
+    result = snapshot_load_from(machine, fp);
+    fclose(fp);
+
+    return result;
+}
+
+/* Read the machine from the given stream */
+int snapshot_load_from(xsm_machine *machine, FILE *fp)
+{
+    int i, j, page, block, kind, length;
+    int type, mode, ma, epn;
+    size_t block_size;
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    xsm_word *words;
+    xsm_event event;
+    char *data;
+
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)))
+        return XSM_FAILURE;
+
+    if (snapshot_read_int(fp, 4) != SNAPSHOT_VERSION)
+        return XSM_FAILURE;
+
+    /* The CPU */
+    machine_set_mode(machine, snapshot_read_int(fp, 4));
+    machine_set_cycles(machine, snapshot_read_int(fp, 8));
+
+    for (i = 0; i < XSM_NUM_REG; ++i)
+        if (!snapshot_read_word(fp, registers_get_register_by_code(machine, i)))
+            return XSM_FAILURE;
+
+    /* The last exception */
+    type = snapshot_read_int(fp, 4);
+    mode = snapshot_read_int(fp, 4);
+    ma = snapshot_read_int(fp, 4);
+    epn = snapshot_read_int(fp, 4);
+    length = snapshot_read_int(fp, 4);
+
+    if (length < 0 || length >= SNAPSHOT_MESSAGE_LEN)
+        return XSM_FAILURE;
+
+    if (fread(machine->snapshot_message, 1, length, fp) != (size_t)length)
+        return XSM_FAILURE;
+
+    machine->snapshot_message[length] = '\0';
+
+    exception_set(machine, machine->snapshot_message, type, mode);
+    exception_set_ma(machine, ma);
+    exception_set_epn(machine, epn);
+
+    /* Pending device operations replace the ones of the fresh machine */
+    length = snapshot_read_int(fp, 4);
+
+    if (length < 0 || length > XSM_EVENT_MAX)
+        return XSM_FAILURE;
+
+    event_init(machine);
+
+    for (i = 0; i < length; ++i)
+    {
+        event.time = snapshot_read_int(fp, 8);
+        event.type = snapshot_read_int(fp, 4);
+        event.disk_op.src_block = snapshot_read_int(fp, 4);
+        event.disk_op.dest_page = snapshot_read_int(fp, 4);
+        event.disk_op.operation = snapshot_read_int(fp, 4);
+
+        if (!snapshot_read_word(fp, &event.console_op.word))
+            return XSM_FAILURE;
+
+        event.console_op.operation = snapshot_read_int(fp, 4);
+        event_schedule(machine, &event);
+    }
+
+    /* Memory */
+    for (page = 0; page < XSM_MEMORY_NUMPAGES; ++page)
+    {
+        words = memory_get_page(machine, page);
+        kind = snapshot_read_int(fp, 1);
+
+        if (kind == SNAPSHOT_PAGE_ZERO)
+            memset(words, 0, XSM_PAGE_SIZE * sizeof(xsm_word));
+        else if (kind == SNAPSHOT_PAGE_SAME)
+        {
+            j = snapshot_read_int(fp, 4);
+
+            if (j < 0 || j >= page)
+                return XSM_FAILURE;
+
+            memcpy(words, memory_get_page(machine, j), XSM_PAGE_SIZE * sizeof(xsm_word));
+        }
+        else if (kind == SNAPSHOT_PAGE_DATA)
+        {
+            for (i = 0; i < XSM_PAGE_SIZE; ++i)
+                if (!snapshot_read_word(fp, &words[i]))
+                    return XSM_FAILURE;
+        }
+        else
+            return XSM_FAILURE;
+    }
+
+    /* The disk blocks that differ from the image */
+    block_size = XSM_DISK_BLOCK_SIZE * XSM_WORD_SIZE;
+
+    for (block = 0; block < XSM_DISK_BLOCK_NUM; ++block)
+    {
+        data = disk_get_block(machine, block);
+        kind = snapshot_read_int(fp, 1);
+
+        if (kind == SNAPSHOT_PAGE_CLEAN)
+            continue;
+
+        if (kind == SNAPSHOT_PAGE_ZERO)
+            memset(data, 0, block_size);
+        else if (kind == SNAPSHOT_PAGE_SAME)
+        {
+            j = snapshot_read_int(fp, 4);
+
+            if (j < 0 || j >= block)
+                return XSM_FAILURE;
+
+            memcpy(data, disk_get_block(machine, j), block_size);
+        }
+        else if (kind == SNAPSHOT_PAGE_DATA)
+        {
+            if (fread(data, 1, block_size, fp) != block_size)
+                return XSM_FAILURE;
+        }
+        else
+            return XSM_FAILURE;
+
+        disk_set_dirty(machine, block);
+    }
+
+    if (ferror(fp) || feof(fp))
+        return XSM_FAILURE;
+
+    return XSM_SUCCESS;
+}
+
+/* Write the low bytes of the value, least significant first */
+void snapshot_write_int(FILE *fp, long long value, int bytes)
+{
+    int i;
+
+    for (i = 0; i < bytes; ++i)
+        fputc((int)((unsigned long long)value >> (i * 8)) & 0xFF, fp);
+}
+
+/* Read a signed value of the given number of bytes */
+long long snapshot_read_int(FILE *fp, int bytes)
+{
+    int i, byte;
+    unsigned long long value = 0;
+
+    for (i = 0; i < bytes; ++i)
+    {
+        byte = fgetc(fp);
+
+        if (byte == EOF)
+            return 0;
+
+        value |= (unsigned long long)byte << (i * 8);
+    }
+
+    if (bytes < 8 && (value >> (bytes * 8 - 1)) & 1)
+        value |= ~0ULL << (bytes * 8);
+
+    return (long long)value;
+}
+
+/* Write the given word, integers are kept binary */
+void snapshot_write_word(FILE *fp, xsm_word *word)
+{
+    if (word->tag == XSM_WORD_INTEGER)
+    {
+        snapshot_write_int(fp, SNAPSHOT_WORD_INTEGER, 1);
+        snapshot_write_int(fp, word->integer, 4);
+    }
+    else
+    {
+        snapshot_write_int(fp, SNAPSHOT_WORD_TEXT, 1);
+        fwrite(word->val, 1, XSM_WORD_SIZE, fp);
+    }
+}
+
+/* Read a word */
+int snapshot_read_word(FILE *fp, xsm_word *word)
+{
+    char data[XSM_WORD_SIZE];
+    int kind;
+
+    kind = snapshot_read_int(fp, 1);
+
+    if (kind == SNAPSHOT_WORD_INTEGER)
+        return word_store_integer(word, snapshot_read_int(fp, 4));
+
+    if (kind != SNAPSHOT_WORD_TEXT)
+        return XSM_FAILURE;
+
+    if (fread(data, 1, XSM_WORD_SIZE, fp) != XSM_WORD_SIZE)
+        return XSM_FAILURE;
+
+    return word_store_raw(word, data);
+}
+
+/* Continue the FNV-1a hash with the given data */
+unsigned long long snapshot_hash(unsigned long long hash, const void *data, size_t size)
+{
+    size_t i;
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    for (i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/* Hash the values of the words in the given page */
+unsigned long long snapshot_hash_page(xsm_word *page)
+{
+    int i;
+    unsigned long long hash = SNAPSHOT_HASH_INIT;
+
+    for (i = 0; i < XSM_PAGE_SIZE; ++i)
+        if (page[i].tag == XSM_WORD_INTEGER)
+            hash = snapshot_hash(hash, &page[i].integer, sizeof(int));
+        else
+            hash = snapshot_hash(hash, page[i].val, XSM_WORD_SIZE);
+
+    return hash;
+}
+
+/* Checks whether the two pages would be stored the same */
+int snapshot_page_equal(xsm_word *a, xsm_word *b)
+{
+    int i;
+
+    for (i = 0; i < XSM_PAGE_SIZE; ++i)
+    {
+        if ((a[i].tag == XSM_WORD_INTEGER) != (b[i].tag == XSM_WORD_INTEGER))
+            return FALSE;
+
+        if (a[i].tag == XSM_WORD_INTEGER)
+        {
+            if (a[i].integer != b[i].integer)
+                return FALSE;
+        }
+        else if (memcmp(a[i].val, b[i].val, XSM_WORD_SIZE))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Checks whether every word of the page is empty text */
+int snapshot_page_zero(xsm_word *page)
+{
+    int i;
+
+    for (i = 0; i < XSM_PAGE_SIZE; ++i)
+        if (page[i].tag == XSM_WORD_INTEGER || !snapshot_bytes_zero(page[i].val, XSM_WORD_SIZE))
+            return FALSE;
+
+    return TRUE;
+}
+
+/* Checks whether all the given bytes are zero */
+int snapshot_bytes_zero(const char *data, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; ++i)
+        if (data[i])
+            return FALSE;
+
+    return TRUE;
+}
@@ -0,0 +1,42 @@
+#ifndef XSM_SNAPSHOT_H
+
+#define XSM_SNAPSHOT_H
+
+#include <stdio.h>
+
+#include "types.h"
+
+#define SNAPSHOT_MAGIC "XSMSNAP"
+#define SNAPSHOT_VERSION 1
+
+/* How a memory page or a disk block is stored */
+#define SNAPSHOT_PAGE_CLEAN 0   /* Disk block not written, not stored */
+#define SNAPSHOT_PAGE_ZERO 1    /* Every word empty */
+#define SNAPSHOT_PAGE_SAME 2    /* Same as an earlier page, stored as its index */
+#define SNAPSHOT_PAGE_DATA 3    /* Stored in full */
+
+/* How a word is stored */
+#define SNAPSHOT_WORD_TEXT 0
+#define SNAPSHOT_WORD_INTEGER 1
+
+/* Longest exception message kept in a snapshot */
+#define SNAPSHOT_MESSAGE_LEN 256
+
+/* Starting value of the page hashes */
+#define SNAPSHOT_HASH_INIT 14695981039346656037ULL
+
+int snapshot_save(xsm_machine *machine, const char *filename);
+int snapshot_save_to(xsm_machine *machine, FILE *fp);
+int snapshot_load(xsm_machine *machine, const char *filename);
+int snapshot_load_from(xsm_machine *machine, FILE *fp);
+void snapshot_write_int(FILE *fp, long long value, int bytes);
+long long snapshot_read_int(FILE *fp, int bytes);
+void snapshot_write_word(FILE *fp, xsm_word *word);
+int snapshot_read_word(FILE *fp, xsm_word *word);
+unsigned long long snapshot_hash(unsigned long long hash, const void *data, size_t size);
+unsigned long long snapshot_hash_page(xsm_word *page);
+int snapshot_page_equal(xsm_word *a, xsm_word *b);
+int snapshot_page_zero(xsm_word *page);
+int snapshot_bytes_zero(const char *data, size_t size);
+
+#endif
@@ -4,74 +4,72 @@ An interface which handles LEX tokens.
 
 #include "tokenize.h"
 
-static YYSTYPE _curr_token;
-static int _la_exists;
-static int _curr_token_type;
+#include "machine.h"
 
 /* Initialises the tokens */
-int tokenize_init()
+int tokenize_init(xsm_machine *machine)
 {
-    _la_exists = FALSE;
-    return XSM_SUCCESS;
+    machine->tokens.la_exists = FALSE;
+    return lexer_init(machine, &machine->tokens.scanner);
 }
 
 /* Returns next token */
-int tokenize_next_token(YYSTYPE *token_info)
+int tokenize_next_token(xsm_machine *machine, YYSTYPE *token_info)
 {
     int token_type;
 
-    if (_la_exists)
+    if (machine->tokens.la_exists)
     {
-        *token_info = _curr_token;
-        _la_exists = FALSE;
-        return _curr_token_type;
+        *token_info = machine->tokens.curr_token;
+        machine->tokens.la_exists = FALSE;
+        return machine->tokens.curr_token_type;
     }
     else
     {
-        token_type = yylex();
-        *token_info = yylval;
+        token_type = yylex(token_info, machine->tokens.scanner);
         return token_type;
     }
 }
 /* Peeks the next token */
-int tokenize_peek(YYSTYPE *token_info)
+int tokenize_peek(xsm_machine *machine, YYSTYPE *token_info)
 {
-    if (_la_exists)
+    if (machine->tokens.la_exists)
     {
-        *token_info = _curr_token;
-        return _curr_token_type;
+        *token_info = machine->tokens.curr_token;
+        return machine->tokens.curr_token_type;
     }
     else
     {
-        _curr_token_type = yylex();
-        _curr_token = yylval;
-        *token_info = _curr_token;
-        _la_exists = TRUE;
-        return _curr_token_type;
+        machine->tokens.curr_token_type = yylex(&machine->tokens.curr_token, machine->tokens.scanner);
+        *token_info = machine->tokens.curr_token;
+        machine->tokens.la_exists = TRUE;
+        return machine->tokens.curr_token_type;
     }
 }
 
 /* Skips the next token */
-int tokenize_skip_token()
+int tokenize_skip_token(xsm_machine *machine)
 {
     YYSTYPE token_info;
-    return tokenize_next_token(&token_info);
+    return tokenize_next_token(machine, &token_info);
 }
 
 /* Closes the tokens */
-int tokenize_close()
+int tokenize_close(xsm_machine *machine)
 {
+    lexer_destroy(machine->tokens.scanner);
+    machine->tokens.scanner = NULL;
     return XSM_SUCCESS;
 }
 
 /* Resets the tokens */
-void tokenize_reset()
+void tokenize_reset(xsm_machine *machine)
 {
-    _la_exists = FALSE;
+    machine->tokens.la_exists = FALSE;
 }
 
 /* Clears the token stream */
-void tokenize_clear_stream()
+void tokenize_clear_stream(xsm_machine *machine)
 {
-    lexer_buffer_reset();
+    lexer_buffer_reset(machine->tokens.scanner);
 }
\ No newline at end of file
@@ -5,14 +5,23 @@
 #include "lexer.h"
 #include "types.h"
 
-int tokenize_init();
-int tokenize_next_token(YYSTYPE *token_info);
-int tokenize_peek(YYSTYPE *token_info);
-int tokenize_skip_token();
-int tokenize_close();
-void tokenize_reset();
-void tokenize_clear_stream();
+typedef struct _xsm_tokenizer
+{
+    /* The scanner, and the token looked ahead at */
+    void *scanner;
+    YYSTYPE curr_token;
+    int la_exists;
+    int curr_token_type;
+} xsm_tokenizer;
 
-int yylex();
+int tokenize_init(xsm_machine *machine);
+int tokenize_next_token(xsm_machine *machine, YYSTYPE *token_info);
+int tokenize_peek(xsm_machine *machine, YYSTYPE *token_info);
+int tokenize_skip_token(xsm_machine *machine);
+int tokenize_close(xsm_machine *machine);
+void tokenize_reset(xsm_machine *machine);
+void tokenize_clear_stream(xsm_machine *machine);
+
+int yylex(YYSTYPE *token_info, void *scanner);
 
 #endif
\ No newline at end of file
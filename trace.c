@@ -0,0 +1,537 @@
+/*
+The instruction trace. Every instruction the interpreter runs is recorded
+with its IP, mode, PTBR and opcode, and with the registers and memory it
+changed. The trace starts with the registers as they were, after that a
+record stores only what differs from the state before it:
+
+    flags, opcode, IP as a difference from the last IP,
+    [PTBR], [registers changed], [memory words written], [pages written]
+
+A page written is stored whole, with every word as it was after the
+instruction, so memory can be rebuilt from the records. A record that
+would hold more pages than it can is flagged with TRACE_OVERFLOW.
+
+Numbers are variable length, small differences take a byte. Records are
+gathered in a large buffer and written out when it fills. The IP is left
+out of the registers changed, it is the IP of the next record. A record is
+completed when the next instruction starts, so the changes of an
+instruction that raises an exception include entering its handler.
+*/
+
+#include "trace.h"
+
+#include "machine.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Start a trace in the file, it is written from the first instruction */
+int trace_open(xsm_machine *machine, const char *filename)
+{
+    xsm_trace *trace = &machine->trace;
+
+    memset(trace, 0, sizeof(xsm_trace));
+
+    trace->buffer = (unsigned char *)malloc(TRACE_BUFFER_SIZE);
+
+    if (!trace->buffer)
+        return XSM_FAILURE;
+
+    trace->fp = fopen(filename, "wb");
+
+    if (!trace->fp)
+    {
+        free(trace->buffer);
+        trace->buffer = NULL;
+        return XSM_FAILURE;
+    }
+
+    return XSM_SUCCESS;
+}
+
+/* An instruction is about to be fetched from the IP */
+void trace_begin(xsm_machine *machine, int ip_val)
+{
+    xsm_trace *trace = &machine->trace;
+    int i;
+
+    if (!trace->fp)
+        return;
+
+    /* The last instruction did not finish */
+    if (trace->pending)
+        trace_end(machine, TRUE);
+
+    /* The starting state, loaded snapshots included */
+    if (!trace->started)
+    {
+        fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), trace->fp);
+        trace_put_byte(trace, TRACE_VERSION);
+
+        for (i = 0; i < XSM_NUM_REG; ++i)
+        {
+            trace_put_word(trace, &machine->cpu.regs[i]);
+            trace->registers[i] = machine->cpu.regs[i];
+        }
+
+        trace->ip = ip_val;
+        trace->ptbr = word_get_integer(&machine->cpu.regs[PTBR]);
+        trace->address = 0;
+        trace->started = TRUE;
+    }
+
+    trace->pending = TRUE;
+    trace->record.flags = 0;
+    trace->record.opcode = TRACE_NO_OPCODE;
+    trace->record.ip = ip_val;
+    trace->record.ptbr = word_get_integer(&machine->cpu.regs[PTBR]);
+    trace->record.num_writes = 0;
+    trace->record.num_pages = 0;
+
+    if (machine_get_mode(machine) == PRIVILEGE_KERNEL)
+        trace->record.flags |= TRACE_KERNEL;
+}
+
+/* The instruction being run has been fetched */
+void trace_opcode(xsm_machine *machine, int opcode)
+{
+    if (opcode >= 0 && opcode < XSM_INSTRUCTION_COUNT)
+        machine->trace.record.opcode = opcode;
+}
+
+/* The instruction being run writes to the address */
+void trace_write(xsm_machine *machine, int address)
+{
+    trace_record *record = &machine->trace.record;
+    int i;
+
+    if (!machine->trace.pending)
+        return;
+
+    for (i = 0; i < record->num_writes; ++i)
+        if (record->writes[i] == address)
+            return;
+
+    if (record->num_writes < TRACE_MAX_WRITES)
+        record->writes[record->num_writes++] = address;
+    else
+        trace_page(machine, address / XSM_PAGE_SIZE);
+}
+
+/* The instruction being run, or a device, writes the whole page */
+void trace_page(xsm_machine *machine, int page)
+{
+    trace_record *record = &machine->trace.record;
+    int i;
+
+    if (!machine->trace.pending)
+        return;
+
+    for (i = 0; i < record->num_pages; ++i)
+        if (record->pages[i] == page)
+            return;
+
+    if (record->num_pages < TRACE_MAX_PAGES)
+        record->pages[record->num_pages++] = page;
+    else
+        record->flags |= TRACE_OVERFLOW;
+}
+
+/* Write the record of the instruction that has run */
+void trace_end(xsm_machine *machine, int exception)
+{
+    xsm_trace *trace = &machine->trace;
+    trace_record *record = &trace->record;
+    int i, j, changed[XSM_NUM_REG], num_changed;
+    xsm_word *page;
+
+    if (!trace->pending)
+        return;
+
+    trace->pending = FALSE;
+
+    if (exception)
+        record->flags |= TRACE_EXCEPTION;
+
+    if (record->ptbr != trace->ptbr)
+        record->flags |= TRACE_PTBR;
+
+    num_changed = 0;
+
+    /* The IP is that of the next record, most registers are left alone byte for byte */
+    for (i = 0; i < XSM_NUM_REG; ++i)
+        if (i != IP && memcmp(&machine->cpu.regs[i], &trace->registers[i], sizeof(xsm_word)) &&
+            !trace_word_equal(&machine->cpu.regs[i], &trace->registers[i]))
+        {
+            changed[num_changed++] = i;
+            trace->registers[i] = machine->cpu.regs[i];
+        }
+
+    if (num_changed)
+        record->flags |= TRACE_REGISTERS;
+
+    if (record->num_writes)
+        record->flags |= TRACE_MEMORY;
+
+    if (record->num_pages)
+        record->flags |= TRACE_PAGES;
+
+    trace_put_byte(trace, record->flags);
+    trace_put_byte(trace, record->opcode);
+    trace_put_signed(trace, (long long)record->ip - trace->ip);
+    trace->ip = record->ip;
+
+    if (record->flags & TRACE_PTBR)
+    {
+        trace_put_signed(trace, record->ptbr);
+        trace->ptbr = record->ptbr;
+    }
+
+    if (num_changed)
+    {
+        trace_put_byte(trace, num_changed);
+
+        for (i = 0; i < num_changed; ++i)
+        {
+            trace_put_byte(trace, changed[i]);
+            trace_put_word(trace, &machine->cpu.regs[changed[i]]);
+        }
+    }
+
+    if (record->num_writes)
+    {
+        trace_put_varint(trace, record->num_writes);
+
+        for (i = 0; i < record->num_writes; ++i)
+        {
+            trace_put_signed(trace, (long long)record->writes[i] - trace->address);
+            trace_put_word(trace, memory_get_word(machine, record->writes[i]));
+            trace->address = record->writes[i];
+        }
+    }
+
+    if (record->num_pages)
+    {
+        trace_put_byte(trace, record->num_pages);
+
+        for (i = 0; i < record->num_pages; ++i)
+        {
+            trace_put_byte(trace, record->pages[i]);
+            page = memory_get_page(machine, record->pages[i]);
+
+            for (j = 0; j < XSM_PAGE_SIZE; ++j)
+                trace_put_word(trace, &page[j]);
+        }
+    }
+}
+
+/* Finish the trace */
+void trace_close(xsm_machine *machine)
+{
+    xsm_trace *trace = &machine->trace;
+
+    if (!trace->fp)
+        return;
+
+    /* An instruction left unfinished stopped the machine */
+    trace_end(machine, TRUE);
+
+    if (!trace_flush(trace) || fclose(trace->fp) != 0)
+        fprintf(stderr, "Could not write the trace\n");
+
+    free(trace->buffer);
+
+    trace->fp = NULL;
+    trace->buffer = NULL;
+}
+
+/* Append a byte to the trace */
+void trace_put_byte(xsm_trace *trace, int byte)
+{
+    if (trace->used == TRACE_BUFFER_SIZE)
+        trace_flush(trace);
+
+    trace->buffer[trace->used++] = (unsigned char)byte;
+}
+
+/* Append a number, seven bits a byte with the high bit set on all but the last */
+void trace_put_varint(xsm_trace *trace, unsigned long long value)
+{
+    while (value >= 0x80)
+    {
+        trace_put_byte(trace, (int)(value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+
+    trace_put_byte(trace, (int)value);
+}
+
+/* Append a signed number, small magnitudes of either sign stay small */
+void trace_put_signed(xsm_trace *trace, long long value)
+{
+    trace_put_varint(trace, ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+}
+
+/* Append a word, as a number if it holds one in binary, else as text */
+void trace_put_word(xsm_trace *trace, xsm_word *word)
+{
+    int i, length;
+
+    if (word->tag == XSM_WORD_INTEGER)
+    {
+        trace_put_byte(trace, TRACE_VALUE_INTEGER);
+        trace_put_signed(trace, word->integer);
+        return;
+    }
+
+    for (length = 0; length < XSM_WORD_SIZE && word->val[length]; ++length)
+        ;
+
+    trace_put_byte(trace, TRACE_VALUE_TEXT);
+    trace_put_byte(trace, length);
+
+    for (i = 0; i < length; ++i)
+        trace_put_byte(trace, word->val[i]);
+}
+
+/* Write out the buffer */
+int trace_flush(xsm_trace *trace)
+{
+    size_t written;
+
+    written = fwrite(trace->buffer, 1, trace->used, trace->fp);
+
+    if (written != trace->used)
+    {
+        trace->used = 0;
+        return XSM_FAILURE;
+    }
+
+    trace->used = 0;
+    return XSM_SUCCESS;
+}
+
+/* Checks whether two words hold the same text, a binary integer is the text of its number */
+int trace_word_equal(xsm_word *a, xsm_word *b)
+{
+    char text_a[XSM_WORD_SIZE + 1], text_b[XSM_WORD_SIZE + 1];
+
+    if (a->tag == XSM_WORD_INTEGER && b->tag == XSM_WORD_INTEGER)
+        return a->integer == b->integer;
+
+    if (a->tag != XSM_WORD_INTEGER && b->tag != XSM_WORD_INTEGER)
+        return !strncmp(a->val, b->val, XSM_WORD_SIZE);
+
+    if (a->tag == XSM_WORD_INTEGER)
+        snprintf(text_a, sizeof(text_a), "%d", a->integer);
+    else
+        snprintf(text_a, sizeof(text_a), "%.*s", XSM_WORD_SIZE, a->val);
+
+    if (b->tag == XSM_WORD_INTEGER)
+        snprintf(text_b, sizeof(text_b), "%d", b->integer);
+    else
+        snprintf(text_b, sizeof(text_b), "%.*s", XSM_WORD_SIZE, b->val);
+
+    return !strcmp(text_a, text_b);
+}
+
+/* Open a trace and read its starting state */
+int trace_reader_open(trace_reader *reader, const char *filename)
+{
+    char magic[sizeof(TRACE_MAGIC)];
+    int i;
+
+    memset(reader, 0, sizeof(trace_reader));
+
+    reader->fp = fopen(filename, "rb");
+
+    if (!reader->fp)
+        return XSM_FAILURE;
+
+    if (fread(magic, 1, strlen(TRACE_MAGIC), reader->fp) != strlen(TRACE_MAGIC) ||
+        memcmp(magic, TRACE_MAGIC, strlen(TRACE_MAGIC)) || fgetc(reader->fp) != TRACE_VERSION)
+    {
+        trace_reader_close(reader);
+        return XSM_FAILURE;
+    }
+
+    for (i = 0; i < XSM_NUM_REG; ++i)
+        if (!trace_get_word(reader->fp, &reader->registers[i]))
+        {
+            trace_reader_close(reader);
+            return XSM_FAILURE;
+        }
+
+    /* The first record is stored against the starting IP and PTBR, as trace_begin() does */
+    reader->ip = word_get_integer(&reader->registers[IP]);
+    reader->ptbr = word_get_integer(&reader->registers[PTBR]);
+
+    return XSM_SUCCESS;
+}
+
+/* Read the next record, FALSE at the end of the trace */
+int trace_read_record(trace_reader *reader, trace_record *record)
+{
+    FILE *fp = reader->fp;
+    long long value;
+    unsigned long long count;
+    int i, j, c;
+
+    if ((c = fgetc(fp)) == EOF)
+        return FALSE;
+
+    record->flags = c;
+    record->opcode = fgetc(fp);
+
+    if (record->opcode == EOF || !trace_get_signed(fp, &value))
+        return FALSE;
+
+    reader->ip += (int)value;
+    record->ip = reader->ip;
+
+    if (record->flags & TRACE_PTBR)
+    {
+        if (!trace_get_signed(fp, &value))
+            return FALSE;
+
+        reader->ptbr = (int)value;
+    }
+
+    record->ptbr = reader->ptbr;
+    record->num_registers = 0;
+    record->num_writes = 0;
+    record->num_pages = 0;
+
+    if (record->flags & TRACE_REGISTERS)
+    {
+        record->num_registers = fgetc(fp);
+
+        if (record->num_registers < 0 || record->num_registers > XSM_NUM_REG)
+            return FALSE;
+
+        for (i = 0; i < record->num_registers; ++i)
+        {
+            record->registers[i] = fgetc(fp);
+
+            if (record->registers[i] < 0 || record->registers[i] >= XSM_NUM_REG)
+                return FALSE;
+
+            if (!trace_get_word(fp, &record->register_values[i]))
+                return FALSE;
+
+            reader->registers[record->registers[i]] = record->register_values[i];
+        }
+    }
+
+    if (record->flags & TRACE_MEMORY)
+    {
+        if (!trace_get_varint(fp, &count) || count > TRACE_MAX_WRITES)
+            return FALSE;
+
+        record->num_writes = (int)count;
+
+        for (i = 0; i < record->num_writes; ++i)
+        {
+            if (!trace_get_signed(fp, &value))
+                return FALSE;
+
+            reader->address += (int)value;
+            record->writes[i] = reader->address;
+
+            if (!trace_get_word(fp, &record->write_values[i]))
+                return FALSE;
+        }
+    }
+
+    if (record->flags & TRACE_PAGES)
+    {
+        record->num_pages = fgetc(fp);
+
+        if (record->num_pages < 0 || record->num_pages > TRACE_MAX_PAGES)
+            return FALSE;
+
+        for (i = 0; i < record->num_pages; ++i)
+        {
+            record->pages[i] = fgetc(fp);
+
+            for (j = 0; j < XSM_PAGE_SIZE; ++j)
+                if (!trace_get_word(fp, &record->page_values[i][j]))
+                    return FALSE;
+        }
+    }
+
+    return !ferror(fp) && !feof(fp);
+}
+
+/* Read a number written by trace_put_varint() */
+int trace_get_varint(FILE *fp, unsigned long long *value)
+{
+    int c, shift;
+
+    *value = 0;
+
+    for (shift = 0; shift < 64; shift += 7)
+    {
+        if ((c = fgetc(fp)) == EOF)
+            return XSM_FAILURE;
+
+        *value |= (unsigned long long)(c & 0x7f) << shift;
+
+        if (!(c & 0x80))
+            return XSM_SUCCESS;
+    }
+
+    return XSM_FAILURE;
+}
+
+/* Read a number written by trace_put_signed() */
+int trace_get_signed(FILE *fp, long long *value)
+{
+    unsigned long long raw;
+
+    if (!trace_get_varint(fp, &raw))
+        return XSM_FAILURE;
+
+    *value = (long long)(raw >> 1) ^ -(long long)(raw & 1);
+    return XSM_SUCCESS;
+}
+
+/* Read a word written by trace_put_word() */
+int trace_get_word(FILE *fp, xsm_word *word)
+{
+    char text[XSM_WORD_SIZE + 1];
+    long long value;
+    int kind, length;
+
+    kind = fgetc(fp);
+
+    if (kind == TRACE_VALUE_INTEGER)
+    {
+        if (!trace_get_signed(fp, &value))
+            return XSM_FAILURE;
+
+        word_store_integer(word, (int)value);
+        return XSM_SUCCESS;
+    }
+
+    length = fgetc(fp);
+
+    if (kind != TRACE_VALUE_TEXT || length < 0 || length > XSM_WORD_SIZE)
+        return XSM_FAILURE;
+
+    if (fread(text, 1, length, fp) != (size_t)length)
+        return XSM_FAILURE;
+
+    text[length] = '\0';
+    word_store_string(word, text);
+    return XSM_SUCCESS;
+}
+
+/* Close a trace being read */
+void trace_reader_close(trace_reader *reader)
+{
+    if (reader->fp)
+        fclose(reader->fp);
+
+    reader->fp = NULL;
+}
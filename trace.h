@@ -0,0 +1,104 @@
+#ifndef XSM_TRACE_H
+
+#define XSM_TRACE_H
+
+#include <stdio.h>
+
+#include "types.h"
+
+#define TRACE_MAGIC "XSMTRACE"
+#define TRACE_VERSION 2
+
+/* Bytes gathered before they are written out */
+#define TRACE_BUFFER_SIZE (1 << 20)
+
+/* Memory words recorded for one instruction, further writes are recorded by page with its words */
+#define TRACE_MAX_WRITES 64
+#define TRACE_MAX_PAGES 8
+
+/* Flags of a record */
+#define TRACE_KERNEL 1      /* Ran in KERNEL mode */
+#define TRACE_PTBR 2        /* PTBR differs from the last record */
+#define TRACE_REGISTERS 4   /* Registers changed */
+#define TRACE_MEMORY 8      /* Memory words written */
+#define TRACE_PAGES 16      /* Whole pages written */
+#define TRACE_EXCEPTION 32  /* Raised an exception, its handling is part of the changes */
+#define TRACE_OVERFLOW 64   /* Wrote more pages than a record holds, the rest are left out */
+
+/* Opcode of a record whose instruction could not be fetched */
+#define TRACE_NO_OPCODE 255
+
+/* How a value is stored */
+#define TRACE_VALUE_INTEGER 0
+#define TRACE_VALUE_TEXT 1
+
+/* Changes made by one instruction */
+typedef struct _trace_record
+{
+    int flags;
+    int opcode;
+    int ip;
+    int ptbr;
+
+    int num_registers;
+    int registers[XSM_NUM_REG];
+    xsm_word register_values[XSM_NUM_REG];
+
+    int num_writes;
+    int writes[TRACE_MAX_WRITES];
+    xsm_word write_values[TRACE_MAX_WRITES];
+
+    int num_pages;
+    int pages[TRACE_MAX_PAGES];
+    xsm_word page_values[TRACE_MAX_PAGES][XSM_PAGE_SIZE];
+} trace_record;
+
+typedef struct _xsm_trace
+{
+    FILE *fp;
+    unsigned char *buffer;
+    size_t used;
+
+    /* Set once the header has been written */
+    int started;
+
+    /* Record of the instruction being run */
+    int pending;
+    trace_record record;
+
+    /* State as of the last record, changes are stored against it */
+    xsm_word registers[XSM_NUM_REG];
+    int ip, ptbr, address;
+} xsm_trace;
+
+/* Reads a trace back */
+typedef struct _trace_reader
+{
+    FILE *fp;
+
+    /* State as of the last record read */
+    xsm_word registers[XSM_NUM_REG];
+    int ip, ptbr, address;
+} trace_reader;
+
+int trace_open(xsm_machine *machine, const char *filename);
+void trace_begin(xsm_machine *machine, int ip_val);
+void trace_opcode(xsm_machine *machine, int opcode);
+void trace_write(xsm_machine *machine, int address);
+void trace_page(xsm_machine *machine, int page);
+void trace_end(xsm_machine *machine, int exception);
+void trace_close(xsm_machine *machine);
+void trace_put_byte(xsm_trace *trace, int byte);
+void trace_put_varint(xsm_trace *trace, unsigned long long value);
+void trace_put_signed(xsm_trace *trace, long long value);
+void trace_put_word(xsm_trace *trace, xsm_word *word);
+int trace_flush(xsm_trace *trace);
+int trace_word_equal(xsm_word *a, xsm_word *b);
+int trace_reader_open(trace_reader *reader, const char *filename);
+int trace_read_record(trace_reader *reader, trace_record *record);
+int trace_get_varint(FILE *fp, unsigned long long *value);
+int trace_get_signed(FILE *fp, long long *value);
+int trace_get_word(FILE *fp, xsm_word *word);
+void trace_reader_close(trace_reader *reader);
+
+#endif
@@ -7,9 +7,20 @@
 #define XSM_TYPE_STRING 0
 #define XSM_TYPE_INTEGER 1
 
+/* Word representations */
+#define XSM_WORD_RAW 0      /* Text, not yet classified */
+#define XSM_WORD_STRING 1   /* Text, not an integer */
+#define XSM_WORD_NUMERIC 2  /* Text holding an integer */
+#define XSM_WORD_INTEGER 3  /* Binary integer, text not materialised */
+
 typedef struct _xsm_word
 {
     char val[XSM_WORD_SIZE];
+    int integer;
+    int tag;
 } xsm_word;
 
+/* A whole machine, every part of the simulator works on one */
+typedef struct _xsm_machine xsm_machine;
+
 #endif
\ No newline at end of file
@@ -9,18 +9,37 @@ Utility functions. An interface between UNIX and XSM data types.
 #include <memory.h>
 #include <stdio.h>
 
-/* Determine the type of data in the word */
-int word_get_unix_type(xsm_word *word)
+/* Determine the type of the text in the word and cache its integer value */
+void word_classify(xsm_word *word)
 {
-    char *data = word->val;
+    char data[XSM_WORD_SIZE + 1];
     unsigned int index = 0;
 
+    memcpy(data, word->val, XSM_WORD_SIZE);
+    data[XSM_WORD_SIZE] = '\0';
+
+    word->integer = atoi(data);
+    word->tag = XSM_WORD_NUMERIC;
+
     if (data[0] == '+' || data[0] == '-')
         index++;
 
     for (; data[index] != '\0'; index++)
         if (data[index] < '0' || data[index] > '9')
-            return XSM_TYPE_STRING;
+        {
+            word->tag = XSM_WORD_STRING;
+            return;
+        }
+}
+
+/* Determine the type of data in the word */
+int word_get_unix_type(xsm_word *word)
+{
+    if (word->tag == XSM_WORD_RAW)
+        word_classify(word);
+
+    if (word->tag == XSM_WORD_STRING)
+        return XSM_TYPE_STRING;
 
     return XSM_TYPE_INTEGER;
 }
@@ -28,21 +47,30 @@ int word_get_unix_type(xsm_word *word)
 /* Retrieve the integer value in the given word */
 int word_get_integer(xsm_word *word)
 {
-    int n;
-    return atoi(word->val);
+    if (word->tag == XSM_WORD_RAW)
+        word_classify(word);
+
+    return word->integer;
 }
 
 /* Retrieve the string value in the given word */
 char *word_get_string(xsm_word *word)
 {
+    /* Materialise the text of a binary integer */
+    if (word->tag == XSM_WORD_INTEGER)
+    {
+        sprintf(word->val, "%d", word->integer);
+        word->tag = XSM_WORD_NUMERIC;
+    }
+
     return word->val;
 }
 
 /* Store the integer value in the given word */
 int word_store_integer(xsm_word *word, int integer)
 {
-    char *data = word->val;
-    sprintf(data, "%d", integer);
+    word->integer = integer;
+    word->tag = XSM_WORD_INTEGER;
     return XSM_SUCCESS;
 }
 
@@ -51,9 +79,24 @@ int word_store_string(xsm_word *word, const char *str)
 {
     char *data = word->val;
     strncpy(data, str, XSM_WORD_SIZE);
+    word->tag = XSM_WORD_RAW;
     return XSM_SUCCESS;
 }
 
+/* Store the raw XSM_WORD_SIZE bytes in the given word */
+int word_store_raw(xsm_word *word, const char *data)
+{
+    memcpy(word->val, data, XSM_WORD_SIZE);
+    word->tag = XSM_WORD_RAW;
+    return XSM_SUCCESS;
+}
+
+/* Retrieve the raw XSM_WORD_SIZE bytes of the given word */
+void word_retrieve_raw(char *dest, xsm_word *word)
+{
+    memcpy(dest, word_get_string(word), XSM_WORD_SIZE);
+}
+
 /* Copy the value in the src word to dest word */
 void word_copy(xsm_word *dest, xsm_word *src)
 {
@@ -64,10 +107,10 @@ void word_copy(xsm_word *dest, xsm_word *src)
 void word_encrypt(xsm_word *word)
 {
     int i, result = 0;
-    char *data = (char *)word;
+    char *data = word_get_string(word);
 
     for (i = 0; i < XSM_WORD_SIZE; ++i)
         result = result + data[i];
 
     word_store_integer(word, result);
-}
\ No newline at end of file
+}
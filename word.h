@@ -4,11 +4,14 @@
 
 #include "types.h"
 
+void word_classify(xsm_word *word);
 int word_get_unix_type(xsm_word *word);
 int word_get_integer(xsm_word *word);
 char *word_get_string(xsm_word *word);
 int word_store_integer(xsm_word *word, int integer);
 int word_store_string(xsm_word *word, const char *str);
+int word_store_raw(xsm_word *word, const char *data);
+void word_retrieve_raw(char *dest, xsm_word *word);
 void word_copy(xsm_word *dest, xsm_word *src);
 void word_encrypt(xsm_word *word);
 
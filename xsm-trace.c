@@ -0,0 +1,218 @@
+/*
+Decodes traces written by xsm --trace.
+
+    xsm-trace [--ptbr N] [--ip LOW[-HIGH]] [--mode kernel|user] [--summary] file
+
+Prints one line per instruction with the registers and memory it changed,
+or with --summary only the totals. The filters keep the instructions run
+under a page table, that is by one process, in a range of IPs or in a
+mode.
+*/
+
+#include "libxsm.h"
+#include "machine.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _trace_filter
+{
+    int ptbr, use_ptbr;
+    int ip_low, ip_high;
+    int mode;   /* -1 for both */
+    int summary;
+} trace_filter;
+
+typedef struct _trace_summary
+{
+    long long records, shown;
+    long long by_mode[2];
+    long long exceptions, writes, pages, overflows;
+    long long opcodes[XSM_INSTRUCTION_COUNT + 1];
+} trace_summary;
+
+/* Checks whether the record passes the filter */
+int trace_tool_match(trace_filter *filter, trace_record *record)
+{
+    int mode = (record->flags & TRACE_KERNEL) ? PRIVILEGE_KERNEL : PRIVILEGE_USER;
+
+    if (filter->use_ptbr && record->ptbr != filter->ptbr)
+        return FALSE;
+
+    if (record->ip < filter->ip_low || record->ip > filter->ip_high)
+        return FALSE;
+
+    if (filter->mode >= 0 && mode != filter->mode)
+        return FALSE;
+
+    return TRUE;
+}
+
+/* Print the record on a line */
+void trace_tool_print(long long index, trace_record *record)
+{
+    const char **names = registers_names();
+    int i;
+
+    printf("%lld %s ptbr=%d ip=%d %s", index, (record->flags & TRACE_KERNEL) ? "K" : "U", record->ptbr, record->ip,
+           record->opcode < XSM_INSTRUCTION_COUNT ? machine_get_opcode_name(record->opcode) : "-");
+
+    for (i = 0; i < record->num_registers; ++i)
+        printf(" %s=%s", names[record->registers[i]], word_get_string(&record->register_values[i]));
+
+    for (i = 0; i < record->num_writes; ++i)
+        printf(" [%d]=%s", record->writes[i], word_get_string(&record->write_values[i]));
+
+    for (i = 0; i < record->num_pages; ++i)
+        printf(" page=%d", record->pages[i]);
+
+    if (record->flags & TRACE_OVERFLOW)
+        printf(" pages-left-out");
+
+    if (record->flags & TRACE_EXCEPTION)
+        printf(" exception");
+
+    printf("\n");
+}
+
+/* Add the record to the totals */
+void trace_tool_count(trace_summary *summary, trace_record *record)
+{
+    summary->shown++;
+    summary->by_mode[(record->flags & TRACE_KERNEL) ? PRIVILEGE_KERNEL : PRIVILEGE_USER]++;
+    summary->writes += record->num_writes;
+    summary->pages += record->num_pages;
+
+    if (record->flags & TRACE_EXCEPTION)
+        summary->exceptions++;
+
+    if (record->flags & TRACE_OVERFLOW)
+        summary->overflows++;
+
+    if (record->opcode < XSM_INSTRUCTION_COUNT)
+        summary->opcodes[record->opcode]++;
+    else
+        summary->opcodes[XSM_INSTRUCTION_COUNT]++;
+}
+
+/* Print the totals */
+void trace_tool_print_summary(trace_summary *summary)
+{
+    int opcode;
+
+    printf("Instructions: %lld, %lld shown, %lld in KERNEL mode, %lld in USER mode\n",
+           summary->records, summary->shown, summary->by_mode[PRIVILEGE_KERNEL], summary->by_mode[PRIVILEGE_USER]);
+    printf("Exceptions: %lld, memory words written: %lld, pages written: %lld\n",
+           summary->exceptions, summary->writes, summary->pages);
+
+    if (summary->overflows)
+        printf("Instructions with pages left out of the trace: %lld\n", summary->overflows);
+
+    for (opcode = 0; opcode <= XSM_INSTRUCTION_COUNT; ++opcode)
+        if (summary->opcodes[opcode])
+            printf("%-10s %lld\n", opcode < XSM_INSTRUCTION_COUNT ? machine_get_opcode_name(opcode) : "-",
+                   summary->opcodes[opcode]);
+}
+
+/* Parse the arguments into the filter, returns the trace file */
+const char *trace_tool_parse_args(int argc, char **argv, trace_filter *filter)
+{
+    const char *filename = NULL;
+    char *dash;
+    int i;
+
+    filter->use_ptbr = FALSE;
+    filter->ip_low = 0;
+    filter->ip_high = 0x7fffffff;
+    filter->mode = -1;
+    filter->summary = FALSE;
+
+    for (i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--ptbr") && i + 1 < argc)
+        {
+            filter->use_ptbr = TRUE;
+            filter->ptbr = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--ip") && i + 1 < argc)
+        {
+            i++;
+            filter->ip_low = atoi(argv[i]);
+            dash = strchr(argv[i], '-');
+            filter->ip_high = dash ? atoi(dash + 1) : filter->ip_low;
+        }
+        else if (!strcmp(argv[i], "--mode") && i + 1 < argc)
+        {
+            i++;
+
+            if (!strcmp(argv[i], "kernel"))
+                filter->mode = PRIVILEGE_KERNEL;
+            else if (!strcmp(argv[i], "user"))
+                filter->mode = PRIVILEGE_USER;
+            else
+                return NULL;
+        }
+        else if (!strcmp(argv[i], "--summary"))
+            filter->summary = TRUE;
+        else if (argv[i][0] != '-' && !filename)
+            filename = argv[i];
+        else
+            return NULL;
+    }
+
+    return filename;
+}
+
+/* Main function */
+int main(int argc, char **argv)
+{
+    trace_filter filter;
+    trace_summary summary;
+    trace_reader reader;
+    trace_record *record;
+    const char *filename;
+
+    filename = trace_tool_parse_args(argc, argv, &filter);
+
+    if (!filename)
+    {
+        fprintf(stderr, "Usage: xsm-trace [--ptbr N] [--ip LOW[-HIGH]] [--mode kernel|user] [--summary] file\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!trace_reader_open(&reader, filename))
+    {
+        fprintf(stderr, "Could not read the trace %s\n", filename);
+        return EXIT_FAILURE;
+    }
+
+    record = (trace_record *)malloc(sizeof(trace_record));
+
+    if (!record)
+        return EXIT_FAILURE;
+
+    memset(&summary, 0, sizeof(trace_summary));
+
+    while (trace_read_record(&reader, record))
+    {
+        summary.records++;
+
+        if (!trace_tool_match(&filter, record))
+            continue;
+
+        if (!filter.summary)
+            trace_tool_print(summary.records - 1, record);
+
+        trace_tool_count(&summary, record);
+    }
+
+    if (filter.summary)
+        trace_tool_print_summary(&summary);
+
+    free(record);
+    trace_reader_close(&reader);
+
+    return EXIT_SUCCESS;
+}